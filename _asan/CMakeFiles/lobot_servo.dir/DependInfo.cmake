@@ -0,0 +1,34 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/control_linux.c" "CMakeFiles/lobot_servo.dir/src/control_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/control_linux.c.o.d"
+  "/root/repo/src/decimator.c" "CMakeFiles/lobot_servo.dir/src/decimator.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/decimator.c.o.d"
+  "/root/repo/src/frame.c" "CMakeFiles/lobot_servo.dir/src/frame.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/frame.c.o.d"
+  "/root/repo/src/health.c" "CMakeFiles/lobot_servo.dir/src/health.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/health.c.o.d"
+  "/root/repo/src/port.c" "CMakeFiles/lobot_servo.dir/src/port.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/port.c.o.d"
+  "/root/repo/src/reactor_linux.c" "CMakeFiles/lobot_servo.dir/src/reactor_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/reactor_linux.c.o.d"
+  "/root/repo/src/recorder_linux.c" "CMakeFiles/lobot_servo.dir/src/recorder_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/recorder_linux.c.o.d"
+  "/root/repo/src/replay_linux.c" "CMakeFiles/lobot_servo.dir/src/replay_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/replay_linux.c.o.d"
+  "/root/repo/src/scan_linux.c" "CMakeFiles/lobot_servo.dir/src/scan_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/scan_linux.c.o.d"
+  "/root/repo/src/sched_linux.c" "CMakeFiles/lobot_servo.dir/src/sched_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/sched_linux.c.o.d"
+  "/root/repo/src/servo.c" "CMakeFiles/lobot_servo.dir/src/servo.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/servo.c.o.d"
+  "/root/repo/src/shadow.c" "CMakeFiles/lobot_servo.dir/src/shadow.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/shadow.c.o.d"
+  "/root/repo/src/sim_linux.c" "CMakeFiles/lobot_servo.dir/src/sim_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/sim_linux.c.o.d"
+  "/root/repo/src/trajectory.c" "CMakeFiles/lobot_servo.dir/src/trajectory.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/trajectory.c.o.d"
+  "/root/repo/src/transport_linux.c" "CMakeFiles/lobot_servo.dir/src/transport_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/transport_linux.c.o.d"
+  "/root/repo/src/transport_mem_linux.c" "CMakeFiles/lobot_servo.dir/src/transport_mem_linux.c.o" "gcc" "CMakeFiles/lobot_servo.dir/src/transport_mem_linux.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lobot_bench.dir/lobot_bench.c.o"
+  "CMakeFiles/lobot_bench.dir/lobot_bench.c.o.d"
+  "lobot_bench"
+  "lobot_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/lobot_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
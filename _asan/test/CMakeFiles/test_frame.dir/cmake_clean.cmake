@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_frame.dir/test_frame.cpp.o"
+  "CMakeFiles/test_frame.dir/test_frame.cpp.o.d"
+  "test_frame"
+  "test_frame.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test_frame.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,41 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lobot_servo.dir/src/control_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/control_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/decimator.c.o"
+  "CMakeFiles/lobot_servo.dir/src/decimator.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/frame.c.o"
+  "CMakeFiles/lobot_servo.dir/src/frame.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/health.c.o"
+  "CMakeFiles/lobot_servo.dir/src/health.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/port.c.o"
+  "CMakeFiles/lobot_servo.dir/src/port.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/reactor_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/reactor_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/recorder_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/recorder_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/replay_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/replay_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/scan_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/scan_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/sched_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/sched_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/servo.c.o"
+  "CMakeFiles/lobot_servo.dir/src/servo.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/shadow.c.o"
+  "CMakeFiles/lobot_servo.dir/src/shadow.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/sim_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/sim_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/trajectory.c.o"
+  "CMakeFiles/lobot_servo.dir/src/trajectory.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/transport_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/transport_linux.c.o.d"
+  "CMakeFiles/lobot_servo.dir/src/transport_mem_linux.c.o"
+  "CMakeFiles/lobot_servo.dir/src/transport_mem_linux.c.o.d"
+  "liblobot_servo.a"
+  "liblobot_servo.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/lobot_servo.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
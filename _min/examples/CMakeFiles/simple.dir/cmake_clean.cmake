@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/simple.dir/simple.c.o"
+  "CMakeFiles/simple.dir/simple.c.o.d"
+  "simple"
+  "simple.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/simple.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_decimator.dir/test_decimator.c.o"
+  "CMakeFiles/test_decimator.dir/test_decimator.c.o.d"
+  "test_decimator"
+  "test_decimator.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_decimator.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
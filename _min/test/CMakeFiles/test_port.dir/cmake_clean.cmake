@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_port.dir/test_port.c.o"
+  "CMakeFiles/test_port.dir/test_port.c.o.d"
+  "test_port"
+  "test_port.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_port.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
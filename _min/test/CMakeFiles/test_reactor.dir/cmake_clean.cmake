@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_reactor.dir/test_reactor.c.o"
+  "CMakeFiles/test_reactor.dir/test_reactor.c.o.d"
+  "test_reactor"
+  "test_reactor.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_reactor.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
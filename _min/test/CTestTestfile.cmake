@@ -0,0 +1,36 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/test
+# Build directory: /root/repo/_min/test
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(port "/root/repo/_min/test/test_port")
+set_tests_properties(port PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;7;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(decimator "/root/repo/_min/test/test_decimator")
+set_tests_properties(decimator PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;11;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(sim "/root/repo/_min/test/test_sim")
+set_tests_properties(sim PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;15;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(shadow "/root/repo/_min/test/test_shadow")
+set_tests_properties(shadow PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;19;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(replay "/root/repo/_min/test/test_replay")
+set_tests_properties(replay PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;23;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(trajectory "/root/repo/_min/test/test_trajectory")
+set_tests_properties(trajectory PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;27;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(sweep "/root/repo/_min/test/test_sweep")
+set_tests_properties(sweep PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;31;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(recorder "/root/repo/_min/test/test_recorder")
+set_tests_properties(recorder PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;35;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(frame "/root/repo/_min/test/test_frame")
+set_tests_properties(frame PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;39;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(scan "/root/repo/_min/test/test_scan")
+set_tests_properties(scan PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;43;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(frames "/root/repo/_min/test/test_frames")
+set_tests_properties(frames PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;47;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(health "/root/repo/_min/test/test_health")
+set_tests_properties(health PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;51;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(reactor "/root/repo/_min/test/test_reactor")
+set_tests_properties(reactor PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;55;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(control "/root/repo/_min/test/test_control")
+set_tests_properties(control PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;59;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(sched "/root/repo/_min/test/test_sched")
+set_tests_properties(sched PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;63;add_test;/root/repo/test/CMakeLists.txt;0;")
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lobot_sim.dir/lobot_sim.c.o"
+  "CMakeFiles/lobot_sim.dir/lobot_sim.c.o.d"
+  "lobot_sim"
+  "lobot_sim.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/lobot_sim.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
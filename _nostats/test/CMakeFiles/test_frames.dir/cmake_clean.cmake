@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_frames.dir/test_frames.c.o"
+  "CMakeFiles/test_frames.dir/test_frames.c.o.d"
+  "test_frames"
+  "test_frames.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_frames.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
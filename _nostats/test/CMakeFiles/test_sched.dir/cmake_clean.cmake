@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_sched.dir/test_sched.c.o"
+  "CMakeFiles/test_sched.dir/test_sched.c.o.d"
+  "test_sched"
+  "test_sched.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_sched.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lobot_parse.dir/parse.c.o"
+  "CMakeFiles/lobot_parse.dir/parse.c.o.d"
+  "liblobot_parse.a"
+  "liblobot_parse.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/lobot_parse.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
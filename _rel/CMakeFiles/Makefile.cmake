@@ -0,0 +1,84 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "/root/repo/CMakeLists.txt"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/bench/CMakeLists.txt"
+  "/root/repo/examples/CMakeLists.txt"
+  "/root/repo/test/CMakeLists.txt"
+  "/root/repo/utils/CMakeLists.txt"
+  "/usr/share/cmake-3.25/Modules/CMakeCInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFile.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  "utils/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "bench/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "test/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "examples/CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "CMakeFiles/lobot_servo.dir/DependInfo.cmake"
+  "utils/CMakeFiles/lobot_parse.dir/DependInfo.cmake"
+  "utils/CMakeFiles/lobot_util.dir/DependInfo.cmake"
+  "utils/CMakeFiles/lobot_sim.dir/DependInfo.cmake"
+  "bench/CMakeFiles/lobot_bench.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_port.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_decimator.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_sim.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_shadow.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_replay.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_trajectory.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_sweep.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_recorder.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_frame.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_scan.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_frames.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_health.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_reactor.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_control.dir/DependInfo.cmake"
+  "test/CMakeFiles/test_sched.dir/DependInfo.cmake"
+  "examples/CMakeFiles/simple.dir/DependInfo.cmake"
+  "examples/CMakeFiles/control.dir/DependInfo.cmake"
+  "examples/CMakeFiles/frames.dir/DependInfo.cmake"
+  )
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_recorder.dir/test_recorder.c.o"
+  "CMakeFiles/test_recorder.dir/test_recorder.c.o.d"
+  "test_recorder"
+  "test_recorder.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_recorder.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lobot_util.dir/lobot_util.c.o"
+  "CMakeFiles/lobot_util.dir/lobot_util.c.o.d"
+  "lobot_util"
+  "lobot_util.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/lobot_util.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
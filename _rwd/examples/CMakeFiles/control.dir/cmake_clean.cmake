@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/control.dir/control.c.o"
+  "CMakeFiles/control.dir/control.c.o.d"
+  "control"
+  "control.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/control.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/frames.dir/frames.cpp.o"
+  "CMakeFiles/frames.dir/frames.cpp.o.d"
+  "frames"
+  "frames.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/frames.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
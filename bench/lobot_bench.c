@@ -0,0 +1,426 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+#include "lobot_servo/sim.h"
+
+#include "parse.h"
+
+#define VERSION_STRING "1.0"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a[0])))
+
+struct args
+{
+    const char* dev_path;
+    bool sim;
+    uint32_t baud;
+    uint32_t turnaround_us;
+    bool echo;
+    bool calibrate;
+    uint8_t ids[LOBOT_SIM_SERVOS_MAX];
+    size_t n;
+    unsigned iterations;
+};
+
+/* one round trip of a getter against a servo */
+typedef lobot_error_t (*getter_t)(struct lobot_port_t* port, uint8_t id);
+
+static lobot_error_t bench_get_id(struct lobot_port_t* port, uint8_t id)
+{
+    uint8_t id_out;
+    return lobot_get_id(port, id, &id_out);
+}
+
+static lobot_error_t bench_get_pos(struct lobot_port_t* port, uint8_t id)
+{
+    uint16_t pos;
+    return lobot_get_pos(port, id, &pos);
+}
+
+static lobot_error_t bench_get_offset(struct lobot_port_t* port, uint8_t id)
+{
+    int8_t offset;
+    return lobot_get_offset(port, id, &offset);
+}
+
+static lobot_error_t bench_get_limit(struct lobot_port_t* port, uint8_t id)
+{
+    uint16_t min, max;
+    return lobot_get_limit(port, id, &min, &max);
+}
+
+static const struct getter_table {
+    const char* name;
+    getter_t func;
+} getter_table[] = {
+    {"get_id"    , bench_get_id},
+    {"get_pos"   , bench_get_pos},
+    {"get_offset", bench_get_offset},
+    {"get_limit" , bench_get_limit},
+};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* nearest rank percentile of sorted samples */
+static double percentile(const uint64_t* sorted, size_t n, double p)
+{
+    size_t rank = (size_t)(p / 100.0 * n + 0.999999);
+
+    if (n == 0) {
+        return 0.0;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[(rank > n ? n : rank) - 1] / 1000.0;
+}
+
+static void bench_getter(struct lobot_port_t* port, const struct args* args,
+        const struct getter_table* getter, uint64_t* samples, bool last)
+{
+    uint64_t start, cpu_start, cpu_ns, sum = 0;
+    unsigned i, errors = 0, timeouts = 0;
+    size_t n = 0;
+    lobot_error_t ret;
+
+    cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    for (i = 0; i < args->iterations; ++i) {
+        start = clock_ns(CLOCK_MONOTONIC);
+        ret = getter->func(port, args->ids[i % args->n]);
+        if (ret == LOBOT_OK) {
+            samples[n] = clock_ns(CLOCK_MONOTONIC) - start;
+            sum += samples[n++];
+        } else if (ret == LOBOT_TIMEOUT || ret == LOBOT_NO_REPLY) {
+            timeouts++;
+        } else {
+            errors++;
+        }
+    }
+    cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+    qsort(samples, n, sizeof(samples[0]), compare_u64);
+    fprintf(stdout,
+            "    \"%s\": {\"count\": %zu, \"timeouts\": %u, \"errors\": %u, "
+            "\"min\": %.1f, \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, "
+            "\"p99.9\": %.1f, \"max\": %.1f, \"cpu_us\": %.2f}%s\n",
+            getter->name, n, timeouts, errors,
+            n ? samples[0] / 1000.0 : 0.0, n ? sum / 1000.0 / n : 0.0,
+            percentile(samples, n, 50.0), percentile(samples, n, 99.0),
+            percentile(samples, n, 99.9), n ? samples[n - 1] / 1000.0 : 0.0,
+            cpu_ns / 1000.0 / args->iterations, last ? "" : ",");
+}
+
+static void bench_set_pos(struct lobot_port_t* port, const struct args* args)
+{
+    uint64_t start, cpu_start, elapsed_ns, cpu_ns;
+    uint32_t timeout_us;
+    unsigned i, errors = 0;
+
+    cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    start = clock_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < args->iterations; ++i) {
+        if (lobot_set_pos(port, args->ids[i % args->n],
+                    LOBOT_ANGLE_RAW_MIN + i % LOBOT_ANGLE_RAW_MAX, 20) != LOBOT_OK) {
+            errors++;
+        }
+    }
+    /* frames only count once they are on the wire, a write may return long
+     * before that, so wait for a reply queued behind them */
+    timeout_us = lobot_port_get_timeout(port);
+    lobot_port_set_timeout(port, 5000000);
+    bench_get_pos(port, args->ids[0]);
+    lobot_port_set_timeout(port, timeout_us);
+    elapsed_ns = clock_ns(CLOCK_MONOTONIC) - start;
+    cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+    fprintf(stdout,
+            "  \"set_pos\": {\"frames\": %u, \"errors\": %u, \"seconds\": %.3f, "
+            "\"frames_per_s\": %.1f, \"cpu_us\": %.2f},\n",
+            args->iterations, errors, elapsed_ns / 1e9,
+            args->iterations / (elapsed_ns / 1e9),
+            cpu_ns / 1000.0 / args->iterations);
+}
+
+/* read all positions once per cycle, in one pipelined sweep or with one
+ * lobot_get_pos per joint */
+static void bench_cycles(struct lobot_port_t* port, const struct args* args,
+        bool sweep, double* joints_per_s)
+{
+    uint64_t start, cpu_start, elapsed_ns, cpu_ns;
+    uint16_t pos[LOBOT_SIM_SERVOS_MAX];
+    lobot_error_t status[LOBOT_SIM_SERVOS_MAX];
+    unsigned i, cycles, joints = 0, errors = 0;
+    size_t k;
+
+    cycles = (args->iterations + args->n - 1) / args->n;
+    cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    start = clock_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < cycles; ++i) {
+        if (sweep) {
+            lobot_read_positions(port, args->ids, args->n, pos, status);
+        } else {
+            for (k = 0; k < args->n; ++k) {
+                status[k] = lobot_get_pos(port, args->ids[k], &pos[k]);
+            }
+        }
+        for (k = 0; k < args->n; ++k) {
+            if (status[k] == LOBOT_OK) {
+                joints++;
+            } else {
+                errors++;
+            }
+        }
+    }
+    elapsed_ns = clock_ns(CLOCK_MONOTONIC) - start;
+    cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    *joints_per_s = joints / (elapsed_ns / 1e9);
+
+    fprintf(stdout,
+            "    \"%s\": {\"cycles\": %u, \"joints\": %u, \"errors\": %u, "
+            "\"seconds\": %.3f, \"cycles_per_s\": %.1f, \"joints_per_s\": %.1f, "
+            "\"cpu_us\": %.2f},\n",
+            sweep ? "sweep" : "get_pos_loop", cycles, joints, errors,
+            elapsed_ns / 1e9, cycles / (elapsed_ns / 1e9), *joints_per_s,
+            cpu_ns / 1000.0 / (cycles * args->n));
+}
+
+static void bench_sweep(struct lobot_port_t* port, const struct args* args)
+{
+    double loop, sweep;
+
+    fprintf(stdout, "  \"positions\": {\n");
+    bench_cycles(port, args, false, &loop);
+    bench_cycles(port, args, true, &sweep);
+    fprintf(stdout, "    \"speedup\": %.2f\n  }\n", loop > 0 ? sweep / loop : 0.0);
+}
+
+static void usage(const char* name)
+{
+    fprintf(stdout,
+            "Usage: %s [-d port | -s] [-i id1[,id2...]] [-b baud] [-n count] "
+            "[-t us] [-e] [-c] [-h] [-v]\n"
+            "\n"
+            "Measure round trip latency of each getter, set_pos throughput, "
+            "position sweep rate and CPU cost per transaction, printed as JSON\n"
+            "\n"
+            "Options:\n"
+            "\t-d|--device port              Serial port for Lobot servo, default /dev/ttyUSB0\n"
+            "\t-s|--sim                      Run against an in-process simulated bus on a pty\n"
+            "\t-i|--ids id1[,id2...]         Servo IDs to exercise, default 1\n"
+            "\t-b|--baud baud                Bus baud rate, default 115200\n"
+            "\t-n|--count count              Transactions per measurement, default 1000\n"
+            "\t-t|--turnaround us            Simulated servo turnaround, default 100\n"
+            "\t-e|--echo                     Simulated adapter echoes requests\n"
+            "\t-c|--calibrate                Calibrate the port against the first ID\n"
+            "\n"
+            "\t-v|--version                  Version information\n"
+            "\t-h|--help                     This message\n"
+            "\n"
+            "Examples:\n"
+            "lobot_bench -d /dev/ttyUSB0 -i 1,2,3 > usb0.json\n"
+            "  benchmark servos 1 to 3 on /dev/ttyUSB0\n"
+            "lobot_bench -s -i 1,2,3,4,5,6 -b 1000000\n"
+            "  benchmark the library against six simulated servos at 1 Mbaud\n"
+            , name);
+}
+
+static struct option options[] =
+{
+    {"help", no_argument, 0, 'h'},
+    {"version", no_argument, 0, 'v'},
+
+    {"device", required_argument, 0, 'd'},
+    {"sim", no_argument, 0, 's'},
+    {"ids", required_argument, 0, 'i'},
+    {"baud", required_argument, 0, 'b'},
+    {"count", required_argument, 0, 'n'},
+    {"turnaround", required_argument, 0, 't'},
+    {"echo", no_argument, 0, 'e'},
+    {"calibrate", no_argument, 0, 'c'},
+    {0, 0, 0, 0},
+};
+
+static void parse_option(struct args* args, int argc, char* argv[])
+{
+    int opt, opt_index = 0;
+
+    while ((opt = getopt_long(argc, argv, ":d:si:b:n:t:echv",
+                    options, &opt_index)) != -1) {
+        switch (opt) {
+            case 'd':
+                args->dev_path = optarg;
+                break;
+            case 's':
+                args->sim = true;
+                break;
+            case 'i':
+                args->n = parse_ids(optarg, args->ids, ARRAY_SIZE(args->ids));
+                if (args->n == 0) {
+                    fprintf(stderr, "Error: Servo IDs should be in range of [0, 253]\n");
+                    usage(argv[0]);
+                    exit(-EINVAL);
+                }
+                break;
+            case 'b':
+                args->baud = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                args->iterations = strtoul(optarg, NULL, 10);
+                if (args->iterations == 0) {
+                    fprintf(stderr, "Error: Invalid count\n");
+                    usage(argv[0]);
+                    exit(-EINVAL);
+                }
+                break;
+            case 't':
+                args->turnaround_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                args->echo = true;
+                break;
+            case 'c':
+                args->calibrate = true;
+                break;
+            case ':':
+                fprintf(stderr, "Error: Missing argument for option %s\n", argv[optind-1]);
+                usage(argv[0]);
+                exit(-EINVAL);
+            case 'v':
+                fprintf(stdout, "lobot_bench "VERSION_STRING"\n");
+                exit(0);
+            case 'h':
+            default: /* '?' */
+                usage(argv[0]);
+                exit(0);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    struct lobot_port_options port_options;
+    struct lobot_port_calibration cal = {0};
+    struct lobot_port_info info;
+    struct lobot_port_t* sim_port = NULL;
+    struct lobot_sim_t* sim = NULL;
+    struct lobot_port_t* port;
+    struct args args = {0};
+    uint64_t* samples;
+    size_t i;
+
+    args.dev_path = getenv("LOBOT_DEVICE_PATH");
+    if (args.dev_path == NULL) {
+        args.dev_path = "/dev/ttyUSB0";
+    }
+    args.baud = LOBOT_PORT_BAUD;
+    args.turnaround_us = 100;
+    args.ids[0] = 1;
+    args.n = 1;
+    args.iterations = 1000;
+
+    parse_option(&args, argc, argv);
+
+    lobot_port_options_init(&port_options);
+    port_options.baud = args.baud;
+
+    if (args.sim) {
+        struct lobot_sim_config config = {0};
+
+        config.ids = args.ids;
+        config.n = args.n;
+        config.reply_delay_us = args.turnaround_us;
+        config.echo = args.echo;
+
+        sim_port = lobot_port_open_transport(&lobot_transport_pty, NULL, NULL,
+                &port_options);
+        sim = sim_port ? lobot_sim_create(sim_port, &config) : NULL;
+        if (!sim || lobot_sim_start(sim) < 0) {
+            fprintf(stderr, "Cannot start simulated bus\n");
+            exit(-ENODEV);
+        }
+        args.dev_path = lobot_port_peer(sim_port);
+    }
+
+    port = lobot_port_open_ex(args.dev_path, &port_options);
+    if (!port) {
+        fprintf(stderr, "Cannot open port %s\n", args.dev_path);
+        exit(-ENODEV);
+    }
+    if (args.calibrate && lobot_port_calibrate(port, args.ids[0], &cal) < 0) {
+        fprintf(stderr, "Cannot calibrate port %s\n", args.dev_path);
+        exit(-EIO);
+    }
+    lobot_port_info(port, &info);
+
+    samples = calloc(args.iterations, sizeof(*samples));
+    if (!samples) {
+        exit(-ENOMEM);
+    }
+
+    fprintf(stdout, "{\n  \"bench_version\": \"%s\",\n  \"device\": \"%s\",\n"
+            "  \"sim\": %s,\n  \"baud\": %u,\n  \"low_latency\": %d,\n"
+            "  \"latency_timer_ms\": %d,\n  \"count\": %u,\n  \"ids\": [",
+            VERSION_STRING, args.sim ? "sim" : args.dev_path,
+            args.sim ? "true" : "false", info.baud, info.low_latency,
+            info.latency_timer_ms, args.iterations);
+    for (i = 0; i < args.n; ++i) {
+        fprintf(stdout, "%s%u", i ? ", " : "", args.ids[i]);
+    }
+    fprintf(stdout, "],\n  \"calibrated\": %s,\n  \"echo\": %d,\n"
+            "  \"adapter_latency_us\": %u,\n  \"rtt_us\": %u,\n",
+            args.calibrate ? "true" : "false", cal.echo, cal.latency_us, cal.rtt_us);
+    fprintf(stdout, "  \"latency_us\": {\n");
+    for (i = 0; i < ARRAY_SIZE(getter_table); ++i) {
+        bench_getter(port, &args, &getter_table[i], samples,
+                i + 1 == ARRAY_SIZE(getter_table));
+    }
+    fprintf(stdout, "  },\n");
+    bench_set_pos(port, &args);
+    bench_sweep(port, &args);
+    fprintf(stdout, "}\n");
+
+    free(samples);
+    lobot_port_close(port);
+    if (sim) {
+        lobot_sim_destroy(sim);
+        lobot_port_close(sim_port);
+    }
+    return 0;
+}
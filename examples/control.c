@@ -0,0 +1,58 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "lobot_servo/control.h"
+#include "lobot_servo/port.h"
+
+int main(void)
+{
+    const uint8_t ids[] = {1};
+    struct lobot_control_config config = {
+        .period_us = 5000,
+        .ids = ids,
+        .n = sizeof(ids),
+    };
+    struct lobot_servo_state state;
+    struct lobot_control_t* ctl;
+    struct lobot_port_t* port;
+
+    port = lobot_port_open("/dev/ttyUSB0");
+    if(!port) exit(-1);
+
+    ctl = lobot_control_create(port, &config);
+    if(!ctl || lobot_control_start(ctl) != 0) exit(-1);
+
+    int t = 0;
+    int delta = 10;
+    for (int i = 0; i < 1000; ++i) {
+        t += delta;
+        if(t >= 1000 || t < 0) delta = -delta;
+
+        /* setpoints are queued, the control thread keeps the bus cadence */
+        lobot_control_set_pos(ctl, 1, t, 20);
+        if (lobot_control_get_state(ctl, 1, &state) == 0) {
+            printf("target:%d pos:%d status:%d\n", t, state.position, state.status);
+        }
+        usleep(20000);
+    }
+
+    lobot_control_destroy(ctl);
+}
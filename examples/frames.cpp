@@ -0,0 +1,62 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "lobot_servo/frame.hpp"
+
+/* frames of constant commands are built by the compiler */
+constexpr auto stop_all = lobot::make_frame<LOBOT_CMD_MOVE_STOP>(lobot::broadcast);
+constexpr auto unload_all = lobot::make_frame<LOBOT_CMD_LOAD_OR_UNLOAD_WRITE>(lobot::broadcast, 0);
+constexpr auto center_1 = lobot::make_frame<LOBOT_CMD_MOVE_TIME_WRITE>(1, 500, 1000);
+
+static_assert(stop_all.size() == 6, "MOVE_STOP has no parameters");
+static_assert(stop_all[4] == LOBOT_CMD_MOVE_STOP && stop_all[5] == 0xF2,
+        "checksum folded at compile time");
+static_assert(center_1[5] == 0xF4 && center_1[6] == 0x01, "little endian position");
+static_assert(lobot::frame_valid(unload_all) && lobot::frame_valid(center_1), "valid frames");
+static_assert(lobot::command_traits<LOBOT_CMD_POS_READ>::reply_len == 8, "POS_READ reply length");
+static_assert(lobot::decode<LOBOT_CMD_POS_READ>(
+            lobot::reply<LOBOT_CMD_POS_READ>{{0x55, 0x55, 1, 5, 28, 0xF4, 0x01, 0}}) == 500,
+        "positions decode like lobot_get_pos");
+
+int main(int argc, char* argv[])
+{
+    const char* dev = argc > 1 ? argv[1] : "/dev/ttyUSB0";
+    struct lobot_port_t* port;
+    uint16_t pos = 0;
+    int ret;
+
+    port = lobot_port_open(dev);
+    if (!port) {
+        fprintf(stderr, "Cannot open port %s\n", dev);
+        return EXIT_FAILURE;
+    }
+
+    lobot::write(port, center_1);
+    ret = lobot::read<LOBOT_CMD_POS_READ>(port, 1, pos);
+    if (ret > 0) {
+        printf("servo 1 at %u\n", pos);
+    } else {
+        printf("servo 1 didn't answer (%d)\n", ret);
+    }
+    lobot::write(port, stop_all);
+
+    lobot_port_close(port);
+    return 0;
+}
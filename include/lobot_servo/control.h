@@ -0,0 +1,114 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__CONTROL_H_
+#define MOGI_LOBOT__CONTROL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+#include "servo.h"
+
+/* setpoints that can be queued between two control cycles */
+#define LOBOT_CONTROL_QUEUE_LEN (256)
+
+/* struct representing a background control loop owning a port */
+struct lobot_control_t;
+
+/* control loop configuration */
+struct lobot_control_config {
+    uint32_t period_us;     /* cycle period, in microseconds */
+    const uint8_t* ids;     /* servos whose position is read every cycle */
+    size_t n;               /* number of ids, at most LOBOT_ID_MAX + 1 */
+};
+
+/* latest known state of a servo */
+struct lobot_servo_state {
+    uint64_t timestamp_us;  /* CLOCK_MONOTONIC time of the reading */
+    uint64_t cycle;         /* control cycle of the reading */
+    lobot_error_t status;   /* result of the last read */
+    uint16_t position;      /* last successfully read position */
+};
+
+/* create a control loop, taking ownership of port
+ * @param port Port returned by lobot_port_open, closed by
+ *        lobot_control_destroy
+ * @param config Loop configuration, ids are copied
+ * @return struct lobot_control_t *, NULL on failure
+ */
+struct lobot_control_t* lobot_control_create(struct lobot_port_t* port,
+        const struct lobot_control_config* config);
+
+/* start the control thread
+ * Every cycle, queued setpoints are sent with lobot_set_pos_multi, positions
+ * are read with lobot_read_positions and published, then the thread sleeps
+ * until the next absolute cycle deadline.
+ * @param ctl Control loop returned by lobot_control_create
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_control_start(struct lobot_control_t* ctl);
+
+/* stop the control thread and wait for it to exit
+ * @param ctl Control loop returned by lobot_control_create
+ */
+void lobot_control_stop(struct lobot_control_t* ctl);
+
+/* queue a setpoint for the next cycle, safe to call from any thread
+ * Only the latest setpoint of each servo is sent per cycle.
+ * @param ctl Control loop returned by lobot_control_create
+ * @param id Target servo ID, broadcast isn't accepted
+ * @param position Target servo position
+ * @param time Duration for the move, in milliseconds
+ * @return 0 on success, -EAGAIN if the queue is full, -EINVAL if id is above
+ *         LOBOT_ID_MAX
+ */
+int lobot_control_set_pos(struct lobot_control_t* ctl, uint8_t id,
+        uint16_t position, uint16_t time);
+
+/* read latest state of a servo without blocking, safe to call from any thread
+ * @param ctl Control loop returned by lobot_control_create
+ * @param id Servo ID, one of the configured ids
+ * @param state_out Output state
+ * @return 0 on success, -ENOENT if the servo isn't polled by the loop
+ */
+int lobot_control_get_state(struct lobot_control_t* ctl, uint8_t id,
+        struct lobot_servo_state* state_out);
+
+/* number of cycles that missed their deadline
+ * @param ctl Control loop returned by lobot_control_create
+ */
+uint64_t lobot_control_overruns(struct lobot_control_t* ctl);
+
+/* number of cycles whose setpoints failed to go out, see lobot_set_pos_multi
+ * @param ctl Control loop returned by lobot_control_create
+ */
+uint64_t lobot_control_write_errors(struct lobot_control_t* ctl);
+
+/* stop the loop, close its port and free it
+ * @param ctl Control loop returned by lobot_control_create
+ */
+void lobot_control_destroy(struct lobot_control_t* ctl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
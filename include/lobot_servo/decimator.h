@@ -0,0 +1,110 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__DECIMATOR_H_
+#define MOGI_LOBOT__DECIMATOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+
+/* move output callback
+ * @param ctx Context given in configuration
+ * @param id Servo ID
+ * @param position Target position of the move
+ * @param time_ms Duration of the move
+ */
+typedef void (*lobot_decimator_emit)(void* ctx, uint8_t id, uint16_t position,
+        uint16_t time_ms);
+
+/* decimator configuration */
+struct lobot_decimator_config {
+    float tolerance;            /* largest distance, in raw units, between an
+                                   input sample and the emitted moves, 2 if 0 */
+    uint16_t segment_max_ms;    /* longest move, bounding output latency,
+                                   500 if 0; a gap in the samples longer
+                                   than this is crossed in this time */
+    lobot_decimator_emit emit;  /* NULL to send moves with lobot_set_pos */
+    void* ctx;                  /* context passed to emit */
+};
+
+/* per servo counters */
+struct lobot_decimator_stats {
+    uint32_t samples;           /* input samples */
+    uint32_t moves;             /* emitted moves */
+    uint32_t failed;            /* moves lobot_set_pos failed to send */
+};
+
+/* struct representing a setpoint compressor */
+struct lobot_decimator_t;
+
+/* create a setpoint compressor
+ * Dense setpoint streams are fitted with piecewise linear segments, each sent
+ * as one MOVE_TIME_WRITE once extending it would break the tolerance. A move
+ * covers the segment just closed, so output trails input by at most
+ * segment_max_ms plus one sample.
+ * @param port Port returned by lobot_port_open, may be NULL if emit is set
+ * @param config Configuration, NULL for defaults
+ * @return struct lobot_decimator_t *, NULL on failure
+ */
+struct lobot_decimator_t* lobot_decimator_create(struct lobot_port_t* port,
+        const struct lobot_decimator_config* config);
+
+/* feed a setpoint sample, time stamps of a servo must increase
+ * The first sample of a servo only anchors its first segment.
+ * @param dec Decimator returned by lobot_decimator_create
+ * @param id Servo ID
+ * @param t_ms Time stamp of the sample
+ * @param position Setpoint, in raw units
+ * @return 1 if a move was emitted, 0 if not, -EIO if lobot_set_pos failed to
+ *         send it, the segment is dropped then, other negative errno on
+ *         failure
+ */
+int lobot_decimator_push(struct lobot_decimator_t* dec, uint8_t id,
+        uint32_t t_ms, float position);
+
+/* emit the pending segment of a servo up to its last sample
+ * @param dec Decimator returned by lobot_decimator_create
+ * @param id Servo ID
+ * @return 1 if a move was emitted, 0 if not, -EIO if lobot_set_pos failed to
+ *         send it, other negative errno on failure
+ */
+int lobot_decimator_flush(struct lobot_decimator_t* dec, uint8_t id);
+
+/* get counters of a servo
+ * @param dec Decimator returned by lobot_decimator_create
+ * @param id Servo ID
+ * @param stats_out Output counters
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_decimator_stats(struct lobot_decimator_t* dec, uint8_t id,
+        struct lobot_decimator_stats* stats_out);
+
+/* free a setpoint compressor, its port is left open
+ * @param dec Decimator returned by lobot_decimator_create
+ */
+void lobot_decimator_destroy(struct lobot_decimator_t* dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,349 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Header only C++14 frame layer
+ *
+ * command_traits<Cmd> describes the request parameters and the reply of every
+ * LX-15D command at compile time, and make_frame<Cmd>() encodes a request
+ * into a std::array. With constant arguments the whole frame, checksum
+ * included, is a constant expression:
+ *
+ *     constexpr auto stop_all = lobot::make_frame<LOBOT_CMD_MOVE_STOP>(lobot::broadcast);
+ *     lobot::write(port, stop_all);
+ *
+ * Nothing is allocated, frames live wherever the caller puts them.
+ */
+
+#ifndef MOGI_LOBOT__FRAME_HPP_
+#define MOGI_LOBOT__FRAME_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "port.h"
+#include "protocol.h"
+#include "servo.h"
+
+namespace lobot {
+
+/* frame header byte, sent twice */
+constexpr uint8_t frame_header = 0x55;
+/* ID all servos listen to */
+constexpr uint8_t broadcast = LOBOT_ID_BROADCAST;
+/* frame bytes besides the parameters: header(2), id, len, cmd, checksum */
+constexpr std::size_t frame_overhead = 6;
+/* index of the first parameter in a frame */
+constexpr std::size_t param_index = 5;
+
+namespace detail {
+
+constexpr uint8_t low_byte(uint16_t v)
+{
+    return static_cast<uint8_t>(v & 0xFF);
+}
+
+constexpr uint8_t high_byte(uint16_t v)
+{
+    return static_cast<uint8_t>((v >> 8) & 0xFF);
+}
+
+constexpr uint16_t u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+/* same as lobot_check_sum: inverted sum of id, len, cmd and parameters */
+template <std::size_t N>
+constexpr uint8_t checksum(uint8_t id, uint8_t cmd, const std::array<uint8_t, N>& params)
+{
+    unsigned sum = id + (N + 3) + cmd;
+    for (std::size_t i = 0; i < N; ++i) {
+        sum += params[i];
+    }
+    return static_cast<uint8_t>(~sum);
+}
+
+/* byte i of the frame carrying params, std::array can't be assigned to in a
+ * C++14 constant expression so frames are built byte by byte */
+template <std::size_t N>
+constexpr uint8_t frame_byte(std::size_t i, uint8_t id, uint8_t cmd,
+        const std::array<uint8_t, N>& params)
+{
+    return i < 2 ? frame_header :
+        i == 2 ? id :
+        i == 3 ? static_cast<uint8_t>(N + 3) :
+        i == 4 ? cmd :
+        i < param_index + N ? params[i - param_index] :
+        checksum(id, cmd, params);
+}
+
+template <std::size_t N, std::size_t... I>
+constexpr std::array<uint8_t, N + frame_overhead> build(uint8_t id, uint8_t cmd,
+        const std::array<uint8_t, N>& params, std::index_sequence<I...>)
+{
+    return {{frame_byte(I, id, cmd, params)...}};
+}
+
+} // namespace detail
+
+/* request parameter layouts */
+struct no_params {
+    static constexpr std::size_t size = 0;
+    static constexpr std::array<uint8_t, 0> params()
+    {
+        return {{}};
+    }
+};
+
+struct u8_param {
+    static constexpr std::size_t size = 1;
+    static constexpr std::array<uint8_t, 1> params(uint8_t v)
+    {
+        return {{v}};
+    }
+};
+
+struct i8_param {
+    static constexpr std::size_t size = 1;
+    static constexpr std::array<uint8_t, 1> params(int8_t v)
+    {
+        return {{static_cast<uint8_t>(v)}};
+    }
+};
+
+struct u16_pair_params {
+    static constexpr std::size_t size = 4;
+    static constexpr std::array<uint8_t, 4> params(uint16_t first, uint16_t second)
+    {
+        return {{detail::low_byte(first), detail::high_byte(first),
+            detail::low_byte(second), detail::high_byte(second)}};
+    }
+};
+
+/* move: position and time, clamped like lobot_set_pos */
+struct move_params {
+    static constexpr std::size_t size = 4;
+    static constexpr std::array<uint8_t, 4> params(uint16_t position, uint16_t time)
+    {
+        return u16_pair_params::params(
+                position > LOBOT_ANGLE_RAW_MAX ? LOBOT_ANGLE_RAW_MAX : position,
+                time > LOBOT_MOVETIME_MS_MAX ? LOBOT_MOVETIME_MS_MAX : time);
+    }
+};
+
+/* motor mode: mode byte, unused byte, signed speed */
+struct motor_mode_params {
+    static constexpr std::size_t size = 4;
+    static constexpr std::array<uint8_t, 4> params(uint8_t mode, int16_t speed)
+    {
+        return {{mode, 0, detail::low_byte(static_cast<uint16_t>(speed)),
+            detail::high_byte(static_cast<uint16_t>(speed))}};
+    }
+};
+
+/* reply layouts, decode takes a pointer to the reply's first parameter */
+struct no_reply {
+    static constexpr std::size_t size = 0;
+};
+
+struct u8_reply {
+    static constexpr std::size_t size = 1;
+    using reply_type = uint8_t;
+    static constexpr reply_type decode(const uint8_t* p)
+    {
+        return p[0];
+    }
+};
+
+struct i8_reply {
+    static constexpr std::size_t size = 1;
+    using reply_type = int8_t;
+    static constexpr reply_type decode(const uint8_t* p)
+    {
+        return static_cast<int8_t>(p[0]);
+    }
+};
+
+struct u16_reply {
+    static constexpr std::size_t size = 2;
+    using reply_type = uint16_t;
+    static constexpr reply_type decode(const uint8_t* p)
+    {
+        return detail::u16(p);
+    }
+};
+
+struct u16_pair_reply {
+    static constexpr std::size_t size = 4;
+    using reply_type = std::pair<uint16_t, uint16_t>;
+    static constexpr reply_type decode(const uint8_t* p)
+    {
+        return reply_type(detail::u16(p), detail::u16(p + 2));
+    }
+};
+
+struct motor_mode_reply {
+    static constexpr std::size_t size = 4;
+    using reply_type = std::pair<uint8_t, int16_t>;
+    static constexpr reply_type decode(const uint8_t* p)
+    {
+        return reply_type(p[0], static_cast<int16_t>(detail::u16(p + 2)));
+    }
+};
+
+/* a command with its request and reply layouts */
+template <lobot_cmd_t Cmd, typename Request, typename Reply>
+struct command : Request, Reply {
+    static constexpr lobot_cmd_t cmd = Cmd;
+    static constexpr std::size_t request_params = Request::size;
+    static constexpr std::size_t reply_params = Reply::size;
+    static constexpr std::size_t request_len = Request::size + frame_overhead;
+    /* 0 for commands the servo doesn't answer */
+    static constexpr std::size_t reply_len = Reply::size ? Reply::size + frame_overhead : 0;
+};
+
+template <lobot_cmd_t Cmd, typename Request, typename Reply>
+constexpr lobot_cmd_t command<Cmd, Request, Reply>::cmd;
+template <lobot_cmd_t Cmd, typename Request, typename Reply>
+constexpr std::size_t command<Cmd, Request, Reply>::request_params;
+template <lobot_cmd_t Cmd, typename Request, typename Reply>
+constexpr std::size_t command<Cmd, Request, Reply>::reply_params;
+template <lobot_cmd_t Cmd, typename Request, typename Reply>
+constexpr std::size_t command<Cmd, Request, Reply>::request_len;
+template <lobot_cmd_t Cmd, typename Request, typename Reply>
+constexpr std::size_t command<Cmd, Request, Reply>::reply_len;
+
+/* compile time description of a command, left undefined for values that
+ * aren't LX-15D commands */
+template <lobot_cmd_t Cmd>
+struct command_traits;
+
+#define LOBOT_COMMAND_TRAITS(cmd_, request_, reply_) \
+    template <> struct command_traits<cmd_> : command<cmd_, request_, reply_> {}
+
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_MOVE_TIME_WRITE     , move_params      , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_MOVE_TIME_READ      , no_params        , u16_pair_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_MOVE_TIME_WAIT_WRITE, move_params      , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_MOVE_TIME_WAIT_READ , no_params        , u16_pair_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_MOVE_START          , no_params        , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_MOVE_STOP           , no_params        , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ID_WRITE            , u8_param         , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ID_READ             , no_params        , u8_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ANGLE_OFFSET_ADJUST , i8_param         , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ANGLE_OFFSET_WRITE  , no_params        , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ANGLE_OFFSET_READ   , no_params        , i8_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ANGLE_LIMIT_WRITE   , u16_pair_params  , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_ANGLE_LIMIT_READ    , no_params        , u16_pair_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_VIN_LIMIT_WRITE     , u16_pair_params  , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_VIN_LIMIT_READ      , no_params        , u16_pair_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_TEMP_MAX_LIMIT_WRITE, u8_param         , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_TEMP_MAX_LIMIT_READ , no_params        , u8_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_TEMP_READ           , no_params        , u8_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_VIN_READ            , no_params        , u16_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_POS_READ            , no_params        , u16_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_OR_MOTOR_MODE_WRITE , motor_mode_params, no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_OR_MOTOR_MODE_READ  , no_params        , motor_mode_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_LOAD_OR_UNLOAD_WRITE, u8_param         , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_LOAD_OR_UNLOAD_READ , no_params        , u8_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_LED_CTRL_WRITE      , u8_param         , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_LED_CTRL_READ       , no_params        , u8_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_LED_ERROR_WRITE     , u8_param         , no_reply);
+LOBOT_COMMAND_TRAITS(LOBOT_CMD_LED_ERROR_READ      , no_params        , u8_reply);
+
+#undef LOBOT_COMMAND_TRAITS
+
+/* request frame of a command */
+template <lobot_cmd_t Cmd>
+using frame = std::array<uint8_t, command_traits<Cmd>::request_len>;
+
+/* reply frame of a command that has one */
+template <lobot_cmd_t Cmd>
+using reply = std::array<uint8_t, command_traits<Cmd>::reply_len>;
+
+/* encode a request, arguments are those of the command's params()
+ * @param id Target servo ID
+ * @return request frame, a constant expression for constant arguments
+ */
+template <lobot_cmd_t Cmd, typename... Args>
+constexpr frame<Cmd> make_frame(uint8_t id, Args... args)
+{
+    return detail::build(id, static_cast<uint8_t>(Cmd),
+            command_traits<Cmd>::params(args...),
+            std::make_index_sequence<command_traits<Cmd>::request_len>());
+}
+
+/* check the header, length and checksum of a frame */
+template <std::size_t N>
+constexpr bool frame_valid(const std::array<uint8_t, N>& f)
+{
+    unsigned sum = 0;
+
+    if (N < frame_overhead || f[0] != frame_header || f[1] != frame_header ||
+            f[3] != N - 3) {
+        return false;
+    }
+    for (std::size_t i = 2; i < N - 1; ++i) {
+        sum += f[i];
+    }
+    return f[N - 1] == static_cast<uint8_t>(~sum);
+}
+
+/* decode the parameters of a command's reply, which must be valid */
+template <lobot_cmd_t Cmd>
+constexpr typename command_traits<Cmd>::reply_type decode(const reply<Cmd>& r)
+{
+    return command_traits<Cmd>::decode(&r[param_index]);
+}
+
+/* write a frame to a port
+ * @return same as lobot_port_write
+ */
+template <std::size_t N>
+inline int write(lobot_port_t* port, const std::array<uint8_t, N>& f)
+{
+    return lobot_port_write(port, f.data(), N);
+}
+
+/* send a read command and decode its reply
+ * @param port Port returned by lobot_port_open
+ * @param id Target servo ID
+ * @param value_out Output decoded reply
+ * @param timeout_us Reply timeout, the port's by default
+ * @return same as lobot_port_transact
+ */
+template <lobot_cmd_t Cmd>
+inline int read(lobot_port_t* port, uint8_t id,
+        typename command_traits<Cmd>::reply_type& value_out,
+        uint32_t timeout_us = LOBOT_PORT_TIMEOUT_DEFAULT)
+{
+    const frame<Cmd> request = make_frame<Cmd>(id);
+    reply<Cmd> r;
+    int ret;
+
+    ret = lobot_port_transact(port, request.data(), request.size(), r.data(),
+            r.size(), timeout_us);
+    if (ret > 0) {
+        value_out = decode<Cmd>(r);
+    }
+    return ret;
+}
+
+} // namespace lobot
+
+#endif
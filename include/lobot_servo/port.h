@@ -24,29 +24,359 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
+
+/* default reply timeout of a newly opened port, in microseconds */
+#define LOBOT_PORT_TIMEOUT_US (50000)
+/* pass as timeout to use the port's own timeout */
+#define LOBOT_PORT_TIMEOUT_DEFAULT (UINT32_MAX)
+
+/* default baud rate of LX-15D servos */
+#define LOBOT_PORT_BAUD (115200)
 
 /* struct representing a serial port */
 struct lobot_port_t;
 
+/* serial port options, initialize with lobot_port_options_init */
+struct lobot_port_options {
+    uint32_t baud;          /* any baud rate the adapter supports */
+    int low_latency;        /* ask the driver not to batch received bytes, on
+                               FTDI adapters this also drops the latency timer
+                               to 1ms */
+    int exclusive;          /* refuse further opens of the tty (TIOCEXCL) */
+    int flush;              /* discard stale data in both directions at open */
+    uint32_t timeout_us;    /* default reply timeout, in microseconds, 0 for
+                               LOBOT_PORT_TIMEOUT_US which calibration may
+                               lower, others are kept */
+    int calibrate;          /* probe the adapter at open, see
+                               lobot_port_calibrate, off by default */
+};
+
+/* serial port settings in effect */
+struct lobot_port_info {
+    uint32_t baud;          /* baud rate reported by the driver */
+    int low_latency;        /* low latency mode is in effect */
+    int exclusive;          /* port is opened exclusively */
+    int latency_timer_ms;   /* USB adapter latency timer, -1 if unknown */
+    uint32_t byte_time_ns;  /* time to transmit one byte */
+    uint32_t rtt_us;        /* request to reply round trip measured by
+                               lobot_port_calibrate, at open with the
+                               calibrate option, 0 until a servo answered */
+    int calibrate_error;    /* negative errno of the calibration at open with
+                               the calibrate option, 0 if it succeeded or was
+                               not asked for */
+};
+
+/* adapter measurements taken by lobot_port_calibrate */
+struct lobot_port_calibration {
+    int echo;               /* the adapter echoes written bytes back, the
+                               port strips them from what it receives */
+    uint32_t echo_us;       /* write to its echo received, 0 without echo */
+    uint32_t latency_us;    /* one way latency between host and bus, half of
+                               the echo's time beyond its airtime, 0 without
+                               echo */
+    uint32_t rtt_us;        /* probe round trip, 0 if no servo answered */
+    uint32_t turnaround_us; /* servo turnaround before its reply, including
+                               the adapter's latency both ways without echo,
+                               0 if no servo answered */
+};
+
+/* latency histogram buckets, bucket i counts round trips shorter than
+ * 2^(i+1) us and the last one everything slower */
+#define LOBOT_STATS_BUCKETS (20)
+/* opcodes tracked, commands at or above are counted under opcode 0 */
+#define LOBOT_STATS_CMDS (64)
+/* servo IDs tracked, including broadcast */
+#define LOBOT_STATS_IDS (256)
+
+/* traffic counters of one opcode or one servo ID */
+struct lobot_port_counters {
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint32_t tx_frames;
+    uint32_t rx_frames;
+    uint32_t transactions;  /* requests answered by a valid reply */
+    uint32_t timeouts;      /* requests left without reply */
+    uint32_t chksum_errors; /* requests whose reply failed its checksum */
+    uint32_t short_writes;  /* frames not fully written */
+    uint32_t latency[LOBOT_STATS_BUCKETS]; /* round trips of transactions */
+};
+
+/* port statistics, indexed by opcode and by servo ID of the request */
+struct lobot_port_stats {
+    struct lobot_port_counters cmd[LOBOT_STATS_CMDS];
+    struct lobot_port_counters id[LOBOT_STATS_IDS];
+};
+
+/* priority classes of the bus arbiter, most urgent first */
+typedef enum {
+    LOBOT_PRIO_ESTOP    = 0,    /* emergency stop */
+    LOBOT_PRIO_SETPOINT = 1,    /* position commands */
+    LOBOT_PRIO_FEEDBACK = 2,    /* position and telemetry reads */
+    LOBOT_PRIO_CONFIG   = 3,    /* configuration and diagnostics */
+} lobot_prio_t;
+
+#define LOBOT_PRIO_COUNT (4)
+
+/* transport moving bytes of a port, implement to plug in other links
+ * All operations take the context stored by open and must not block.
+ */
+struct lobot_transport {
+    const char* name;
+    /* open link for dev, store context in *ctx and update info
+     * @return 0 on success, negative errno on failure */
+    int (*open)(void** ctx, const char* dev, void* arg,
+            const struct lobot_port_options* options, struct lobot_port_info* info);
+    /* read available bytes
+     * @return bytes read, 0 if none, negative errno on failure */
+    int (*readv)(void* ctx, const struct iovec* iov, int iovcnt);
+    /* write bytes, may wait about their airtime for a full buffer to drain
+     * @return bytes written, short on timeout, negative errno on failure */
+    int (*write)(void* ctx, const uint8_t* buffer, size_t len);
+    /* wait until readable
+     * @return positive if readable, 0 on timeout, negative errno on failure */
+    int (*poll)(void* ctx, uint32_t timeout_us);
+    /* optional, descriptor readable along with the link, for event loops */
+    int (*fd)(void* ctx);
+    /* optional, path a peer opens to reach the other end of the link */
+    const char* (*peer)(void* ctx);
+    void (*close)(void* ctx);
+};
+
+/* serial tty, dev is its device path */
+extern const struct lobot_transport lobot_transport_tty;
+/* new pseudo-terminal pair, the port owns the master and lobot_port_peer
+ * names the slave to hand to a simulator or another program, dev is unused */
+extern const struct lobot_transport lobot_transport_pty;
+/* AF_UNIX stream socket, dev is the path of a listening socket */
+extern const struct lobot_transport lobot_transport_unix;
+
 /* open a serial port
  * @param dev Device path for the serial port
  * @return struct lobot_port_t *
  */
 struct lobot_port_t* lobot_port_open(const char* dev);
 
+/* fill port options with defaults: LOBOT_PORT_BAUD, low latency on, not
+ * exclusive, flush on open, LOBOT_PORT_TIMEOUT_US
+ * @param options Options to initialize
+ */
+void lobot_port_options_init(struct lobot_port_options* options);
+
+/* open a serial port with options
+ * @param dev Device path for the serial port
+ * @param options Port options, NULL for defaults
+ * @return struct lobot_port_t *, NULL on failure
+ */
+struct lobot_port_t* lobot_port_open_ex(const char* dev,
+        const struct lobot_port_options* options);
+
+/* open a port on any transport
+ * @param transport Transport moving the port's bytes
+ * @param dev Transport specific device path
+ * @param arg Transport specific argument, passed to its open
+ * @param options Port options, NULL for defaults
+ * @return struct lobot_port_t *, NULL on failure with errno set
+ */
+struct lobot_port_t* lobot_port_open_transport(const struct lobot_transport* transport,
+        const char* dev, void* arg, const struct lobot_port_options* options);
+
+/* open two ports linked in memory, bytes written to one are read from the
+ * other without going through the kernel
+ * @param ends Output ports
+ * @param options Port options, NULL for defaults
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_port_open_loopback(struct lobot_port_t* ends[2],
+        const struct lobot_port_options* options);
+
+/* get path a peer opens to reach the other end of the port's link
+ * @param port Port returned by calling lobot_port_open
+ * @return path, NULL if the transport has none
+ */
+const char* lobot_port_peer(struct lobot_port_t* port);
+
+/* get serial port settings actually in effect
+ * @param port Port returned by calling lobot_port_open
+ * @param info Output settings
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_port_info(struct lobot_port_t* port, struct lobot_port_info* info);
+
+/* probe the adapter and servo behind a port and adopt the measurements
+ * A read request is sent a few times. If the adapter echoes it back, the port
+ * strips echoed frames from then on. Its echo and the servo's reply give the
+ * adapter's latency and the servo's turnaround. When a servo answered, the
+ * port's timeout comes down to four round trips of the longest frame, 10 ms
+ * at least, unless the caller set it with the timeout_us option or
+ * lobot_port_set_timeout. Pipelined sweeps queue the next request early when
+ * the measured latency covers the rest of the reply; uncalibrated ports never
+ * do. Takes two port timeouts when no servo answers. A failure at open with
+ * the calibrate option shows in calibrate_error of lobot_port_info.
+ * @param port Port returned by calling lobot_port_open
+ * @param id Servo ID to probe, broadcast (0xFE) works with a single servo on
+ *        the bus
+ * @param cal_out Output measurements, may be NULL
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_port_calibrate(struct lobot_port_t* port, uint8_t id,
+        struct lobot_port_calibration* cal_out);
+
+/* get measurements of the last lobot_port_calibrate
+ * @param port Port returned by calling lobot_port_open
+ * @param cal Output measurements
+ * @return 0 on success, -ENODATA if the port wasn't calibrated
+ */
+int lobot_port_calibration(struct lobot_port_t* port, struct lobot_port_calibration* cal);
+
 /* read data from serial port to buffer
+ * Frames echoed by the adapter are left out once calibration detected echo.
  * @param port Port returned by calling lobot_port_open
  * @param buffer Buffer to read
  * @param len Length to read
  */
 int lobot_port_read(struct lobot_port_t* port, uint8_t* buffer, size_t len);
 
+/* receive next complete frame from serial port
+ * Received bytes are buffered per port and scanned for frame headers; stale
+ * bytes and frames with bad length or checksum are dropped. At most one read
+ * is issued on the port, and only when no complete frame is buffered yet.
+ * @param port Port returned by calling lobot_port_open
+ * @param frame Buffer to store the frame
+ * @param size Size of frame buffer
+ * @return frame length, 0 if no complete frame is available yet,
+ *         -EBADMSG if a corrupted frame was dropped, other negative errno
+ *         on failure
+ */
+int lobot_port_recv_frame(struct lobot_port_t* port, uint8_t* frame, size_t size);
+
 /* write data to serial port
  * @param port Port returned by calling lobot_port_open
  * @param buffer Buffer containing data to write
  * @param len Length to write
  */
-int lobot_port_write(struct lobot_port_t* port, uint8_t* buffer, size_t len);
+int lobot_port_write(struct lobot_port_t* port, const uint8_t* buffer, size_t len);
+
+/* wait until data is available to read from serial port
+ * Bytes already pulled in by the frame decoder count only once they complete
+ * a frame, a partial frame waits for the rest to arrive.
+ * @param port Port returned by calling lobot_port_open
+ * @param timeout_us Time to wait, in microseconds
+ * @return positive if a complete frame is buffered or new bytes arrived, 0 on
+ *         timeout, negative errno on failure
+ */
+int lobot_port_poll(struct lobot_port_t* port, uint32_t timeout_us);
+
+/* wait for the reply frame to a request already written to serial port
+ * @param port Port returned by calling lobot_port_open
+ * @param request Request frame the reply answers
+ * @param reply Buffer to store reply frame
+ * @param reply_len Expected length of reply frame
+ * @param timeout_us Deadline for the reply, in microseconds, or
+ *        LOBOT_PORT_TIMEOUT_DEFAULT to use the port's
+ * @param on_header Optional callback, invoked once as soon as the header of a
+ *        reply frame starts arriving, so the next request can be queued while
+ *        the rest of the reply is still on the wire
+ * @param ctx Context passed to on_header
+ * @return same as lobot_port_transact
+ */
+int lobot_port_recv_reply(struct lobot_port_t* port, const uint8_t* request,
+        uint8_t* reply, size_t reply_len, uint32_t timeout_us,
+        void (*on_header)(void* ctx), void* ctx);
+
+/* write a request frame and wait for its reply frame
+ * The call returns as soon as the last byte of the reply is received. Frames
+ * not answering the request (echo, stale replies) are skipped.
+ * @param port Port returned by calling lobot_port_open
+ * @param request Complete request frame
+ * @param request_len Length of request frame
+ * @param reply Buffer to store reply frame
+ * @param reply_len Expected length of reply frame
+ * @param timeout_us Deadline for the reply relative to the request, in
+ *        microseconds, or LOBOT_PORT_TIMEOUT_DEFAULT to use the port's
+ * @return reply length on success, -ETIMEDOUT if no reply arrived before the
+ *         deadline, -EAGAIN if timeout_us is 0 and no reply is buffered,
+ *         -EBADMSG if only corrupted frames arrived, other negative errno on
+ *         failure
+ */
+int lobot_port_transact(struct lobot_port_t* port, const uint8_t* request,
+        size_t request_len, uint8_t* reply, size_t reply_len, uint32_t timeout_us);
+
+/* set default reply timeout of serial port
+ * @param port Port returned by calling lobot_port_open
+ * @param timeout_us Timeout in microseconds, LOBOT_PORT_TIMEOUT_US by default;
+ *        once set, lobot_port_calibrate no longer lowers it
+ */
+void lobot_port_set_timeout(struct lobot_port_t* port, uint32_t timeout_us);
+
+/* get default reply timeout of serial port
+ * @param port Port returned by calling lobot_port_open
+ * @return Timeout in microseconds
+ */
+uint32_t lobot_port_get_timeout(struct lobot_port_t* port);
+
+/* take the bus for a series of transactions
+ * Ports are safe to share between threads: each read, write and transaction
+ * takes the bus on its own, in class LOBOT_PRIO_CONFIG unless the calling
+ * thread already holds it. Holders release it at frame boundaries, and the
+ * bus goes to the most urgent class waiting, first come first served within a
+ * class: waiters take a ticket and a newcomer never overtakes a waiter of its
+ * own class. Acquiring again from the holding thread nests.
+ * @param port Port returned by calling lobot_port_open
+ * @param prio Priority class of the transactions
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_port_acquire(struct lobot_port_t* port, lobot_prio_t prio);
+
+/* take the bus only if it can be had at once, for event loops that must not
+ * block; the bus is refused while held elsewhere or waited for in the same or
+ * a more urgent class
+ * @param port Port returned by calling lobot_port_open
+ * @param prio Priority class of the transactions
+ * @return 0 on success, -EBUSY if the bus isn't free, other negative errno on
+ *         failure
+ */
+int lobot_port_try_acquire(struct lobot_port_t* port, lobot_prio_t prio);
+
+/* release the bus taken by lobot_port_acquire
+ * @param port Port returned by calling lobot_port_open
+ */
+void lobot_port_release(struct lobot_port_t* port);
+
+/* check whether a more urgent class is waiting for the bus
+ * @param port Port returned by calling lobot_port_open
+ * @param prio Priority class of the caller
+ * @return 1 if a more urgent class is waiting, 0 otherwise
+ */
+int lobot_port_contended(struct lobot_port_t* port, lobot_prio_t prio);
+
+/* let more urgent classes waiting for the bus go first, to be called by the
+ * holder between two transactions; nested holds are kept
+ * @param port Port returned by calling lobot_port_open
+ * @param prio Priority class of the caller
+ * @return 1 if the bus was handed over and taken back, 0 otherwise
+ */
+int lobot_port_yield(struct lobot_port_t* port, lobot_prio_t prio);
+
+/* get file descriptor of serial port, to wait on it with poll/epoll
+ * @param port Port returned by calling lobot_port_open
+ * @return file descriptor, negative errno on failure
+ */
+int lobot_port_fd(struct lobot_port_t* port);
+
+/* snapshot port statistics
+ * Counters are updated without locking, a snapshot taken while other threads
+ * use the port is consistent per counter only.
+ * @param port Port returned by calling lobot_port_open
+ * @param stats_out Output statistics, about 40 KiB
+ * @return 0 on success, -ENOTSUP if built without LOBOT_ENABLE_STATS
+ */
+int lobot_port_stats(struct lobot_port_t* port, struct lobot_port_stats* stats_out);
+
+/* clear port statistics
+ * @param port Port returned by calling lobot_port_open
+ */
+void lobot_port_stats_reset(struct lobot_port_t* port);
 
 /* close an opened serial port
  * @param port Port to close
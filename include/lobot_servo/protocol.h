@@ -0,0 +1,93 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__PROTOCOL_H_
+#define MOGI_LOBOT__PROTOCOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* longest frame on the bus: header(2), id, len, cmd, 4 parameters, checksum */
+#define LOBOT_FRAME_LEN_MAX (10)
+/* most parameters carried by a frame */
+#define LOBOT_FRAME_PARAM_MAX (4)
+/* ID every servo on the bus accepts; writes to it get no reply, reads are
+ * answered by every servo, so their replies collide unless only one servo is
+ * on the bus */
+#define LOBOT_ID_BROADCAST (0xFE)
+
+/* LX-15D bus commands */
+typedef enum {
+    LOBOT_CMD_MOVE_TIME_WRITE      = 1,
+    LOBOT_CMD_MOVE_TIME_READ       = 2,
+    LOBOT_CMD_MOVE_TIME_WAIT_WRITE = 7,
+    LOBOT_CMD_MOVE_TIME_WAIT_READ  = 8,
+    LOBOT_CMD_MOVE_START           = 11,
+    LOBOT_CMD_MOVE_STOP            = 12,
+    LOBOT_CMD_ID_WRITE             = 13,
+    LOBOT_CMD_ID_READ              = 14,
+    LOBOT_CMD_ANGLE_OFFSET_ADJUST  = 17,
+    LOBOT_CMD_ANGLE_OFFSET_WRITE   = 18,
+    LOBOT_CMD_ANGLE_OFFSET_READ    = 19,
+    LOBOT_CMD_ANGLE_LIMIT_WRITE    = 20,
+    LOBOT_CMD_ANGLE_LIMIT_READ     = 21,
+    LOBOT_CMD_VIN_LIMIT_WRITE      = 22,
+    LOBOT_CMD_VIN_LIMIT_READ       = 23,
+    LOBOT_CMD_TEMP_MAX_LIMIT_WRITE = 24,
+    LOBOT_CMD_TEMP_MAX_LIMIT_READ  = 25,
+    LOBOT_CMD_TEMP_READ            = 26,
+    LOBOT_CMD_VIN_READ             = 27,
+    LOBOT_CMD_POS_READ             = 28,
+    LOBOT_CMD_OR_MOTOR_MODE_WRITE  = 29,
+    LOBOT_CMD_OR_MOTOR_MODE_READ   = 30,
+    LOBOT_CMD_LOAD_OR_UNLOAD_WRITE = 31,
+    LOBOT_CMD_LOAD_OR_UNLOAD_READ  = 32,
+    LOBOT_CMD_LED_CTRL_WRITE       = 33,
+    LOBOT_CMD_LED_CTRL_READ        = 34,
+    LOBOT_CMD_LED_ERROR_WRITE      = 35,
+    LOBOT_CMD_LED_ERROR_READ       = 36,
+} lobot_cmd_t;
+
+/* one command of a batch, see lobot_frames_encode */
+struct lobot_frame_desc {
+    uint8_t id;                 /* target servo ID */
+    uint8_t cmd;                /* lobot_cmd_t */
+    uint8_t nparams;            /* parameters used, at most LOBOT_FRAME_PARAM_MAX */
+    uint8_t params[LOBOT_FRAME_PARAM_MAX];
+};
+
+/* encode commands as back to back frames, ready for a single write
+ * Checksums are summed while the bytes are stored, nothing is allocated.
+ * @param frames Commands to encode
+ * @param n Number of commands
+ * @param buffer Output buffer
+ * @param size Size of buffer, n * LOBOT_FRAME_LEN_MAX always suffices
+ * @return bytes written, -EINVAL if a command has too many parameters,
+ *         -ENOSPC if buffer is too small, buffer content is undefined then
+ */
+int lobot_frames_encode(const struct lobot_frame_desc* frames, size_t n,
+        uint8_t* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__REACTOR_H_
+#define MOGI_LOBOT__REACTOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+#include "protocol.h"
+#include "servo.h"
+
+/* transactions that can be queued per port */
+#define LOBOT_REACTOR_QUEUE_LEN (64)
+
+/* struct representing an event loop driving many serial ports */
+struct lobot_reactor_t;
+
+/* completion callback of a transaction
+ * @param ctx Context given at submission
+ * @param port Port the transaction ran on
+ * @param err LOBOT_OK if success
+ * @param params Parameters of the reply, NULL for failed or write only
+ *        transactions
+ * @param nparams Number of reply parameters
+ */
+typedef void (*lobot_reactor_cb)(void* ctx, struct lobot_port_t* port,
+        lobot_error_t err, const uint8_t* params, size_t nparams);
+
+/* create a reactor
+ * @return struct lobot_reactor_t *, NULL on failure
+ */
+struct lobot_reactor_t* lobot_reactor_create(void);
+
+/* register a port with reactor
+ * @param reactor Reactor returned by lobot_reactor_create
+ * @param port Port returned by calling lobot_port_open
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_reactor_add_port(struct lobot_reactor_t* reactor, struct lobot_port_t* port);
+
+/* unregister a port, pending transactions complete with LOBOT_BAD_PORT
+ * Called from a completion callback, the port is let go once the current
+ * lobot_reactor_run_once is over, so it must not be closed before then.
+ * @param reactor Reactor returned by lobot_reactor_create
+ * @param port Port previously added
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_reactor_remove_port(struct lobot_reactor_t* reactor, struct lobot_port_t* port);
+
+/* queue a transaction on a registered port
+ * Transactions on one port run one at a time in submission order, while
+ * transactions on different ports run concurrently. The reactor's thread
+ * holds the bus of a port from a request until its reply or timeout, so
+ * other threads using the port wait meanwhile. The reactor never waits for a
+ * bus held by another thread: that port is left alone and retried every
+ * millisecond while the other ports carry on.
+ * @param reactor Reactor returned by lobot_reactor_create
+ * @param port Registered port
+ * @param id Target servo ID
+ * @param cmd Command to send
+ * @param params Parameters of the request
+ * @param nparams Number of request parameters, at most LOBOT_FRAME_PARAM_MAX
+ * @param reply_nparams Number of parameters of the expected reply, 0 if the
+ *        command has no reply
+ * @param timeout_us Reply timeout in microseconds, or
+ *        LOBOT_PORT_TIMEOUT_DEFAULT to use the port's
+ * @param cb Completion callback, may be NULL
+ * @param ctx Context passed to cb
+ * @return 0 on success, -EAGAIN if the port's queue is full, other negative
+ *         errno on failure
+ */
+int lobot_reactor_submit(struct lobot_reactor_t* reactor, struct lobot_port_t* port,
+        uint8_t id, lobot_cmd_t cmd, const uint8_t* params, size_t nparams,
+        size_t reply_nparams, uint32_t timeout_us, lobot_reactor_cb cb, void* ctx);
+
+/* number of transactions queued or in flight on all ports */
+size_t lobot_reactor_pending(struct lobot_reactor_t* reactor);
+
+/* wait for events and complete transactions
+ * @param reactor Reactor returned by lobot_reactor_create
+ * @param timeout_us Longest time to wait for an event, in microseconds
+ * @return number of completed transactions, negative errno on failure
+ */
+int lobot_reactor_run_once(struct lobot_reactor_t* reactor, uint32_t timeout_us);
+
+/* run until every queued transaction, including ones submitted from
+ * callbacks, has completed
+ * @param reactor Reactor returned by lobot_reactor_create
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_reactor_run(struct lobot_reactor_t* reactor);
+
+/* destroy reactor, registered ports are left open
+ * @param reactor Reactor returned by lobot_reactor_create
+ */
+void lobot_reactor_destroy(struct lobot_reactor_t* reactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
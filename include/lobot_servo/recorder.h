@@ -0,0 +1,165 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__RECORDER_H_
+#define MOGI_LOBOT__RECORDER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+
+/* payload bytes carried by one record, longer chunks span several */
+#define LOBOT_RECORD_PAYLOAD (15)
+
+/* record continues in the next one */
+#define LOBOT_RECORD_MORE (1 << 0)
+
+typedef enum {
+    LOBOT_RECORD_TX     = 1,    /* bytes of one write to the bus */
+    LOBOT_RECORD_RX     = 2,    /* bytes of one read from the bus, as received */
+    LOBOT_RECORD_FRAME  = 3,    /* valid frame decoded from received bytes */
+    LOBOT_RECORD_SAMPLE = 4,    /* value logged by the application */
+} lobot_record_type_t;
+
+/* one record of a capture file, 32 bytes */
+struct lobot_record {
+    uint32_t seq;               /* position in the capture + 1, 0 while written */
+    uint8_t type;               /* lobot_record_type_t */
+    uint8_t flags;              /* LOBOT_RECORD_MORE */
+    uint8_t id;                 /* servo ID, 0xFF if unknown */
+    uint8_t cmd;                /* opcode, 0xFF if unknown */
+    uint64_t timestamp_ns;      /* CLOCK_MONOTONIC */
+    uint8_t len;                /* payload bytes used */
+    uint8_t payload[LOBOT_RECORD_PAYLOAD];
+};
+
+/* capture file header, followed by capacity records */
+struct lobot_record_header {
+    char magic[8];              /* "LOBOTREC" */
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;          /* records the ring holds */
+    uint64_t head;              /* records ever reserved */
+    int64_t start_realtime_ns;  /* CLOCK_REALTIME when the file was created */
+    uint64_t start_monotonic_ns;/* CLOCK_MONOTONIC at the same instant */
+    uint8_t reserved[16];
+};
+
+/* struct representing a memory mapped ring file being recorded */
+struct lobot_recorder_t;
+
+/* struct representing a capture file opened for reading */
+struct lobot_capture_t;
+
+/* create a ring file and map it
+ * Once full, the oldest records are overwritten. Records are reserved with an
+ * atomic add and copied in place, so any thread may record without locking.
+ * @param path File to create, truncated if it exists
+ * @param capacity Number of records the ring holds
+ * @return struct lobot_recorder_t *, NULL on failure
+ */
+struct lobot_recorder_t* lobot_recorder_open(const char* path, size_t capacity);
+
+/* record bytes
+ * @param rec Recorder returned by lobot_recorder_open
+ * @param type Record type
+ * @param id Servo ID, 0xFF if unknown
+ * @param cmd Opcode, 0xFF if unknown
+ * @param data Bytes to record
+ * @param len Number of bytes, split over several records if needed
+ */
+void lobot_recorder_put(struct lobot_recorder_t* rec, lobot_record_type_t type,
+        uint8_t id, uint8_t cmd, const void* data, size_t len);
+
+/* record a decoded value, for instance a position read by the control loop
+ * @param rec Recorder returned by lobot_recorder_open
+ * @param id Servo ID
+ * @param cmd Opcode the value was read with
+ * @param value Value bytes, at most LOBOT_RECORD_PAYLOAD
+ * @param len Number of bytes
+ */
+void lobot_recorder_sample(struct lobot_recorder_t* rec, uint8_t id,
+        uint8_t cmd, const void* value, size_t len);
+
+/* tap a port: every write and read goes to the recorder, along with each
+ * valid frame decoded from received bytes
+ * @param port Port returned by calling lobot_port_open
+ * @param rec Recorder, NULL to stop recording
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_port_set_recorder(struct lobot_port_t* port, struct lobot_recorder_t* rec);
+
+/* unmap and close a ring file, detach it from ports first
+ * @param rec Recorder returned by lobot_recorder_open
+ */
+void lobot_recorder_close(struct lobot_recorder_t* rec);
+
+/* map a capture file for reading
+ * @param path Capture file
+ * @return struct lobot_capture_t *, NULL on failure
+ */
+struct lobot_capture_t* lobot_capture_open(const char* path);
+
+/* get capture header
+ * @param cap Capture returned by lobot_capture_open
+ * @return header, in the mapped file
+ */
+const struct lobot_record_header* lobot_capture_header(struct lobot_capture_t* cap);
+
+/* number of records held, oldest first
+ * @param cap Capture returned by lobot_capture_open
+ */
+size_t lobot_capture_count(struct lobot_capture_t* cap);
+
+/* get a record
+ * @param cap Capture returned by lobot_capture_open
+ * @param index Record index, 0 for the oldest one held
+ * @return record, in the mapped file, NULL if it was being written
+ */
+const struct lobot_record* lobot_capture_get(struct lobot_capture_t* cap, size_t index);
+
+/* unmap a capture file
+ * @param cap Capture returned by lobot_capture_open
+ */
+void lobot_capture_close(struct lobot_capture_t* cap);
+
+/* replay options, passed as arg of lobot_port_open_transport */
+struct lobot_replay_config {
+    int realtime;               /* deliver received bytes at their recorded
+                                   delay after the preceding write, otherwise
+                                   as soon as the write is made */
+    int abort_on_divergence;    /* abort() instead of failing the port */
+};
+
+/* replay of a capture, dev is the capture file and arg an optional
+ * struct lobot_replay_config
+ * Received bytes are played back from the mapped file in the chunks they were
+ * read in. Written bytes must match the recorded ones: on the first mismatch
+ * the offending bytes are reported on stderr and every later operation fails
+ * with -EPROTO.
+ */
+extern const struct lobot_transport lobot_transport_replay;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
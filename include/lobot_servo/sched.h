@@ -0,0 +1,146 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__SCHED_H_
+#define MOGI_LOBOT__SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+#include "protocol.h"
+
+/* tasks a scheduler can hold, periodic and pending one-shot together */
+#define LOBOT_SCHED_TASKS_MAX (64)
+
+/* scheduler configuration */
+struct lobot_sched_config {
+    uint32_t baud;              /* bus baud rate, the port's if 0 */
+    uint32_t turnaround_us;     /* servo and adapter turnaround added to every
+                                   reply, if 0 as measured by
+                                   lobot_port_calibrate, else 500 */
+    float bus_share;            /* share of bus time tasks may claim, 0.9 if 0 */
+};
+
+/* outcome of one transaction */
+struct lobot_sched_result {
+    int task;                   /* handle returned by lobot_sched_add */
+    int err;                    /* 0 on success, negative errno on failure */
+    const uint8_t* reply;       /* reply frame of a read, NULL otherwise */
+    int64_t lateness_us;        /* completion time minus deadline, positive
+                                   when the deadline was missed */
+};
+
+/* a bus transaction, run once or every period
+ * Commands the servo answers are sent as reads at LOBOT_PRIO_FEEDBACK and
+ * wait for the reply, all others are sent as writes at LOBOT_PRIO_SETPOINT.
+ */
+struct lobot_sched_task {
+    uint8_t id;                 /* target servo ID */
+    lobot_cmd_t cmd;            /* command to send */
+    uint8_t params[LOBOT_FRAME_PARAM_MAX];
+    size_t nparams;             /* number of parameters in params */
+    uint32_t period_us;         /* release period, 0 for a one-shot task */
+    uint32_t deadline_us;       /* deadline relative to each release, the
+                                   period if 0, required for one-shot tasks */
+    uint32_t offset_us;         /* delay of the first release */
+    void (*done)(void* ctx, const struct lobot_sched_result* result);
+    void* ctx;                  /* passed to done */
+};
+
+/* scheduler counters */
+struct lobot_sched_stats {
+    uint64_t jobs;              /* transactions run */
+    uint64_t missed;            /* transactions completed after their
+                                   deadline, or skipped for being too late */
+    int64_t worst_lateness_us;  /* largest lateness seen */
+    float load;                 /* bus share claimed by the admitted tasks */
+};
+
+/* struct representing an earliest deadline first bus scheduler */
+struct lobot_sched_t;
+
+/* create a scheduler
+ * The scheduler isn't thread safe, but it takes the bus through the port's
+ * arbiter so other threads may use the same port.
+ * @param port Port returned by lobot_port_open
+ * @param config Scheduler configuration, NULL for defaults
+ * @return struct lobot_sched_t *, NULL on failure
+ */
+struct lobot_sched_t* lobot_sched_create(struct lobot_port_t* port,
+        const struct lobot_sched_config* config);
+
+/* bus time a task's transaction takes
+ * The request's airtime, plus for reads the turnaround and the reply's airtime.
+ * @param sched Scheduler returned by lobot_sched_create
+ * @param task Task to measure
+ * @return airtime, in microseconds
+ */
+uint32_t lobot_sched_airtime_us(struct lobot_sched_t* sched,
+        const struct lobot_sched_task* task);
+
+/* admit a task
+ * Transactions can't be preempted, so a task set is admitted when, for every
+ * task, the total density sum(airtime / min(deadline, period)) plus the
+ * blocking of the longest transaction with a later deadline fits the bus
+ * share. Pending one-shot tasks count with their deadline as period.
+ * @param sched Scheduler returned by lobot_sched_create
+ * @param task Task to add, copied
+ * @return task handle on success, -ENOSPC if the task set would not fit the
+ *         bus, -EMFILE if the scheduler holds LOBOT_SCHED_TASKS_MAX tasks,
+ *         other negative errno on failure
+ */
+int lobot_sched_add(struct lobot_sched_t* sched, const struct lobot_sched_task* task);
+
+/* remove a task, its pending transaction isn't run
+ * @param sched Scheduler returned by lobot_sched_create
+ * @param task Handle returned by lobot_sched_add
+ * @return 0 on success, -ENOENT if there's no such task
+ */
+int lobot_sched_remove(struct lobot_sched_t* sched, int task);
+
+/* wait for released transactions and run them, earliest deadline first
+ * Only the releases due once the wait is over are run; those coming due
+ * while they run are left to the next call. Reads wait for their reply for
+ * their airtime plus a small margin, at most until their deadline. A
+ * periodic task whose release is already a full period behind skips to the
+ * latest one, counting the skipped transactions as missed.
+ * @param sched Scheduler returned by lobot_sched_create
+ * @param timeout_us Longest time to wait for a release
+ * @return number of transactions run, 0 on timeout, negative errno on failure
+ */
+int lobot_sched_run_once(struct lobot_sched_t* sched, uint32_t timeout_us);
+
+/* get scheduler counters
+ * @param sched Scheduler returned by lobot_sched_create
+ * @param stats_out Output counters
+ */
+void lobot_sched_stats(struct lobot_sched_t* sched, struct lobot_sched_stats* stats_out);
+
+/* free a scheduler, its port is left open
+ * @param sched Scheduler returned by lobot_sched_create
+ */
+void lobot_sched_destroy(struct lobot_sched_t* sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,7 @@ extern "C" {
 
 #include <stdint.h>
 #include "port.h"
+#include "protocol.h"
 
 /* MACRO specific to LX-D15 servos */
 #define LOBOT_ANGLE_RAW_MIN (0)
@@ -31,11 +32,30 @@ extern "C" {
 #define LOBOT_MOVETIME_MS_MAX (30000)
 #define LOBOT_OFFSET_RAW_MIN (-125)
 #define LOBOT_OFFSET_RAW_MAX (125)
+#define LOBOT_ID_MAX (253)
+
+/* LED error flags reported by lobot_get_led_error */
+#define LOBOT_LED_ERROR_TEMP  (1 << 0)  /* over temperature */
+#define LOBOT_LED_ERROR_VIN   (1 << 1)  /* input voltage out of range */
+#define LOBOT_LED_ERROR_STALL (1 << 2)  /* locked rotor */
+
+/* fields of lobot_read_state */
+#define LOBOT_STATE_POS       (1 << 0)
+#define LOBOT_STATE_VIN       (1 << 1)
+#define LOBOT_STATE_TEMP      (1 << 2)
+#define LOBOT_STATE_LOAD      (1 << 3)
+#define LOBOT_STATE_LED_ERROR (1 << 4)
+#define LOBOT_STATE_ALL       (0x1F)
 
 typedef enum {
     LOBOT_OK = 0,
     LOBOT_BAD_PORT = -1,
     LOBOT_BAD_CHKSUM = -2,
+    LOBOT_BAD_ARG = -3,
+    LOBOT_BAD_WRITE = -4,
+    LOBOT_NO_REPLY = -5,
+    LOBOT_TIMEOUT = -6,
+    LOBOT_NO_MEMORY = -7,
 } lobot_error_t;
 
 /* read servo ID
@@ -63,6 +83,26 @@ lobot_error_t lobot_set_id(struct lobot_port_t *port, uint8_t id, uint8_t new_id
  * @return LOBOT_OK if success
  */
 lobot_error_t lobot_get_pos(struct lobot_port_t *port, uint8_t id, uint16_t* pos_out);
+/* get positions of multiple servos in one pipelined sweep
+ * On a port calibrated with echo, each request is queued as soon as the
+ * previous reply starts arriving when the adapter latency allows, so the bus
+ * stays busy; otherwise each reply is awaited first, as a lobot_get_pos loop
+ * would. The bus is half duplex, so the gain is at most the adapter's latency
+ * both ways per servo: lobot_sim has none, and lobot_bench reads 720 servos/s
+ * either way there at 115200 baud. A servo that doesn't answer, or whose
+ * reply is corrupted, only fails its own entry.
+ * @param port Port handle returned by lobot_port_open
+ * @param ids Array of n target servo IDs
+ * @param n Number of servos, at most LOBOT_ID_MAX + 1
+ * @param pos_out Array of n output positions, entries of failed servos are
+ *        left untouched
+ * @param status Optional array of n per servo results
+ *
+ * @return LOBOT_OK if all servos answered, otherwise the error of the first
+ *         failed servo
+ */
+lobot_error_t lobot_read_positions(struct lobot_port_t *port, const uint8_t* ids,
+        size_t n, uint16_t* pos_out, lobot_error_t* status);
 /* set servo position
  * @param port Port handle returned by lobot_port_open
  * @param id Target servo ID
@@ -72,6 +112,51 @@ lobot_error_t lobot_get_pos(struct lobot_port_t *port, uint8_t id, uint16_t* pos
  * @return LOBOT_OK if success
  */
 lobot_error_t lobot_set_pos(struct lobot_port_t *port, uint8_t id, uint16_t position, uint16_t time);
+/* set positions of multiple servos, starting all moves at the same time
+ * Every servo is staged with a MOVE_TIME_WAIT_WRITE command, followed by a
+ * broadcast MOVE_START, all coalesced into a single write to the port
+ * @param port Port handle returned by lobot_port_open
+ * @param ids Array of n target servo IDs
+ * @param positions Array of n target servo positions
+ * @param times Array of n move durations, in milliseconds
+ * @param n Number of servos, at most LOBOT_ID_MAX + 1
+ *
+ * @return LOBOT_OK if success
+ */
+lobot_error_t lobot_set_pos_multi(struct lobot_port_t *port, const uint8_t* ids,
+        const uint16_t* positions, const uint16_t* times, size_t n);
+/* stop servo motion immediately
+ * Sent at LOBOT_PRIO_ESTOP, so it goes out at the next frame boundary even
+ * while other threads keep the port busy
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID, LOBOT_ID_BROADCAST to stop all servos
+ *
+ * @return LOBOT_OK if success
+ */
+lobot_error_t lobot_stop(struct lobot_port_t *port, uint8_t id);
+
+/* find the servos on the bus
+ * Probes are sent at bus pace, spaced by a request and reply airtime plus the
+ * servo turnaround, as calibrated on the port or 400 us otherwise, without
+ * waiting for each other's replies. Replies are matched by the ID they carry
+ * and after the last probe the scan waits for late replies as long as the
+ * measured round trips suggest, so a full scan takes about 254 probe slots
+ * instead of 254 timeouts.
+ * @param port Port handle returned by lobot_port_open
+ * @param ids IDs to probe, e.g. the result of an earlier scan, NULL to probe
+ *        every ID from 0 to LOBOT_ID_MAX
+ * @param n Number of IDs, ignored if ids is NULL
+ * @param found_ids Output IDs of the servos that answered, in ascending
+ *        order, room for n IDs, LOBOT_ID_MAX + 1 if ids is NULL
+ * @param n_found Output number of servos found
+ * @param n_corrupt Output number of corrupted replies seen, each may stand for
+ *        a servo missing from found_ids, may be NULL
+ *
+ * @return LOBOT_OK if success, even with corrupted replies; found_ids holds
+ *         the servos found before a port failure otherwise
+ */
+lobot_error_t lobot_scan(struct lobot_port_t *port, const uint8_t* ids, size_t n,
+        uint8_t* found_ids, size_t* n_found, size_t* n_corrupt);
 
 /* get servo position offset
  * @param port Port handle returned by lobot_port_open
@@ -117,6 +202,188 @@ lobot_error_t lobot_set_limit(struct lobot_port_t *port, uint8_t id, uint16_t mi
  * @return LOBOT_OK if success
  */
 lobot_error_t lobot_set_load(struct lobot_port_t *port, uint8_t id, uint8_t enable_load);
+/* get servo load output state
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID
+ * @param load_out Output value, 1 if load output is enabled
+ *
+ * @return LOBOT_OK if success
+ */
+lobot_error_t lobot_get_load(struct lobot_port_t *port, uint8_t id, uint8_t* load_out);
+
+/* get servo input voltage
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID
+ * @param vin_out Output value of input voltage, in millivolts
+ *
+ * @return LOBOT_OK if success
+ */
+lobot_error_t lobot_get_vin(struct lobot_port_t *port, uint8_t id, uint16_t* vin_out);
+
+/* get servo temperature
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID
+ * @param temp_out Output value of internal temperature, in degrees Celsius
+ *
+ * @return LOBOT_OK if success
+ */
+lobot_error_t lobot_get_temp(struct lobot_port_t *port, uint8_t id, uint8_t* temp_out);
+
+/* get servo LED error flags
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID
+ * @param flags_out Output LOBOT_LED_ERROR_* flags
+ *
+ * @return LOBOT_OK if success
+ */
+lobot_error_t lobot_get_led_error(struct lobot_port_t *port, uint8_t id, uint8_t* flags_out);
+
+/* state of several servos, one caller provided array of n entries per field
+ * Arrays of fields not requested may be NULL. Entries of failed reads are
+ * left untouched.
+ */
+struct lobot_state_soa {
+    uint16_t* position;
+    uint16_t* vin_mv;
+    uint8_t* temp_c;
+    uint8_t* loaded;
+    uint8_t* led_error;
+    lobot_error_t* status;  /* optional, first failure of each servo */
+};
+
+/* read selected fields of multiple servos in one pipelined sweep
+ * @param port Port handle returned by lobot_port_open
+ * @param ids Array of n target servo IDs
+ * @param n Number of servos, at most LOBOT_ID_MAX + 1
+ * @param fields_mask LOBOT_STATE_* fields to read
+ * @param state Output arrays
+ *
+ * @return LOBOT_OK if all reads succeeded, otherwise the error of the first
+ *         failed read
+ */
+lobot_error_t lobot_read_state(struct lobot_port_t *port, const uint8_t* ids,
+        size_t n, unsigned fields_mask, struct lobot_state_soa* state);
+
+/* shadow register cache counters */
+struct lobot_shadow_stats {
+    uint32_t reads;         /* ID, offset and limit reads */
+    uint32_t read_hits;     /* reads answered from cache */
+    uint32_t writes;        /* position, offset and limit writes */
+    uint32_t writes_elided; /* writes repeating the acknowledged value */
+};
+
+/* enable the shadow register cache of a port
+ * Positions, offsets and limits written through this API are remembered per
+ * servo, and writes repeating them are not sent. Offset and limit reads are
+ * answered from cache once known, ID reads once the servo answered an ID read
+ * or was given its ID. Unloading or loading a servo forgets its position.
+ * Writes issued otherwise, for instance by the control loop or trajectory
+ * executor, or changes made by another host, are not seen: call
+ * lobot_shadow_invalidate afterwards. The cache is only touched with the
+ * port's bus held, so it is safe to share the port between threads.
+ * @param port Port handle returned by lobot_port_open
+ * @param pos_deadband Positions within this many raw units of the last
+ *        written one, with the same move time, count as repeats
+ *
+ * @return LOBOT_OK if success, LOBOT_NO_MEMORY if the cache can't be allocated
+ */
+lobot_error_t lobot_shadow_enable(struct lobot_port_t *port, uint16_t pos_deadband);
+
+/* disable and drop the shadow register cache of a port
+ * @param port Port handle returned by lobot_port_open
+ */
+void lobot_shadow_disable(struct lobot_port_t *port);
+
+/* forget cached registers of a servo
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID, broadcast ID 0xFE for all servos
+ */
+void lobot_shadow_invalidate(struct lobot_port_t *port, uint8_t id);
+
+/* get shadow register cache counters
+ * @param port Port handle returned by lobot_port_open
+ * @param stats_out Output counters
+ *
+ * @return LOBOT_OK if success, LOBOT_BAD_ARG if the cache is disabled
+ */
+lobot_error_t lobot_shadow_stats(struct lobot_port_t *port,
+        struct lobot_shadow_stats* stats_out);
+
+/* link health of a servo, see lobot_health_enable */
+typedef enum {
+    LOBOT_HEALTH_UNKNOWN = 0,   /* not heard from yet */
+    LOBOT_HEALTH_UP      = 1,   /* answered its last request */
+    LOBOT_HEALTH_SUSPECT = 2,   /* missed its last replies */
+    LOBOT_HEALTH_DOWN    = 3,   /* missed dead_after replies in a row */
+} lobot_health_state_t;
+
+/* link health tracking options, initialize with lobot_health_config_init */
+struct lobot_health_config {
+    uint32_t retries;           /* attempts after a lost or corrupted reply */
+    uint32_t min_timeout_us;    /* shortest reply timeout */
+    uint32_t max_timeout_us;    /* longest reply timeout, also used until a
+                                   round trip is measured, the port's if 0 */
+    uint32_t dead_after;        /* lost replies in a row taking a servo down */
+    uint32_t probe_us;          /* delay before a down servo is probed again,
+                                   doubling with every probe it misses */
+    uint32_t probe_max_us;      /* longest delay between probes */
+};
+
+/* link health of a servo */
+struct lobot_health_info {
+    lobot_health_state_t state;
+    uint32_t srtt_us;           /* smoothed round trip, 0 until measured */
+    uint32_t rttvar_us;         /* round trip variation */
+    uint32_t timeout_us;        /* reply timeout of the next request */
+    uint32_t failures;          /* lost replies in a row */
+};
+
+/* fill link health options with defaults: 2 retries, timeouts between 2 ms
+ * and the port's, down after 3 lost replies, probed after 100 ms backing off
+ * to 2 s
+ * @param config Options to initialize
+ */
+void lobot_health_config_init(struct lobot_health_config* config);
+
+/* enable per servo link health tracking of a port
+ * Every read keeps a smoothed round trip and its variation per servo, in the
+ * style of TCP, and waits srtt + 4 * rttvar for replies, clamped to the
+ * configured bounds, instead of the port's fixed timeout; servos not measured
+ * yet go by the round trips of the others. Getters retry lost
+ * or corrupted replies, doubling the timeout each attempt; round trips of
+ * retried requests aren't sampled. A servo missing dead_after replies in a
+ * row is down: getters try it once without retrying, and sweeps
+ * (lobot_read_positions, lobot_read_state) skip it with LOBOT_NO_REPLY,
+ * without bus traffic, until its next probe is due.
+ * @param port Port handle returned by lobot_port_open
+ * @param config Options, NULL for defaults
+ *
+ * @return LOBOT_OK if success, LOBOT_NO_MEMORY if tracking can't be allocated
+ */
+lobot_error_t lobot_health_enable(struct lobot_port_t *port,
+        const struct lobot_health_config* config);
+
+/* disable and drop link health tracking of a port
+ * @param port Port handle returned by lobot_port_open
+ */
+void lobot_health_disable(struct lobot_port_t *port);
+
+/* forget the link health of a servo, e.g. after replacing it
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID, broadcast ID 0xFE for all servos
+ */
+void lobot_health_reset(struct lobot_port_t *port, uint8_t id);
+
+/* get the link health of a servo
+ * Waits for the bus, so the entry isn't read halfway through an update.
+ * @param port Port handle returned by lobot_port_open
+ * @param id Target servo ID
+ * @param info_out Output health
+ *
+ * @return LOBOT_OK if success, LOBOT_BAD_ARG if tracking is disabled
+ */
+lobot_error_t lobot_health_get(struct lobot_port_t *port, uint8_t id,
+        struct lobot_health_info* info_out);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,134 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__SIM_H_
+#define MOGI_LOBOT__SIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+
+/* servos a simulated bus can hold */
+#define LOBOT_SIM_SERVOS_MAX (32)
+
+/* simulated bus configuration */
+struct lobot_sim_config {
+    const uint8_t* ids;         /* IDs of the simulated servos */
+    size_t n;                   /* number of servos */
+    uint32_t baud;              /* bus baud rate used for byte timing, the
+                                   port's if 0 */
+    uint32_t reply_delay_us;    /* servo turnaround before replying */
+    int echo;                   /* echo requests back like a half duplex
+                                   adapter without echo cancellation */
+    float corrupt_rate;         /* probability of a bit error in a reply */
+    float drop_rate;            /* probability of a reply being lost */
+    uint32_t seed;              /* random seed for corruption and drops */
+};
+
+/* state of a simulated servo */
+struct lobot_sim_servo {
+    uint8_t id;
+    uint16_t position;          /* current position, following moves */
+    uint16_t target;            /* target of the current move */
+    uint16_t time_ms;           /* duration of the current move */
+    int8_t offset;
+    uint16_t limit_min;
+    uint16_t limit_max;
+    uint16_t vin_mv;
+    uint8_t temp_c;
+    uint8_t loaded;
+    uint8_t led_error;
+};
+
+/* bus counters */
+struct lobot_sim_stats {
+    uint32_t requests;          /* valid frames received */
+    uint32_t replies;           /* replies sent */
+    uint32_t dropped;           /* replies dropped on purpose */
+    uint32_t corrupted;         /* replies corrupted on purpose */
+    uint32_t collisions;        /* frames overlapping on the bus: replies of
+                                   several servos, or a request written while
+                                   a reply is on the wire */
+    uint32_t overflows;         /* frames lost to a full transmit queue */
+};
+
+/* struct representing a simulated bus of LX-15D servos */
+struct lobot_sim_t;
+
+/* create a simulated bus answering on port
+ * Every command of the bus protocol is emulated. Requests go on the bus one
+ * after another at the bus baud rate from the time they are read, and are
+ * acted upon once their last byte is through; requests beyond those on the
+ * bus are left in the port, so a fast writer is held back by the bus. Replies
+ * start after the servo turnaround and go out one byte time apart. The bus is
+ * half duplex: a request overlapping a reply on the wire corrupts the rest of
+ * the reply and is not acted upon.
+ * @param port Port the simulated servos are attached to, for instance the
+ *        other end of a loopback pair or a pty master
+ * @param config Bus configuration
+ * @return struct lobot_sim_t *, NULL on failure
+ */
+struct lobot_sim_t* lobot_sim_create(struct lobot_port_t* port,
+        const struct lobot_sim_config* config);
+
+/* handle requests and send replies that are due
+ * @param sim Simulated bus returned by lobot_sim_create
+ * @param timeout_us Longest time to wait for a request
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_sim_run_once(struct lobot_sim_t* sim, uint32_t timeout_us);
+
+/* run the bus on a background thread
+ * @param sim Simulated bus returned by lobot_sim_create
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_sim_start(struct lobot_sim_t* sim);
+
+/* stop the background thread
+ * @param sim Simulated bus returned by lobot_sim_create
+ */
+void lobot_sim_stop(struct lobot_sim_t* sim);
+
+/* get state of a simulated servo
+ * @param sim Simulated bus returned by lobot_sim_create
+ * @param id Servo ID
+ * @param servo_out Output state
+ * @return 0 on success, -ENOENT if no servo has this ID
+ */
+int lobot_sim_servo(struct lobot_sim_t* sim, uint8_t id,
+        struct lobot_sim_servo* servo_out);
+
+/* get bus counters
+ * @param sim Simulated bus returned by lobot_sim_create
+ * @param stats_out Output counters
+ */
+void lobot_sim_stats(struct lobot_sim_t* sim, struct lobot_sim_stats* stats_out);
+
+/* stop and free a simulated bus, its port is left open
+ * @param sim Simulated bus returned by lobot_sim_create
+ */
+void lobot_sim_destroy(struct lobot_sim_t* sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__TRAJECTORY_H_
+#define MOGI_LOBOT__TRAJECTORY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "port.h"
+
+/* joints a trajectory executor can drive */
+#define LOBOT_TRAJ_JOINTS_MAX (32)
+/* waypoints that can be buffered per joint */
+#define LOBOT_TRAJ_WAYPOINTS_MAX (64)
+
+/* interpolation between waypoints */
+typedef enum {
+    LOBOT_INTERP_LINEAR = 0,
+    LOBOT_INTERP_CUBIC = 1,     /* hermite, using waypoint velocity */
+    LOBOT_INTERP_QUINTIC = 2,   /* using waypoint velocity and acceleration */
+} lobot_interp_t;
+
+/* a time stamped joint target */
+struct lobot_waypoint {
+    uint32_t t_ms;          /* time stamp on the executor's clock */
+    float position;         /* raw servo position */
+    float velocity;         /* raw units per second */
+    float acceleration;     /* raw units per second squared */
+};
+
+/* executor configuration */
+struct lobot_trajectory_config {
+    uint32_t baud;              /* bus baud rate, the port's if 0 */
+    float bus_share;            /* share of bus time for setpoints, 0.5 if 0 */
+    float tolerance;            /* largest deviation, in raw units, allowed
+                                   between the servo's linear move and the
+                                   curve, 2 if 0 */
+    uint16_t segment_min_ms;    /* shortest move sent to a servo, 20 if 0 */
+    uint16_t segment_max_ms;    /* longest move sent to a servo, 500 if 0 */
+};
+
+/* tracking status of a joint */
+struct lobot_trajectory_status {
+    uint32_t lag_ms;        /* how late the last move was sent */
+    uint32_t max_lag_ms;    /* worst lag so far */
+    uint32_t frames;        /* moves sent so far */
+    uint32_t pending;       /* buffered waypoints */
+    float target;           /* position of the last move */
+};
+
+/* struct representing a trajectory executor */
+struct lobot_trajectory_t;
+
+/* create a trajectory executor
+ * @param port Port returned by lobot_port_open
+ * @param config Executor configuration, NULL for defaults
+ * @return struct lobot_trajectory_t *, NULL on failure
+ */
+struct lobot_trajectory_t* lobot_trajectory_create(struct lobot_port_t* port,
+        const struct lobot_trajectory_config* config);
+
+/* add a joint to the executor
+ * @param traj Executor returned by lobot_trajectory_create
+ * @param id Servo ID of the joint
+ * @param interp Interpolation between the joint's waypoints
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_trajectory_add_joint(struct lobot_trajectory_t* traj, uint8_t id,
+        lobot_interp_t interp);
+
+/* append a waypoint to a joint's stream, time stamps must increase
+ * @param traj Executor returned by lobot_trajectory_create
+ * @param id Servo ID of the joint
+ * @param wp Waypoint to append
+ * @return 0 on success, -EAGAIN if the joint's buffer is full, other negative
+ *         errno on failure
+ */
+int lobot_trajectory_push(struct lobot_trajectory_t* traj, uint8_t id,
+        const struct lobot_waypoint* wp);
+
+/* send moves that are due, call often, e.g. every control cycle
+ * Each move lets the servo's interpolator cover the longest segment of the
+ * curve within tolerance. When the bus budget is exhausted, the most lagging
+ * joints are served first and all moves go out in a single write.
+ * @param traj Executor returned by lobot_trajectory_create
+ * @param now_ms Current time on the clock of the waypoint time stamps
+ * @return number of moves sent, negative errno on failure
+ */
+int lobot_trajectory_update(struct lobot_trajectory_t* traj, uint32_t now_ms);
+
+/* get tracking status of a joint
+ * @param traj Executor returned by lobot_trajectory_create
+ * @param id Servo ID of the joint
+ * @param status_out Output status
+ * @return 0 on success, negative errno on failure
+ */
+int lobot_trajectory_status(struct lobot_trajectory_t* traj, uint8_t id,
+        struct lobot_trajectory_status* status_out);
+
+/* free a trajectory executor, its port is left open
+ * @param traj Executor returned by lobot_trajectory_create
+ */
+void lobot_trajectory_destroy(struct lobot_trajectory_t* traj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,316 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "lobot_servo/control.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#define ID_SLOTS 256
+
+/* bounded multi-producer single-consumer queue cell */
+struct setpoint_cell {
+    size_t seq;
+    uint8_t id;
+    uint16_t position;
+    uint16_t time;
+};
+
+/* servo state published under a seqlock, fields are accessed atomically so
+ * readers racing with the writer only ever retry
+ */
+struct state_slot {
+    uint32_t seq;
+    int polled;
+    uint64_t timestamp_us;
+    uint64_t cycle;
+    int32_t status;
+    uint16_t position;
+};
+
+struct lobot_control_t {
+    struct lobot_port_t *port;
+    uint32_t period_us;
+    uint8_t ids[LOBOT_ID_MAX + 1];
+    size_t n;
+
+    pthread_t thread;
+    int running;
+    int started;
+    uint64_t overruns;
+    uint64_t write_errors;
+
+    struct setpoint_cell queue[LOBOT_CONTROL_QUEUE_LEN];
+    size_t enqueue_pos;
+    size_t dequeue_pos;
+
+    struct state_slot states[ID_SLOTS];
+};
+
+static uint64_t timespec_us(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static void timespec_add_us(struct timespec *ts, uint32_t us)
+{
+    ts->tv_nsec += (long)(us % 1000000) * 1000;
+    ts->tv_sec += us / 1000000 + ts->tv_nsec / 1000000000;
+    ts->tv_nsec %= 1000000000;
+}
+
+static int setpoint_pop(struct lobot_control_t *ctl, uint8_t *id,
+        uint16_t *position, uint16_t *time)
+{
+    struct setpoint_cell *cell;
+    size_t pos = ctl->dequeue_pos;
+
+    cell = &ctl->queue[pos % LOBOT_CONTROL_QUEUE_LEN];
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return 0;
+    }
+    *id = cell->id;
+    *position = cell->position;
+    *time = cell->time;
+    __atomic_store_n(&cell->seq, pos + LOBOT_CONTROL_QUEUE_LEN, __ATOMIC_RELEASE);
+    ctl->dequeue_pos = pos + 1;
+    return 1;
+}
+
+static void publish(struct state_slot *slot, uint64_t now_us, uint64_t cycle,
+        lobot_error_t status, const uint16_t *position)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&slot->timestamp_us, now_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->cycle, cycle, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->status, status, __ATOMIC_RELAXED);
+    if (position) {
+        __atomic_store_n(&slot->position, *position, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void* control_thread(void *arg)
+{
+    struct lobot_control_t *ctl = arg;
+    uint8_t set_ids[LOBOT_ID_MAX + 1];
+    uint16_t set_pos[LOBOT_ID_MAX + 1];
+    uint16_t set_time[LOBOT_ID_MAX + 1];
+    int16_t set_index[ID_SLOTS];
+    uint16_t positions[LOBOT_ID_MAX + 1];
+    lobot_error_t status[LOBOT_ID_MAX + 1];
+    struct timespec next, now;
+    uint64_t cycle = 0;
+    uint16_t position, time;
+    size_t i, nset;
+    uint8_t id;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (__atomic_load_n(&ctl->running, __ATOMIC_ACQUIRE)) {
+        /* keep only the latest setpoint of every servo, IDs were checked when
+         * queued so they all fit */
+        memset(set_index, -1, sizeof(set_index));
+        nset = 0;
+        while (setpoint_pop(ctl, &id, &position, &time)) {
+            if (set_index[id] < 0) {
+                set_index[id] = nset++;
+                set_ids[set_index[id]] = id;
+            }
+            set_pos[set_index[id]] = position;
+            set_time[set_index[id]] = time;
+        }
+        if (nset > 0 && lobot_set_pos_multi(ctl->port, set_ids, set_pos, set_time,
+                    nset) != LOBOT_OK) {
+            __atomic_add_fetch(&ctl->write_errors, 1, __ATOMIC_RELAXED);
+        }
+
+        if (ctl->n > 0) {
+            lobot_read_positions(ctl->port, ctl->ids, ctl->n, positions, status);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            for (i = 0; i < ctl->n; ++i) {
+                publish(&ctl->states[ctl->ids[i]], timespec_us(&now), cycle,
+                        status[i], status[i] == LOBOT_OK ? &positions[i] : NULL);
+            }
+        }
+        cycle++;
+
+        timespec_add_us(&next, ctl->period_us);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_us(&now) > timespec_us(&next)) {
+            /* missed the deadline, restart cadence from now */
+            __atomic_add_fetch(&ctl->overruns, 1, __ATOMIC_RELAXED);
+            next = now;
+            continue;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+    }
+
+    return NULL;
+}
+
+struct lobot_control_t* lobot_control_create(struct lobot_port_t* port,
+        const struct lobot_control_config* config)
+{
+    struct lobot_control_t *ctl;
+    size_t i;
+
+    if (port == NULL || config == NULL || config->period_us == 0 ||
+            config->n > LOBOT_ID_MAX + 1 || (config->n && !config->ids)) {
+        return NULL;
+    }
+
+    ctl = calloc(1, sizeof *ctl);
+    if (ctl == NULL) {
+        return NULL;
+    }
+
+    ctl->port = port;
+    ctl->period_us = config->period_us;
+    ctl->n = config->n;
+    for (i = 0; i < config->n; ++i) {
+        ctl->ids[i] = config->ids[i];
+        ctl->states[config->ids[i]].polled = 1;
+        ctl->states[config->ids[i]].status = LOBOT_NO_REPLY;
+    }
+    for (i = 0; i < LOBOT_CONTROL_QUEUE_LEN; ++i) {
+        ctl->queue[i].seq = i;
+    }
+
+    return ctl;
+}
+
+int lobot_control_start(struct lobot_control_t* ctl)
+{
+    int ret;
+
+    if (ctl == NULL) {
+        return -EINVAL;
+    }
+    if (ctl->started) {
+        return -EBUSY;
+    }
+
+    __atomic_store_n(&ctl->running, 1, __ATOMIC_RELEASE);
+    ret = pthread_create(&ctl->thread, NULL, control_thread, ctl);
+    if (ret != 0) {
+        __atomic_store_n(&ctl->running, 0, __ATOMIC_RELEASE);
+        return -ret;
+    }
+    ctl->started = 1;
+    return 0;
+}
+
+void lobot_control_stop(struct lobot_control_t* ctl)
+{
+    if (ctl && ctl->started) {
+        __atomic_store_n(&ctl->running, 0, __ATOMIC_RELEASE);
+        pthread_join(ctl->thread, NULL);
+        ctl->started = 0;
+    }
+}
+
+int lobot_control_set_pos(struct lobot_control_t* ctl, uint8_t id,
+        uint16_t position, uint16_t time)
+{
+    struct setpoint_cell *cell;
+    size_t pos, seq;
+
+    if (ctl == NULL || id > LOBOT_ID_MAX) {
+        return -EINVAL;
+    }
+
+    pos = __atomic_load_n(&ctl->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &ctl->queue[pos % LOBOT_CONTROL_QUEUE_LEN];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&ctl->enqueue_pos, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (seq < pos) {
+            return -EAGAIN;
+        } else {
+            pos = __atomic_load_n(&ctl->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->id = id;
+    cell->position = position;
+    cell->time = time;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int lobot_control_get_state(struct lobot_control_t* ctl, uint8_t id,
+        struct lobot_servo_state* state_out)
+{
+    struct state_slot *slot;
+    uint32_t seq;
+
+    if (ctl == NULL || state_out == NULL) {
+        return -EINVAL;
+    }
+    slot = &ctl->states[id];
+    if (!slot->polled) {
+        return -ENOENT;
+    }
+
+    do {
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        state_out->timestamp_us = __atomic_load_n(&slot->timestamp_us, __ATOMIC_RELAXED);
+        state_out->cycle = __atomic_load_n(&slot->cycle, __ATOMIC_RELAXED);
+        state_out->status = __atomic_load_n(&slot->status, __ATOMIC_RELAXED);
+        state_out->position = __atomic_load_n(&slot->position, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED));
+
+    return 0;
+}
+
+uint64_t lobot_control_overruns(struct lobot_control_t* ctl)
+{
+    return ctl ? __atomic_load_n(&ctl->overruns, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t lobot_control_write_errors(struct lobot_control_t* ctl)
+{
+    return ctl ? __atomic_load_n(&ctl->write_errors, __ATOMIC_RELAXED) : 0;
+}
+
+void lobot_control_destroy(struct lobot_control_t* ctl)
+{
+    if (ctl) {
+        lobot_control_stop(ctl);
+        lobot_port_close(ctl->port);
+        free(ctl);
+    }
+}
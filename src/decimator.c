@@ -0,0 +1,213 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <math.h>
+
+#include "lobot_servo/decimator.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#define ID_SLOTS 256
+
+/* swing door state of a servo: the slopes of lines through the anchor that
+ * pass within tolerance of every sample since the anchor lie in
+ * [slope_min, slope_max]
+ */
+struct door {
+    int anchored;
+    uint32_t t_anchor;
+    float p_anchor;
+    uint32_t t_last;
+    float slope_min;
+    float slope_max;
+    struct lobot_decimator_stats stats;
+};
+
+struct lobot_decimator_t {
+    struct lobot_port_t *port;
+    struct lobot_decimator_config config;
+    struct door doors[ID_SLOTS];
+};
+
+static void open_door(struct door *door, uint32_t t, float p, float tolerance)
+{
+    float dt = (float)(t - door->t_anchor);
+
+    door->slope_max = (p + tolerance - door->p_anchor) / dt;
+    door->slope_min = (p - tolerance - door->p_anchor) / dt;
+    door->t_last = t;
+}
+
+/* close segment at the last sample and start the next one from its end
+ * A segment only grows past segment_max_ms over a gap in the samples, its
+ * move is then shortened to segment_max_ms.
+ * @return 0 on success, -EIO if the move couldn't be sent
+ */
+static int emit(struct lobot_decimator_t *dec, uint8_t id, struct door *door)
+{
+    float slope = (door->slope_min + door->slope_max) / 2;
+    float p = door->p_anchor + slope * (door->t_last - door->t_anchor);
+    uint32_t time = door->t_last - door->t_anchor;
+    uint16_t position;
+    int ret = 0;
+
+    if (p < LOBOT_ANGLE_RAW_MIN) {
+        p = LOBOT_ANGLE_RAW_MIN;
+    }
+    if (p > LOBOT_ANGLE_RAW_MAX) {
+        p = LOBOT_ANGLE_RAW_MAX;
+    }
+    position = (uint16_t)lroundf(p);
+    if (time > dec->config.segment_max_ms) {
+        time = dec->config.segment_max_ms;
+    }
+
+    if (dec->config.emit) {
+        dec->config.emit(dec->config.ctx, id, position, (uint16_t)time);
+        door->stats.moves++;
+    } else if (lobot_set_pos(dec->port, id, position, (uint16_t)time) == LOBOT_OK) {
+        door->stats.moves++;
+    } else {
+        door->stats.failed++;
+        ret = -EIO;
+    }
+
+    door->t_anchor = door->t_last;
+    door->p_anchor = p;
+    return ret;
+}
+
+struct lobot_decimator_t* lobot_decimator_create(struct lobot_port_t* port,
+        const struct lobot_decimator_config* config)
+{
+    struct lobot_decimator_t *dec;
+
+    if (port == NULL && (config == NULL || config->emit == NULL)) {
+        return NULL;
+    }
+
+    dec = calloc(1, sizeof *dec);
+    if (dec == NULL) {
+        return NULL;
+    }
+
+    dec->port = port;
+    if (config) {
+        dec->config = *config;
+    }
+    if (dec->config.tolerance <= 0) {
+        dec->config.tolerance = 2;
+    }
+    if (dec->config.segment_max_ms == 0) {
+        dec->config.segment_max_ms = 500;
+    }
+    if (dec->config.segment_max_ms > LOBOT_MOVETIME_MS_MAX) {
+        dec->config.segment_max_ms = LOBOT_MOVETIME_MS_MAX;
+    }
+
+    return dec;
+}
+
+int lobot_decimator_push(struct lobot_decimator_t* dec, uint8_t id,
+        uint32_t t_ms, float position)
+{
+    struct door *door;
+    float dt, slope_max, slope_min;
+    int emitted = 0;
+    int ret;
+
+    if (dec == NULL) {
+        return -EINVAL;
+    }
+    door = &dec->doors[id];
+
+    if (!door->anchored) {
+        door->anchored = 1;
+        door->t_anchor = t_ms;
+        door->p_anchor = position;
+        door->t_last = t_ms;
+        door->stats.samples++;
+        return 0;
+    }
+    if (t_ms <= door->t_last) {
+        return -EINVAL;
+    }
+    door->stats.samples++;
+
+    if (door->t_last == door->t_anchor) {
+        open_door(door, t_ms, position, dec->config.tolerance);
+        return 0;
+    }
+
+    dt = (float)(t_ms - door->t_anchor);
+    slope_max = (position + dec->config.tolerance - door->p_anchor) / dt;
+    slope_min = (position - dec->config.tolerance - door->p_anchor) / dt;
+    if (slope_max > door->slope_max) {
+        slope_max = door->slope_max;
+    }
+    if (slope_min < door->slope_min) {
+        slope_min = door->slope_min;
+    }
+
+    if (slope_min > slope_max || t_ms - door->t_anchor > dec->config.segment_max_ms) {
+        /* no single line fits any more, sample starts the next segment */
+        ret = emit(dec, id, door);
+        open_door(door, t_ms, position, dec->config.tolerance);
+        emitted = ret < 0 ? ret : 1;
+    } else {
+        door->slope_min = slope_min;
+        door->slope_max = slope_max;
+        door->t_last = t_ms;
+    }
+
+    return emitted;
+}
+
+int lobot_decimator_flush(struct lobot_decimator_t* dec, uint8_t id)
+{
+    struct door *door;
+
+    if (dec == NULL) {
+        return -EINVAL;
+    }
+    door = &dec->doors[id];
+    if (!door->anchored || door->t_last == door->t_anchor) {
+        return 0;
+    }
+
+    return emit(dec, id, door) < 0 ? -EIO : 1;
+}
+
+int lobot_decimator_stats(struct lobot_decimator_t* dec, uint8_t id,
+        struct lobot_decimator_stats* stats_out)
+{
+    if (dec == NULL || stats_out == NULL) {
+        return -EINVAL;
+    }
+
+    *stats_out = dec->doors[id].stats;
+    return 0;
+}
+
+void lobot_decimator_destroy(struct lobot_decimator_t* dec)
+{
+    free(dec);
+}
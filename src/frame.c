@@ -0,0 +1,274 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "frame.h"
+
+#define RING_MASK (LOBOT_RX_RING_SIZE - 1)
+#define RING_AT(ring, i) ((ring)->data[((ring)->head + (i)) & RING_MASK])
+
+uint8_t lobot_check_sum(const uint8_t *buffer)
+{
+    uint8_t checksum = 0;
+    int i;
+    for (i = PACKET_INDEX_ID; i < (PACKET_INDEX_ID + buffer[PACKET_INDEX_LEN]); ++i) {
+        checksum += buffer[i];
+    }
+    return ~(checksum & 0xFF);
+}
+
+size_t lobot_frame_build(uint8_t id, cmd_t cmd, const uint8_t *params,
+        size_t nparams, uint8_t *buffer)
+{
+    size_t len = PACKET_LEN_0 + nparams;
+
+    buffer[PACKET_INDEX_HEADER] = LOBOT_FRAME_HEADER;
+    buffer[PACKET_INDEX_HEADER+1] = LOBOT_FRAME_HEADER;
+    buffer[PACKET_INDEX_ID] = id;
+    buffer[PACKET_INDEX_LEN] = (uint8_t)(len - 3);
+    buffer[PACKET_INDEX_CMD] = (uint8_t)cmd;
+    if (nparams) {
+        memcpy(&buffer[PACKET_INDEX_PARAM], params, nparams);
+    }
+    buffer[len - 1] = lobot_check_sum(buffer);
+    return len;
+}
+
+int lobot_frames_encode(const struct lobot_frame_desc* frames, size_t n,
+        uint8_t* buffer, size_t size)
+{
+    const struct lobot_frame_desc *f;
+    uint8_t *p = buffer;
+    unsigned sum;
+    size_t i, k;
+
+    for (i = 0; i < n; ++i) {
+        f = &frames[i];
+        if (f->nparams > LOBOT_FRAME_PARAM_MAX) {
+            return -EINVAL;
+        }
+        if ((size_t)(buffer + size - p) < (size_t)PACKET_LEN_0 + f->nparams) {
+            return -ENOSPC;
+        }
+
+        p[PACKET_INDEX_HEADER] = LOBOT_FRAME_HEADER;
+        p[PACKET_INDEX_HEADER+1] = LOBOT_FRAME_HEADER;
+        p[PACKET_INDEX_ID] = f->id;
+        p[PACKET_INDEX_LEN] = f->nparams + 3;
+        p[PACKET_INDEX_CMD] = f->cmd;
+        sum = f->id + f->nparams + 3 + f->cmd;
+        for (k = 0; k < f->nparams; ++k) {
+            p[PACKET_INDEX_PARAM + k] = f->params[k];
+            sum += f->params[k];
+        }
+        p[PACKET_INDEX_PARAM + k] = (uint8_t)~sum;
+        p += PACKET_LEN_0 + f->nparams;
+    }
+
+    return (int)(p - buffer);
+}
+
+size_t lobot_cmd_reply_params(cmd_t cmd)
+{
+    switch (cmd) {
+        case LOBOT_CMD_MOVE_TIME_READ:
+        case LOBOT_CMD_MOVE_TIME_WAIT_READ:
+        case LOBOT_CMD_ANGLE_LIMIT_READ:
+        case LOBOT_CMD_VIN_LIMIT_READ:
+        case LOBOT_CMD_OR_MOTOR_MODE_READ:
+            return 4;
+        case LOBOT_CMD_VIN_READ:
+        case LOBOT_CMD_POS_READ:
+            return 2;
+        case LOBOT_CMD_ID_READ:
+        case LOBOT_CMD_ANGLE_OFFSET_READ:
+        case LOBOT_CMD_TEMP_MAX_LIMIT_READ:
+        case LOBOT_CMD_TEMP_READ:
+        case LOBOT_CMD_LOAD_OR_UNLOAD_READ:
+        case LOBOT_CMD_LED_CTRL_READ:
+        case LOBOT_CMD_LED_ERROR_READ:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void lobot_rx_reset(struct lobot_rx_ring *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+size_t lobot_rx_count(const struct lobot_rx_ring *ring)
+{
+    return ring->tail - ring->head;
+}
+
+int lobot_rx_space(struct lobot_rx_ring *ring, struct iovec iov[2])
+{
+    size_t free_len = LOBOT_RX_RING_SIZE - lobot_rx_count(ring);
+    size_t start = ring->tail & RING_MASK;
+    size_t first = LOBOT_RX_RING_SIZE - start;
+
+    if (free_len == 0) {
+        return 0;
+    }
+    if (first >= free_len) {
+        iov[0].iov_base = &ring->data[start];
+        iov[0].iov_len = free_len;
+        return 1;
+    }
+    iov[0].iov_base = &ring->data[start];
+    iov[0].iov_len = first;
+    iov[1].iov_base = &ring->data[0];
+    iov[1].iov_len = free_len - first;
+    return 2;
+}
+
+void lobot_rx_commit(struct lobot_rx_ring *ring, size_t len)
+{
+    ring->tail += len;
+}
+
+size_t lobot_rx_drain(struct lobot_rx_ring *ring, uint8_t *buffer, size_t len)
+{
+    size_t i, count = lobot_rx_count(ring);
+
+    if (len > count) {
+        len = count;
+    }
+    for (i = 0; i < len; ++i) {
+        buffer[i] = RING_AT(ring, i);
+    }
+    ring->head += len;
+    return len;
+}
+
+size_t lobot_rx_peek(const struct lobot_rx_ring *ring, uint8_t *buffer, size_t len)
+{
+    size_t i, count = lobot_rx_count(ring);
+
+    if (len > count) {
+        len = count;
+    }
+    for (i = 0; i < len; ++i) {
+        buffer[i] = RING_AT(ring, i);
+    }
+    return len;
+}
+
+int lobot_rx_reply_started(const struct lobot_rx_ring *ring)
+{
+    size_t count = lobot_rx_count(ring);
+    size_t i;
+    uint8_t len;
+
+    for (i = 0; i + PACKET_INDEX_LEN < count; ++i) {
+        if (RING_AT(ring, i + PACKET_INDEX_HEADER) != LOBOT_FRAME_HEADER ||
+                RING_AT(ring, i + PACKET_INDEX_HEADER + 1) != LOBOT_FRAME_HEADER) {
+            continue;
+        }
+        len = RING_AT(ring, i + PACKET_INDEX_LEN);
+        if (len > PACKET_LEN_0 - 3 && len <= PACKET_LEN_MAX - 3) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int lobot_rx_frame_ready(const struct lobot_rx_ring *ring)
+{
+    size_t count = lobot_rx_count(ring);
+    size_t i, total;
+
+    /* same resync as lobot_rx_extract: skip bytes that can't start a frame */
+    for (i = 0; i + PACKET_INDEX_LEN < count; ++i) {
+        if (RING_AT(ring, i + PACKET_INDEX_HEADER) != LOBOT_FRAME_HEADER ||
+                RING_AT(ring, i + PACKET_INDEX_HEADER + 1) != LOBOT_FRAME_HEADER) {
+            continue;
+        }
+        total = (size_t)RING_AT(ring, i + PACKET_INDEX_LEN) + 3;
+        if (total < PACKET_LEN_0 || total > PACKET_LEN_MAX) {
+            continue;
+        }
+        return i + total <= count;
+    }
+
+    return 0;
+}
+
+int lobot_frame_answers(const uint8_t *request, const uint8_t *reply, size_t reply_len)
+{
+    /* a read request carries no parameters, its echo is never a reply */
+    if (reply[PACKET_INDEX_LEN] + 3 != (int)reply_len || reply_len <= PACKET_LEN_0) {
+        return 0;
+    }
+    if (reply[PACKET_INDEX_CMD] != request[PACKET_INDEX_CMD]) {
+        return 0;
+    }
+    return request[PACKET_INDEX_ID] == LOBOT_ID_BROADCAST ||
+        reply[PACKET_INDEX_ID] == request[PACKET_INDEX_ID];
+}
+
+int lobot_rx_extract(struct lobot_rx_ring *ring, uint8_t *frame, size_t size)
+{
+    uint8_t buffer[PACKET_LEN_MAX];
+    size_t count, total, i;
+    uint8_t len;
+
+    while ((count = lobot_rx_count(ring)) >= PACKET_INDEX_LEN + 1) {
+        /* resync on frame header, dropping stale bytes */
+        if (RING_AT(ring, PACKET_INDEX_HEADER) != LOBOT_FRAME_HEADER ||
+                RING_AT(ring, PACKET_INDEX_HEADER + 1) != LOBOT_FRAME_HEADER) {
+            ring->head++;
+            continue;
+        }
+
+        len = RING_AT(ring, PACKET_INDEX_LEN);
+        total = (size_t)len + 3;
+        if (total < PACKET_LEN_0 || total > PACKET_LEN_MAX) {
+            ring->head++;
+            continue;
+        }
+        if (count < total) {
+            return 0;
+        }
+
+        for (i = 0; i < total; ++i) {
+            buffer[i] = RING_AT(ring, i);
+        }
+        if (lobot_check_sum(buffer) != buffer[total - 1]) {
+            /* might be a false header, rescan from next byte */
+            ring->head++;
+            return -EBADMSG;
+        }
+
+        ring->head += total;
+        if (total > size) {
+            return -EMSGSIZE;
+        }
+        memcpy(frame, buffer, total);
+        return (int)total;
+    }
+
+    return 0;
+}
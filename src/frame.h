@@ -0,0 +1,123 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__FRAME_H_
+#define MOGI_LOBOT__FRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "lobot_servo/protocol.h"
+
+#define PACKET_INDEX_HEADER 0
+#define PACKET_INDEX_ID     2
+#define PACKET_INDEX_LEN    3
+#define PACKET_INDEX_CMD    4
+#define PACKET_INDEX_PARAM  5
+
+/* Total packet length */
+#define PACKET_LEN_0       6        /* zero parameter */
+#define PACKET_LEN_1       7        /* 1 uint8 parameter */
+#define PACKET_LEN_2       8        /* 1 uint16 parameter */
+#define PACKET_LEN_4       10       /* 2 uint16 parameters */
+#define PACKET_LEN_MAX     LOBOT_FRAME_LEN_MAX
+
+typedef lobot_cmd_t cmd_t;
+
+static const uint8_t LOBOT_FRAME_HEADER = 0x55;
+
+#define LOW_BYTE(a) ((uint8_t)((a) & 0xFF))
+#define HIGH_BYTE(a) ((uint8_t)(((a) >> 8) & 0xFF))
+
+/* receive ring size, must be a power of 2 */
+#define LOBOT_RX_RING_SIZE 512
+
+/* ring buffer of received bytes, scanned for complete frames */
+struct lobot_rx_ring {
+    uint8_t data[LOBOT_RX_RING_SIZE];
+    size_t head;    /* next byte to parse, free running */
+    size_t tail;    /* next byte to fill, free running */
+};
+
+/* compute checksum of a frame, whose length is given in its LEN field */
+uint8_t lobot_check_sum(const uint8_t *buffer);
+
+/* build a frame carrying nparams parameter bytes
+ * @param buffer Output buffer, at least nparams + PACKET_LEN_0 bytes
+ * @return frame length
+ */
+size_t lobot_frame_build(uint8_t id, cmd_t cmd, const uint8_t *params,
+        size_t nparams, uint8_t *buffer);
+
+/* number of parameters in a servo's reply to a command
+ * @return 0 for commands the servo doesn't answer
+ */
+size_t lobot_cmd_reply_params(cmd_t cmd);
+
+/* reset ring to empty */
+void lobot_rx_reset(struct lobot_rx_ring *ring);
+
+/* number of buffered bytes not consumed yet */
+size_t lobot_rx_count(const struct lobot_rx_ring *ring);
+
+/* describe free space of the ring so it can be filled with one readv()
+ * @return number of iovec entries used, 0 if the ring is full
+ */
+int lobot_rx_space(struct lobot_rx_ring *ring, struct iovec iov[2]);
+
+/* mark len bytes of free space as filled */
+void lobot_rx_commit(struct lobot_rx_ring *ring, size_t len);
+
+/* copy out up to len raw bytes, bypassing the frame decoder
+ * @return number of bytes copied
+ */
+size_t lobot_rx_drain(struct lobot_rx_ring *ring, uint8_t *buffer, size_t len);
+
+/* copy out up to len raw bytes without consuming them
+ * @return number of bytes copied
+ */
+size_t lobot_rx_peek(const struct lobot_rx_ring *ring, uint8_t *buffer, size_t len);
+
+/* check whether the header of a reply frame, one carrying parameters as
+ * opposed to an echoed read request, has been received
+ */
+int lobot_rx_reply_started(const struct lobot_rx_ring *ring);
+
+/* check whether a complete frame is buffered, which lobot_rx_extract would
+ * return or drop for a bad checksum, without consuming anything
+ */
+int lobot_rx_frame_ready(const struct lobot_rx_ring *ring);
+
+/* check whether reply is the answer to request
+ * Echoed requests, and replies from other servos or to other commands, don't
+ * match.
+ */
+int lobot_frame_answers(const uint8_t *request, const uint8_t *reply, size_t reply_len);
+
+/* extract next complete and valid frame from ring
+ * Bytes preceding a frame header are discarded, as well as frames with bad
+ * length or checksum.
+ * @param frame Output buffer for the frame
+ * @param size Size of output buffer
+ * @return frame length, 0 if no complete frame is buffered yet,
+ *         -EBADMSG if a frame with bad checksum was dropped,
+ *         -EMSGSIZE if a frame larger than size was dropped
+ */
+int lobot_rx_extract(struct lobot_rx_ring *ring, uint8_t *frame, size_t size);
+
+#endif
@@ -0,0 +1,229 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#include "port_internal.h"
+#include "health.h"
+
+/* take a round trip into an estimate, RFC 6298 style */
+static void health_rtt_sample(int64_t* srtt_us, int64_t* rttvar_us, int64_t rtt_us)
+{
+    int64_t err;
+
+    if (*srtt_us == 0) {
+        *srtt_us = rtt_us > 0 ? rtt_us : 1;
+        *rttvar_us = rtt_us / 2;
+        return;
+    }
+    err = rtt_us - *srtt_us;
+    *rttvar_us += ((err < 0 ? -err : err) - *rttvar_us) / 4;
+    *srtt_us += err / 8;
+}
+
+uint32_t health_timeout(struct lobot_health* health, uint8_t id,
+        uint32_t attempt, uint32_t port_timeout_us)
+{
+    struct health_entry *e = health_entry(health, id);
+    uint64_t timeout, max;
+
+    if (e == NULL) {
+        return LOBOT_PORT_TIMEOUT_DEFAULT;
+    }
+
+    max = health->config.max_timeout_us ? health->config.max_timeout_us :
+        port_timeout_us;
+    if (e->srtt_us) {
+        timeout = e->srtt_us + 4 * e->rttvar_us;
+    } else if (health->srtt_us) {
+        timeout = health->srtt_us + 4 * health->rttvar_us;
+    } else {
+        timeout = max;
+    }
+    timeout <<= attempt < 16 ? attempt : 16;
+    if (timeout < health->config.min_timeout_us) {
+        timeout = health->config.min_timeout_us;
+    }
+    return (uint32_t)(timeout < max ? timeout : max);
+}
+
+int health_skip(struct lobot_health* health, uint8_t id, uint64_t now_us)
+{
+    struct health_entry *e = health_entry(health, id);
+
+    return e && e->state == LOBOT_HEALTH_DOWN && now_us < e->probe_at_us;
+}
+
+int health_retry(struct lobot_health* health, uint8_t id, int ret,
+        uint32_t attempt)
+{
+    struct health_entry *e = health_entry(health, id);
+
+    return e && (ret == -ETIMEDOUT || ret == -EBADMSG) &&
+        e->state != LOBOT_HEALTH_DOWN && attempt < health->config.retries;
+}
+
+void health_note(struct lobot_health* health, uint8_t id, int ret,
+        int64_t rtt_us, uint64_t now_us)
+{
+    struct health_entry *e = health_entry(health, id);
+    uint64_t delay;
+
+    if (e == NULL || ret == -EBADMSG) {
+        return;
+    }
+
+    if (ret >= 0) {
+        if (rtt_us >= 0) {
+            health_rtt_sample(&e->srtt_us, &e->rttvar_us, rtt_us);
+            health_rtt_sample(&health->srtt_us, &health->rttvar_us, rtt_us);
+        }
+        e->state = LOBOT_HEALTH_UP;
+        e->failures = 0;
+        e->probes = 0;
+        return;
+    }
+    if (ret != -ETIMEDOUT) {
+        return;
+    }
+
+    e->failures++;
+    if (e->state != LOBOT_HEALTH_DOWN && e->failures < health->config.dead_after) {
+        e->state = LOBOT_HEALTH_SUSPECT;
+        return;
+    }
+    delay = (uint64_t)health->config.probe_us << (e->probes < 16 ? e->probes : 16);
+    if (delay > health->config.probe_max_us) {
+        delay = health->config.probe_max_us;
+    }
+    e->state = LOBOT_HEALTH_DOWN;
+    e->probes++;
+    e->probe_at_us = now_us + delay;
+}
+
+void lobot_health_config_init(struct lobot_health_config* config)
+{
+    if (config) {
+        config->retries = 2;
+        config->min_timeout_us = 2000;
+        config->max_timeout_us = 0;
+        config->dead_after = 3;
+        config->probe_us = 100000;
+        config->probe_max_us = 2000000;
+    }
+}
+
+lobot_error_t lobot_health_enable(struct lobot_port_t *port,
+        const struct lobot_health_config* config)
+{
+    struct lobot_health *health;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    health = lobot_port_health(port);
+    if (health == NULL) {
+        health = calloc(1, sizeof *health);
+        if (health == NULL) {
+            lobot_port_release(port);
+            return LOBOT_NO_MEMORY;
+        }
+        lobot_port_set_health(port, health);
+    }
+    if (config) {
+        health->config = *config;
+    } else {
+        lobot_health_config_init(&health->config);
+    }
+    if (health->config.dead_after == 0) {
+        health->config.dead_after = 1;
+    }
+    lobot_port_release(port);
+
+    return LOBOT_OK;
+}
+
+void lobot_health_disable(struct lobot_port_t *port)
+{
+    if (port) {
+        /* not under a transaction of another thread */
+        lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+        free(lobot_port_health(port));
+        lobot_port_set_health(port, NULL);
+        lobot_port_release(port);
+    }
+}
+
+void lobot_health_reset(struct lobot_port_t *port, uint8_t id)
+{
+    struct lobot_health *health;
+    struct health_entry *e;
+
+    if (port == NULL) {
+        return;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    health = lobot_port_health(port);
+    e = health_entry(health, id);
+    if (e) {
+        memset(e, 0, sizeof *e);
+    } else if (health && id == LOBOT_ID_BROADCAST) {
+        memset(health->entry, 0, sizeof(health->entry));
+        health->srtt_us = 0;
+        health->rttvar_us = 0;
+    }
+    lobot_port_release(port);
+}
+
+lobot_error_t lobot_health_get(struct lobot_port_t *port, uint8_t id,
+        struct lobot_health_info* info_out)
+{
+    struct lobot_health *health;
+    struct health_entry *e;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+    if (info_out == NULL) {
+        return LOBOT_BAD_ARG;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    health = lobot_port_health(port);
+    e = health_entry(health, id);
+    if (e == NULL) {
+        lobot_port_release(port);
+        return LOBOT_BAD_ARG;
+    }
+    info_out->state = (lobot_health_state_t)e->state;
+    info_out->srtt_us = (uint32_t)e->srtt_us;
+    info_out->rttvar_us = (uint32_t)e->rttvar_us;
+    info_out->timeout_us = health_timeout(health, id, 0, lobot_port_get_timeout(port));
+    info_out->failures = e->failures;
+    lobot_port_release(port);
+    return LOBOT_OK;
+}
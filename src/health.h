@@ -0,0 +1,80 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__HEALTH_H_
+#define MOGI_LOBOT__HEALTH_H_
+
+#include <stdint.h>
+
+#include "lobot_servo/servo.h"
+
+/* link health of a servo, round trips in microseconds */
+struct health_entry {
+    uint8_t state;          /* lobot_health_state_t */
+    int64_t srtt_us;        /* 0 until measured */
+    int64_t rttvar_us;
+    uint32_t failures;      /* lost replies in a row */
+    uint32_t probes;        /* probes missed while down */
+    uint64_t probe_at_us;   /* when a down servo may be tried again */
+};
+
+struct lobot_health {
+    struct lobot_health_config config;
+    int64_t srtt_us;        /* over every servo, for those not measured yet */
+    int64_t rttvar_us;
+    struct health_entry entry[LOBOT_ID_MAX + 1];
+};
+
+/* health entry of a servo, NULL if tracking is off or id is broadcast */
+static inline struct health_entry* health_entry(struct lobot_health* health, uint8_t id)
+{
+    if (health == NULL || id > LOBOT_ID_MAX) {
+        return NULL;
+    }
+    return &health->entry[id];
+}
+
+/* reply timeout of an attempt, doubling with every retry
+ * Servos not measured yet, like missing ones, go by the round trips of the
+ * others, and by the longest timeout until any is measured.
+ * @param port_timeout_us Port's timeout
+ * @return timeout, LOBOT_PORT_TIMEOUT_DEFAULT if tracking is off
+ */
+uint32_t health_timeout(struct lobot_health* health, uint8_t id,
+        uint32_t attempt, uint32_t port_timeout_us);
+
+/* check whether a servo is down and its next probe isn't due yet
+ * @return 1 if requests to the servo should be skipped
+ */
+int health_skip(struct lobot_health* health, uint8_t id, uint64_t now_us);
+
+/* check whether a failed attempt should be retried, down servos never are
+ * @param ret Outcome of the attempt, as from lobot_port_transact
+ */
+int health_retry(struct lobot_health* health, uint8_t id, int ret, uint32_t attempt);
+
+/* account the outcome of a request
+ * A reply takes the round trip into the estimate, RFC 6298 style, and brings
+ * the servo up. A lost reply counts towards taking it down, a corrupted one
+ * only shows the servo is there.
+ * @param ret Outcome, as from lobot_port_transact
+ * @param rtt_us Round trip of the request, negative for no sample
+ */
+void health_note(struct lobot_health* health, uint8_t id, int ret,
+        int64_t rtt_us, uint64_t now_us);
+
+#endif
@@ -0,0 +1,1132 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/recorder.h"
+
+#include "frame.h"
+#include "port_internal.h"
+
+#ifdef LOBOT_ENABLE_STATS
+struct port_stats {
+    struct lobot_port_stats counters;
+    uint64_t last_tx_us[LOBOT_STATS_IDS];   /* send time of last request */
+};
+#endif
+
+/* bytes of written frames an echoing adapter is about to send back */
+#define PORT_ECHO_MAX 64
+
+/* probes sent by lobot_port_calibrate */
+#define CALIBRATE_PROBES 5
+/* floor of a timeout derived by lobot_port_calibrate */
+#define CALIBRATE_TIMEOUT_MIN_US 10000
+
+/* priority lock handing the bus to the most urgent waiter, waiters of a
+ * class are served in ticket order */
+struct port_arbiter {
+    pthread_mutex_t lock;
+    pthread_cond_t cond[LOBOT_PRIO_COUNT];
+    unsigned waiting[LOBOT_PRIO_COUNT];
+    unsigned long ticket[LOBOT_PRIO_COUNT];     /* next ticket to hand out */
+    unsigned long serving[LOBOT_PRIO_COUNT];    /* ticket next in line */
+    int busy;
+    pthread_t owner;
+    unsigned depth;
+};
+
+struct lobot_port_t {
+    struct port_arbiter arbiter;
+    const struct lobot_transport *transport;
+    void *ctx;
+    uint32_t timeout_us;
+    int timeout_set;                /* timeout chosen by the caller, kept by
+                                       lobot_port_calibrate */
+    struct lobot_port_info info;
+    struct lobot_rx_ring rx;
+    struct lobot_shadow *shadow;
+    struct lobot_health *health;
+    struct lobot_recorder_t *recorder;
+    struct lobot_port_calibration calibration;
+    int calibrated;
+    uint8_t echo[PORT_ECHO_MAX];    /* written frames not echoed back yet */
+    size_t echo_len;
+#ifdef LOBOT_ENABLE_STATS
+    struct port_stats stats;
+#endif
+};
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void arbiter_init(struct port_arbiter* arb)
+{
+    int i;
+
+    pthread_mutex_init(&arb->lock, NULL);
+    for (i = 0; i < LOBOT_PRIO_COUNT; ++i) {
+        pthread_cond_init(&arb->cond[i], NULL);
+    }
+}
+
+static void arbiter_destroy(struct port_arbiter* arb)
+{
+    int i;
+
+    pthread_mutex_destroy(&arb->lock);
+    for (i = 0; i < LOBOT_PRIO_COUNT; ++i) {
+        pthread_cond_destroy(&arb->cond[i]);
+    }
+}
+
+static int arbiter_outranked(struct port_arbiter* arb, int prio)
+{
+    int i;
+
+    for (i = 0; i < prio; ++i) {
+        if (__atomic_load_n(&arb->waiting[i], __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* wake the most urgent class waiting, with the lock held; only the waiter
+ * holding the class's next ticket takes the bus */
+static void arbiter_handover(struct port_arbiter* arb)
+{
+    int i;
+
+    for (i = 0; i < LOBOT_PRIO_COUNT; ++i) {
+        if (arb->waiting[i]) {
+            pthread_cond_broadcast(&arb->cond[i]);
+            return;
+        }
+    }
+}
+
+/* queue for the bus in a class and take it, with the lock held */
+static void arbiter_wait(struct port_arbiter* arb, int prio, unsigned depth)
+{
+    unsigned long ticket = arb->ticket[prio]++;
+
+    __atomic_fetch_add(&arb->waiting[prio], 1, __ATOMIC_RELAXED);
+    while (arb->busy || arbiter_outranked(arb, prio) || arb->serving[prio] != ticket) {
+        pthread_cond_wait(&arb->cond[prio], &arb->lock);
+    }
+    __atomic_fetch_sub(&arb->waiting[prio], 1, __ATOMIC_RELAXED);
+    arb->serving[prio]++;
+    arb->busy = 1;
+    arb->owner = pthread_self();
+    arb->depth = depth;
+}
+
+/* remember written bytes to strip their echo
+ * Writes too long to remember, like large batches, go unstripped; they are
+ * commands no reply is awaited for.
+ */
+static void echo_push(struct lobot_port_t* port, const uint8_t* buffer, size_t len)
+{
+    if (port->echo_len + len > PORT_ECHO_MAX) {
+        port->echo_len = 0;
+    }
+    if (len <= PORT_ECHO_MAX) {
+        memcpy(&port->echo[port->echo_len], buffer, len);
+        port->echo_len += len;
+    }
+}
+
+/* check whether a received frame is the echo of a written one, and forget it
+ * along with older ones whose echo got lost
+ * @param partial Accept a prefix of the oldest echo still on its way
+ */
+static int echo_match(struct lobot_port_t* port, const uint8_t* frame, size_t len,
+        int partial)
+{
+    size_t off = 0, flen;
+
+    if (partial) {
+        return len <= port->echo_len && memcmp(port->echo, frame, len) == 0;
+    }
+    while (off + PACKET_INDEX_LEN < port->echo_len) {
+        flen = (size_t)port->echo[off + PACKET_INDEX_LEN] + 3;
+        if (off + flen > port->echo_len) {
+            break;
+        }
+        if (flen == len && memcmp(&port->echo[off], frame, len) == 0) {
+            port->echo_len -= off + flen;
+            memmove(port->echo, &port->echo[off + flen], port->echo_len);
+            return 1;
+        }
+        off += flen;
+    }
+    return 0;
+}
+
+/* write through the transport, copying the bytes to the recorder */
+static int port_write(struct lobot_port_t* port, const uint8_t* buffer, size_t len)
+{
+    int ret = port->transport->write(port->ctx, buffer, len);
+
+    if (port->calibration.echo && ret > 0) {
+        echo_push(port, buffer, ret);
+    }
+
+    if (port->recorder && ret > 0) {
+        lobot_recorder_put(port->recorder, LOBOT_RECORD_TX,
+                (size_t)ret >= PACKET_LEN_0 ? buffer[PACKET_INDEX_ID] : 0xFF,
+                (size_t)ret >= PACKET_LEN_0 ? buffer[PACKET_INDEX_CMD] : 0xFF,
+                buffer, ret);
+    }
+    return ret;
+}
+
+/* read through the transport, copying the bytes to the recorder */
+static int port_readv(struct lobot_port_t* port, const struct iovec* iov, int iovcnt)
+{
+    uint8_t joined[LOBOT_RX_RING_SIZE];
+    int ret = port->transport->readv(port->ctx, iov, iovcnt);
+    size_t first;
+
+    if (port->recorder && ret > 0) {
+        first = (size_t)ret < iov[0].iov_len ? (size_t)ret : iov[0].iov_len;
+        if (iovcnt > 1 && (size_t)ret > first && (size_t)ret <= sizeof(joined)) {
+            /* a read across the ring's wrap is one chunk to replay */
+            memcpy(joined, iov[0].iov_base, first);
+            memcpy(&joined[first], iov[1].iov_base, ret - first);
+            lobot_recorder_put(port->recorder, LOBOT_RECORD_RX, 0xFF, 0xFF,
+                    joined, ret);
+        } else {
+            lobot_recorder_put(port->recorder, LOBOT_RECORD_RX, 0xFF, 0xFF,
+                    iov[0].iov_base, first);
+        }
+    }
+    return ret;
+}
+
+#ifdef LOBOT_ENABLE_STATS
+#define STAT_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+
+static struct lobot_port_counters* stats_cmd(struct lobot_port_t* port,
+        const uint8_t* frame)
+{
+    uint8_t cmd = frame[PACKET_INDEX_CMD];
+
+    return &port->stats.counters.cmd[cmd < LOBOT_STATS_CMDS ? cmd : 0];
+}
+
+static struct lobot_port_counters* stats_id(struct lobot_port_t* port,
+        const uint8_t* frame)
+{
+    return &port->stats.counters.id[frame[PACKET_INDEX_ID]];
+}
+
+/* account every frame of a write, written tells how much made it out */
+static void stats_tx(struct lobot_port_t* port, const uint8_t* buffer,
+        size_t len, int written)
+{
+    struct lobot_port_counters *cmd, *id;
+    uint64_t now = monotonic_us();
+    size_t off, flen;
+
+    for (off = 0; off + PACKET_LEN_0 <= len; off += flen) {
+        flen = buffer[off + PACKET_INDEX_LEN] + 3;
+        if (flen < PACKET_LEN_0 || off + flen > len) {
+            break;
+        }
+        cmd = stats_cmd(port, &buffer[off]);
+        id = stats_id(port, &buffer[off]);
+        if (written < 0 || off + flen > (size_t)written) {
+            STAT_ADD(cmd->short_writes, 1);
+            STAT_ADD(id->short_writes, 1);
+            continue;
+        }
+        STAT_ADD(cmd->tx_frames, 1);
+        STAT_ADD(id->tx_frames, 1);
+        STAT_ADD(cmd->tx_bytes, flen);
+        STAT_ADD(id->tx_bytes, flen);
+        __atomic_store_n(&port->stats.last_tx_us[buffer[off + PACKET_INDEX_ID]],
+                now, __ATOMIC_RELAXED);
+    }
+}
+
+static void stats_rx(struct lobot_port_t* port, const uint8_t* frame, size_t len)
+{
+    STAT_ADD(stats_cmd(port, frame)->rx_frames, 1);
+    STAT_ADD(stats_id(port, frame)->rx_frames, 1);
+    STAT_ADD(stats_cmd(port, frame)->rx_bytes, len);
+    STAT_ADD(stats_id(port, frame)->rx_bytes, len);
+}
+
+static unsigned latency_bucket(uint64_t us)
+{
+    unsigned bucket = 0;
+
+    while (us >= 2 && bucket < LOBOT_STATS_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void lobot_port_note_reply(struct lobot_port_t* port, const uint8_t* request, int ret)
+{
+    struct lobot_port_counters *cmd = stats_cmd(port, request);
+    struct lobot_port_counters *id = stats_id(port, request);
+    uint64_t sent, now;
+    unsigned bucket;
+
+    if (ret > 0) {
+        sent = __atomic_load_n(&port->stats.last_tx_us[request[PACKET_INDEX_ID]],
+                __ATOMIC_RELAXED);
+        now = monotonic_us();
+        bucket = latency_bucket(now > sent ? now - sent : 0);
+        STAT_ADD(cmd->transactions, 1);
+        STAT_ADD(id->transactions, 1);
+        STAT_ADD(cmd->latency[bucket], 1);
+        STAT_ADD(id->latency[bucket], 1);
+    } else if (ret == -ETIMEDOUT) {
+        STAT_ADD(cmd->timeouts, 1);
+        STAT_ADD(id->timeouts, 1);
+    } else if (ret == -EBADMSG) {
+        STAT_ADD(cmd->chksum_errors, 1);
+        STAT_ADD(id->chksum_errors, 1);
+    }
+}
+#define STAT_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static void stats_copy(struct lobot_port_counters* dst,
+        const struct lobot_port_counters* src)
+{
+    size_t i;
+
+    dst->tx_bytes = STAT_LOAD(src->tx_bytes);
+    dst->rx_bytes = STAT_LOAD(src->rx_bytes);
+    dst->tx_frames = STAT_LOAD(src->tx_frames);
+    dst->rx_frames = STAT_LOAD(src->rx_frames);
+    dst->transactions = STAT_LOAD(src->transactions);
+    dst->timeouts = STAT_LOAD(src->timeouts);
+    dst->chksum_errors = STAT_LOAD(src->chksum_errors);
+    dst->short_writes = STAT_LOAD(src->short_writes);
+    for (i = 0; i < LOBOT_STATS_BUCKETS; ++i) {
+        dst->latency[i] = STAT_LOAD(src->latency[i]);
+    }
+}
+#define STAT_CLEAR(field) __atomic_store_n(&(field), 0, __ATOMIC_RELAXED)
+
+static void stats_clear(struct lobot_port_counters* c)
+{
+    size_t i;
+
+    STAT_CLEAR(c->tx_bytes);
+    STAT_CLEAR(c->rx_bytes);
+    STAT_CLEAR(c->tx_frames);
+    STAT_CLEAR(c->rx_frames);
+    STAT_CLEAR(c->transactions);
+    STAT_CLEAR(c->timeouts);
+    STAT_CLEAR(c->chksum_errors);
+    STAT_CLEAR(c->short_writes);
+    for (i = 0; i < LOBOT_STATS_BUCKETS; ++i) {
+        STAT_CLEAR(c->latency[i]);
+    }
+}
+#else
+#define stats_tx(port, buffer, len, written) ((void)0)
+#define stats_rx(port, frame, len) ((void)0)
+#endif
+
+void lobot_port_options_init(struct lobot_port_options* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->baud = LOBOT_PORT_BAUD;
+    options->low_latency = 1;
+    options->exclusive = 0;
+    options->flush = 1;
+    options->timeout_us = 0;
+}
+
+struct lobot_port_t* lobot_port_open(const char* dev)
+{
+    return lobot_port_open_ex(dev, NULL);
+}
+
+struct lobot_port_t* lobot_port_open_ex(const char* dev,
+        const struct lobot_port_options* options)
+{
+    return lobot_port_open_transport(&lobot_transport_tty, dev, NULL, options);
+}
+
+struct lobot_port_t* lobot_port_open_transport(const struct lobot_transport* transport,
+        const char* dev, void* arg, const struct lobot_port_options* options)
+{
+    struct lobot_port_options defaults;
+    struct lobot_port_t* port;
+    int ret;
+
+    if (transport == NULL) {
+        return NULL;
+    }
+    if (options == NULL) {
+        lobot_port_options_init(&defaults);
+        options = &defaults;
+    }
+
+    port = calloc(1, sizeof *port);
+    if(port == NULL) {
+        return NULL;
+    }
+    arbiter_init(&port->arbiter);
+
+    port->transport = transport;
+    port->timeout_us = options->timeout_us ? options->timeout_us : LOBOT_PORT_TIMEOUT_US;
+    port->timeout_set = options->timeout_us != 0;
+    port->info.baud = options->baud ? options->baud : LOBOT_PORT_BAUD;
+    port->info.latency_timer_ms = -1;
+    ret = transport->open(&port->ctx, dev, arg, options, &port->info);
+    if (ret < 0) {
+        arbiter_destroy(&port->arbiter);
+        free(port);
+        errno = -ret;
+        return NULL;
+    }
+    /* 10 bits per byte: start, 8 data, stop */
+    port->info.byte_time_ns = 10000000000ULL / port->info.baud;
+
+    lobot_rx_reset(&port->rx);
+    if (options->calibrate) {
+        port->info.calibrate_error = lobot_port_calibrate(port, LOBOT_ID_BROADCAST, NULL);
+    }
+    return port;
+}
+
+int lobot_port_info(struct lobot_port_t* port, struct lobot_port_info* info)
+{
+    if (port == NULL) {
+        return -ENODEV;
+    }
+
+    *info = port->info;
+    return 0;
+}
+
+/* pull everything available into the receive ring with a single read
+ * @return bytes read, 0 if none or the ring is full, negative errno on failure
+ */
+static int port_fill(struct lobot_port_t* port)
+{
+    struct iovec iov[2];
+    int ret;
+    int cnt;
+
+    cnt = lobot_rx_space(&port->rx, iov);
+    if (cnt == 0) {
+        return 0;
+    }
+    ret = port_readv(port, iov, cnt);
+    if (ret > 0) {
+        lobot_rx_commit(&port->rx, ret);
+    }
+    return ret;
+}
+
+/* drop echoed frames at the head of the receive ring
+ * @return 1 if an echo is still arriving there, 0 otherwise
+ */
+static int port_strip_echo(struct lobot_port_t* port)
+{
+    uint8_t head[PACKET_LEN_MAX];
+    size_t count, flen;
+
+    for (;;) {
+        count = lobot_rx_peek(&port->rx, head, sizeof(head));
+        if (count == 0 || port->echo_len == 0) {
+            return 0;
+        }
+        if (count <= PACKET_INDEX_LEN) {
+            return echo_match(port, head, count, 1);
+        }
+        flen = (size_t)head[PACKET_INDEX_LEN] + 3;
+        if (flen > count) {
+            return flen <= PACKET_LEN_MAX && echo_match(port, head, count, 1);
+        }
+        if (!echo_match(port, head, flen, 0)) {
+            return 0;
+        }
+        lobot_rx_drain(&port->rx, head, flen);
+    }
+}
+
+static int port_read_locked(struct lobot_port_t* port, uint8_t* buffer, size_t len)
+{
+    struct iovec iov;
+    size_t buffered;
+    int ret;
+
+    /* with echo, bytes go through the ring to be checked against it */
+    if (port->calibration.echo) {
+        ret = port_fill(port);
+        if (ret < 0 && lobot_rx_count(&port->rx) == 0) {
+            return ret;
+        }
+        if (port_strip_echo(port)) {
+            return 0;
+        }
+        return lobot_rx_drain(&port->rx, buffer, len);
+    }
+
+    /* hand out bytes already pulled in by the frame decoder first */
+    buffered = lobot_rx_drain(&port->rx, buffer, len);
+    if (buffered == len) {
+        return buffered;
+    }
+
+    iov.iov_base = buffer + buffered;
+    iov.iov_len = len - buffered;
+    ret = port_readv(port, &iov, 1);
+    if (ret < 0) {
+        return buffered ? (int)buffered : ret;
+    }
+    return buffered + ret;
+}
+
+int lobot_port_read(struct lobot_port_t* port, uint8_t* buffer, size_t len)
+{
+    int ret;
+
+    if (lobot_port_acquire(port, LOBOT_PRIO_CONFIG) < 0) {
+        return -ENODEV;
+    }
+    ret = port_read_locked(port, buffer, len);
+    lobot_port_release(port);
+    return ret;
+}
+
+static int port_recv_frame_locked(struct lobot_port_t* port, uint8_t* frame, size_t size)
+{
+    int filled = 0;
+    int ret;
+
+    for (;;) {
+        ret = lobot_rx_extract(&port->rx, frame, size);
+        if (ret == 0 && !filled) {
+            /* at most one read per call */
+            ret = port_fill(port);
+            if (ret <= 0) {
+                return ret;
+            }
+            filled = 1;
+            continue;
+        }
+        if (ret > 0 && port->echo_len && echo_match(port, frame, ret, 0)) {
+            continue;
+        }
+        break;
+    }
+
+    if (ret > 0) {
+        stats_rx(port, frame, ret);
+        if (port->recorder) {
+            lobot_recorder_put(port->recorder, LOBOT_RECORD_FRAME,
+                    frame[PACKET_INDEX_ID], frame[PACKET_INDEX_CMD],
+                    &frame[PACKET_INDEX_PARAM], ret - PACKET_LEN_0);
+        }
+    }
+    return ret;
+}
+
+int lobot_port_recv_frame(struct lobot_port_t* port, uint8_t* frame, size_t size)
+{
+    int ret;
+
+    if (lobot_port_acquire(port, LOBOT_PRIO_CONFIG) < 0) {
+        return -ENODEV;
+    }
+    ret = port_recv_frame_locked(port, frame, size);
+    lobot_port_release(port);
+    return ret;
+}
+
+int lobot_port_poll(struct lobot_port_t* port, uint32_t timeout_us)
+{
+    if (port == NULL) {
+        return -ENODEV;
+    }
+    /* a partial frame or junk left in the ring waits for more bytes */
+    if (lobot_rx_frame_ready(&port->rx)) {
+        return 1;
+    }
+
+    return port->transport->poll(port->ctx, timeout_us);
+}
+
+int lobot_port_wait(struct lobot_port_t* port, uint32_t timeout_us)
+{
+    if (port == NULL) {
+        return -ENODEV;
+    }
+
+    return port->transport->poll(port->ctx, timeout_us);
+}
+
+/* wait for the reply to any of n outstanding requests, matched by ID and
+ * command, so a lost reply doesn't make the next one look stale */
+static int recv_reply(struct lobot_port_t* port, const uint8_t* const* requests,
+        const size_t* reply_lens, const size_t* n, uint8_t* reply, size_t size,
+        uint32_t timeout_us, void (*on_header)(void* ctx), void* ctx, size_t* which)
+{
+    uint64_t now, deadline;
+    int chksum_err = 0;
+    size_t k;
+    int ret;
+
+    deadline = monotonic_us() + timeout_us;
+    for (;;) {
+        ret = port_recv_frame_locked(port, reply, size);
+        if (ret == -EBADMSG) {
+            chksum_err = 1;
+            continue;
+        }
+        if (ret == -EMSGSIZE) {
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret > 0) {
+            /* skip echo and stale replies to earlier requests */
+            for (k = 0; k < *n; ++k) {
+                if ((size_t)ret == reply_lens[k] &&
+                        lobot_frame_answers(requests[k], reply, reply_lens[k])) {
+                    break;
+                }
+            }
+            if (k < *n) {
+                if (on_header) {
+                    on_header(ctx);
+                }
+                *which = k;
+                return ret;
+            }
+            continue;
+        }
+
+        if (on_header && lobot_rx_reply_started(&port->rx)) {
+            on_header(ctx);
+            on_header = NULL;
+        }
+
+        /* nothing complete, sleep until more bytes arrive or time is up */
+        if (timeout_us == 0) {
+            return chksum_err ? -EBADMSG : -EAGAIN;
+        }
+        now = monotonic_us();
+        if (now >= deadline) {
+            return chksum_err ? -EBADMSG : -ETIMEDOUT;
+        }
+        ret = port->transport->poll(port->ctx, deadline - now);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+}
+
+int lobot_port_recv_reply(struct lobot_port_t* port, const uint8_t* request,
+        uint8_t* reply, size_t reply_len, uint32_t timeout_us,
+        void (*on_header)(void* ctx), void* ctx)
+{
+    size_t one = 1, which;
+
+    return lobot_port_recv_replies(port, &request, &reply_len, &one, reply, reply_len,
+            timeout_us, on_header, ctx, &which);
+}
+
+int lobot_port_recv_replies(struct lobot_port_t* port, const uint8_t* const* requests,
+        const size_t* reply_lens, const size_t* n, uint8_t* reply, size_t size,
+        uint32_t timeout_us, void (*on_header)(void* ctx), void* ctx, size_t* which)
+{
+    size_t k;
+    int ret;
+
+    if (port == NULL) {
+        return -ENODEV;
+    }
+    if (n == NULL || *n == 0 || which == NULL) {
+        return -EINVAL;
+    }
+    for (k = 0; k < *n; ++k) {
+        if (reply_lens[k] < PACKET_LEN_0 || reply_lens[k] > size) {
+            return -EINVAL;
+        }
+    }
+    if (timeout_us == LOBOT_PORT_TIMEOUT_DEFAULT) {
+        timeout_us = port->timeout_us;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    ret = recv_reply(port, requests, reply_lens, n, reply, size, timeout_us,
+            on_header, ctx, which);
+    lobot_port_release(port);
+    lobot_port_note_reply(port, ret > 0 ? requests[*which] : requests[0], ret);
+    return ret;
+}
+
+int lobot_port_transact(struct lobot_port_t* port, const uint8_t* request,
+        size_t request_len, uint8_t* reply, size_t reply_len, uint32_t timeout_us)
+{
+    int written;
+    int ret;
+
+    if (port == NULL) {
+        return -ENODEV;
+    }
+    if (request_len < PACKET_LEN_0) {
+        return -EINVAL;
+    }
+
+    /* request and reply are one transaction on the wire */
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    written = port_write(port, request, request_len);
+    stats_tx(port, request, request_len, written);
+    if (written < 0 || (size_t)written != request_len) {
+        lobot_port_release(port);
+        return written < 0 ? written : -EIO;
+    }
+
+    ret = lobot_port_recv_reply(port, request, reply, reply_len, timeout_us,
+            NULL, NULL);
+    lobot_port_release(port);
+    return ret;
+}
+
+void lobot_port_set_timeout(struct lobot_port_t* port, uint32_t timeout_us)
+{
+    if (port && timeout_us != LOBOT_PORT_TIMEOUT_DEFAULT) {
+        port->timeout_us = timeout_us;
+        port->timeout_set = 1;
+    }
+}
+
+uint32_t lobot_port_get_timeout(struct lobot_port_t* port)
+{
+    return port ? port->timeout_us : 0;
+}
+
+/* median of n samples, sorting them */
+static uint32_t median_us(uint32_t* v, size_t n)
+{
+    size_t i, j;
+    uint32_t t;
+
+    for (i = 1; i < n; ++i) {
+        for (j = i; j > 0 && v[j - 1] > v[j]; --j) {
+            t = v[j];
+            v[j] = v[j - 1];
+            v[j - 1] = t;
+        }
+    }
+    return v[n / 2];
+}
+
+/* send a probe and time its echo and reply
+ * @return 0 on success, negative errno on failure
+ */
+static int calibrate_probe(struct lobot_port_t* port, const uint8_t* request,
+        uint64_t* echo_us, uint64_t* rtt_us)
+{
+    uint8_t frame[PACKET_LEN_MAX];
+    uint64_t start, now, deadline;
+    int ret;
+
+    *echo_us = 0;
+    *rtt_us = 0;
+    start = monotonic_us();
+    ret = port_write(port, request, PACKET_LEN_0);
+    stats_tx(port, request, PACKET_LEN_0, ret);
+    if (ret != PACKET_LEN_0) {
+        return ret < 0 ? ret : -EIO;
+    }
+
+    deadline = start + port->timeout_us;
+    while (*rtt_us == 0) {
+        ret = port_recv_frame_locked(port, frame, sizeof(frame));
+        if (ret == -EBADMSG || ret == -EMSGSIZE) {
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        now = monotonic_us();
+        if (ret == PACKET_LEN_0 && memcmp(frame, request, PACKET_LEN_0) == 0) {
+            *echo_us = now - start;
+        } else if (ret > 0 && lobot_frame_answers(request, frame, ret)) {
+            *rtt_us = now - start;
+        }
+        if (ret > 0) {
+            continue;
+        }
+        if (now >= deadline) {
+            break;
+        }
+        ret = port->transport->poll(port->ctx, deadline - now);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int lobot_port_calibrate(struct lobot_port_t* port, uint8_t id,
+        struct lobot_port_calibration* cal_out)
+{
+    struct lobot_port_calibration cal;
+    uint32_t echo_us[CALIBRATE_PROBES], rtt_us[CALIBRATE_PROBES];
+    uint8_t request[PACKET_LEN_0];
+    size_t probes, n_echo = 0, n_rtt = 0, missed = 0;
+    uint64_t echo, rtt, air_request, air_reply, timeout;
+    int echo_was;
+    int ret = 0;
+
+    if (port == NULL) {
+        return -ENODEV;
+    }
+
+    lobot_frame_build(id, LOBOT_CMD_ID_READ, NULL, 0, request);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+
+    /* look at the raw link, stale bytes and echo included */
+    memset(&cal, 0, sizeof cal);
+    echo_was = port->calibration.echo;
+    port->calibration.echo = 0;
+    port->echo_len = 0;
+    while (port_fill(port) > 0) {
+        lobot_rx_reset(&port->rx);
+    }
+    lobot_rx_reset(&port->rx);
+
+    /* two probes without reply in a row mean no servo will answer */
+    for (probes = 0; probes < CALIBRATE_PROBES && missed < 2; ++probes) {
+        ret = calibrate_probe(port, request, &echo, &rtt);
+        if (ret < 0) {
+            break;
+        }
+        if (echo) {
+            echo_us[n_echo++] = (uint32_t)echo;
+        }
+        if (rtt) {
+            rtt_us[n_rtt++] = (uint32_t)rtt;
+        }
+        missed = rtt ? 0 : missed + 1;
+    }
+    if (ret < 0) {
+        port->calibration.echo = echo_was;
+        lobot_port_release(port);
+        return ret;
+    }
+
+    air_request = (uint64_t)PACKET_LEN_0 * port->info.byte_time_ns / 1000;
+    air_reply = (uint64_t)PACKET_LEN_1 * port->info.byte_time_ns / 1000;
+    cal.echo = n_echo * 2 > probes;
+    if (cal.echo) {
+        cal.echo_us = median_us(echo_us, n_echo);
+        cal.latency_us = cal.echo_us > air_request ?
+            (uint32_t)(cal.echo_us - air_request) / 2 : 0;
+    }
+    if (n_rtt) {
+        /* past the request, or its echo whose time covers both latencies */
+        cal.rtt_us = median_us(rtt_us, n_rtt);
+        rtt = cal.echo ? cal.echo_us : air_request;
+        cal.turnaround_us = cal.rtt_us > rtt + air_reply ?
+            (uint32_t)(cal.rtt_us - rtt - air_reply) : 0;
+
+        timeout = 4 * (cal.rtt_us + (uint64_t)(PACKET_LEN_MAX - PACKET_LEN_1) *
+                port->info.byte_time_ns / 1000);
+        if (timeout < CALIBRATE_TIMEOUT_MIN_US) {
+            timeout = CALIBRATE_TIMEOUT_MIN_US;
+        }
+        if (!port->timeout_set && timeout < port->timeout_us) {
+            port->timeout_us = (uint32_t)timeout;
+        }
+    }
+
+    port->calibration = cal;
+    port->calibrated = 1;
+    port->info.rtt_us = cal.rtt_us;
+    lobot_port_release(port);
+
+    if (cal_out) {
+        *cal_out = cal;
+    }
+    return 0;
+}
+
+int lobot_port_calibration(struct lobot_port_t* port, struct lobot_port_calibration* cal)
+{
+    if (port == NULL) {
+        return -ENODEV;
+    }
+    if (cal == NULL) {
+        return -EINVAL;
+    }
+    if (!port->calibrated) {
+        return -ENODATA;
+    }
+
+    *cal = port->calibration;
+    return 0;
+}
+
+static int port_write_locked(struct lobot_port_t* port, const uint8_t* buffer, size_t len)
+{
+    int written;
+
+    written = port_write(port, buffer, len);
+    stats_tx(port, buffer, len, written);
+    return written;
+}
+
+int lobot_port_write(struct lobot_port_t* port, const uint8_t* buffer, size_t len)
+{
+    int ret;
+
+    if (lobot_port_acquire(port, LOBOT_PRIO_CONFIG) < 0) {
+        return -ENODEV;
+    }
+    ret = port_write_locked(port, buffer, len);
+    lobot_port_release(port);
+    return ret;
+}
+
+int lobot_port_fd(struct lobot_port_t* port)
+{
+    if (port == NULL) {
+        return -ENODEV;
+    }
+
+    if (port->transport->fd == NULL) {
+        return -ENOTSUP;
+    }
+    return port->transport->fd(port->ctx);
+}
+
+const char* lobot_port_peer(struct lobot_port_t* port)
+{
+    if (port == NULL || port->transport->peer == NULL) {
+        return NULL;
+    }
+    return port->transport->peer(port->ctx);
+}
+
+int lobot_port_stats(struct lobot_port_t* port, struct lobot_port_stats* stats_out)
+{
+#ifdef LOBOT_ENABLE_STATS
+    size_t i;
+
+    if (port == NULL) {
+        return -ENODEV;
+    }
+
+    for (i = 0; i < LOBOT_STATS_CMDS; ++i) {
+        stats_copy(&stats_out->cmd[i], &port->stats.counters.cmd[i]);
+    }
+    for (i = 0; i < LOBOT_STATS_IDS; ++i) {
+        stats_copy(&stats_out->id[i], &port->stats.counters.id[i]);
+    }
+    return 0;
+#else
+    (void)stats_out;
+    return port ? -ENOTSUP : -ENODEV;
+#endif
+}
+
+void lobot_port_stats_reset(struct lobot_port_t* port)
+{
+#ifdef LOBOT_ENABLE_STATS
+    size_t i;
+
+    if (port == NULL) {
+        return;
+    }
+    for (i = 0; i < LOBOT_STATS_CMDS; ++i) {
+        stats_clear(&port->stats.counters.cmd[i]);
+    }
+    for (i = 0; i < LOBOT_STATS_IDS; ++i) {
+        stats_clear(&port->stats.counters.id[i]);
+    }
+#else
+    (void)port;
+#endif
+}
+
+int lobot_port_acquire(struct lobot_port_t* port, lobot_prio_t prio)
+{
+    struct port_arbiter *arb;
+
+    if (port == NULL) {
+        return -ENODEV;
+    }
+    if ((unsigned)prio >= LOBOT_PRIO_COUNT) {
+        return -EINVAL;
+    }
+
+    arb = &port->arbiter;
+    pthread_mutex_lock(&arb->lock);
+    if (arb->busy && pthread_equal(arb->owner, pthread_self())) {
+        arb->depth++;
+        pthread_mutex_unlock(&arb->lock);
+        return 0;
+    }
+    arbiter_wait(arb, prio, 1);
+    pthread_mutex_unlock(&arb->lock);
+
+    return 0;
+}
+
+int lobot_port_try_acquire(struct lobot_port_t* port, lobot_prio_t prio)
+{
+    struct port_arbiter *arb;
+    int ret = 0;
+
+    if (port == NULL) {
+        return -ENODEV;
+    }
+    if ((unsigned)prio >= LOBOT_PRIO_COUNT) {
+        return -EINVAL;
+    }
+
+    arb = &port->arbiter;
+    pthread_mutex_lock(&arb->lock);
+    if (arb->busy && pthread_equal(arb->owner, pthread_self())) {
+        arb->depth++;
+    } else if (arb->busy || arb->waiting[prio] || arbiter_outranked(arb, prio)) {
+        ret = -EBUSY;
+    } else {
+        /* nobody of the class is queued, so the next ticket is served */
+        arb->ticket[prio]++;
+        arb->serving[prio]++;
+        arb->busy = 1;
+        arb->owner = pthread_self();
+        arb->depth = 1;
+    }
+    pthread_mutex_unlock(&arb->lock);
+
+    return ret;
+}
+
+void lobot_port_release(struct lobot_port_t* port)
+{
+    struct port_arbiter *arb;
+
+    if (port == NULL) {
+        return;
+    }
+
+    arb = &port->arbiter;
+    pthread_mutex_lock(&arb->lock);
+    if (arb->busy && --arb->depth == 0) {
+        arb->busy = 0;
+        arbiter_handover(arb);
+    }
+    pthread_mutex_unlock(&arb->lock);
+}
+
+int lobot_port_contended(struct lobot_port_t* port, lobot_prio_t prio)
+{
+    if (port == NULL || (unsigned)prio >= LOBOT_PRIO_COUNT) {
+        return 0;
+    }
+    return arbiter_outranked(&port->arbiter, prio);
+}
+
+int lobot_port_yield(struct lobot_port_t* port, lobot_prio_t prio)
+{
+    struct port_arbiter *arb;
+    unsigned depth;
+
+    if (!lobot_port_contended(port, prio)) {
+        return 0;
+    }
+
+    arb = &port->arbiter;
+    pthread_mutex_lock(&arb->lock);
+    if (!arb->busy || !pthread_equal(arb->owner, pthread_self())) {
+        pthread_mutex_unlock(&arb->lock);
+        return 0;
+    }
+    depth = arb->depth;
+    arb->busy = 0;
+    arbiter_handover(arb);
+    arbiter_wait(arb, prio, depth);
+    pthread_mutex_unlock(&arb->lock);
+
+    return 1;
+}
+
+int lobot_port_set_recorder(struct lobot_port_t* port, struct lobot_recorder_t* rec)
+{
+    if (port == NULL) {
+        return -ENODEV;
+    }
+
+    port->recorder = rec;
+    return 0;
+}
+
+struct lobot_shadow* lobot_port_shadow(struct lobot_port_t* port)
+{
+    return port->shadow;
+}
+
+void lobot_port_set_shadow(struct lobot_port_t* port, struct lobot_shadow* shadow)
+{
+    port->shadow = shadow;
+}
+
+struct lobot_health* lobot_port_health(struct lobot_port_t* port)
+{
+    return port->health;
+}
+
+void lobot_port_set_health(struct lobot_port_t* port, struct lobot_health* health)
+{
+    port->health = health;
+}
+
+void lobot_port_close(struct lobot_port_t* port)
+{
+    if(port) {
+        port->transport->close(port->ctx);
+        free(port->shadow);
+        free(port->health);
+        arbiter_destroy(&port->arbiter);
+        free(port);
+    }
+}
@@ -0,0 +1,81 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__PORT_INTERNAL_H_
+#define MOGI_LOBOT__PORT_INTERNAL_H_
+
+#include <stdint.h>
+
+#include "lobot_servo/port.h"
+
+struct lobot_shadow;
+struct lobot_health;
+
+/* shadow register cache of a port, NULL when disabled
+ * The port frees it on close.
+ */
+struct lobot_shadow* lobot_port_shadow(struct lobot_port_t* port);
+void lobot_port_set_shadow(struct lobot_port_t* port, struct lobot_shadow* shadow);
+
+/* per servo link health of a port, NULL when disabled
+ * The port frees it on close.
+ */
+struct lobot_health* lobot_port_health(struct lobot_port_t* port);
+void lobot_port_set_health(struct lobot_port_t* port, struct lobot_health* health);
+
+/* wait for more bytes from the transport, unlike lobot_port_poll not
+ * returning early for complete frames already buffered
+ * @return positive if data is available, 0 on timeout, negative errno on
+ *         failure
+ */
+int lobot_port_wait(struct lobot_port_t* port, uint32_t timeout_us);
+
+/* wait for the reply to any of several pipelined requests
+ * As lobot_port_recv_reply, but a reply is matched to whichever request it
+ * answers by ID and command, so when one reply is lost or corrupted the next
+ * one isn't skipped as stale.
+ * @param requests Request frames still waiting for their reply
+ * @param reply_lens Expected reply length of each request
+ * @param n Number of requests, read again whenever a frame arrives, as
+ *        on_header may pipeline one more
+ * @param reply Buffer to store the reply frame
+ * @param size Size of reply, at least the longest expected reply
+ * @param which Output index of the request answered
+ * @return same as lobot_port_recv_reply
+ */
+int lobot_port_recv_replies(struct lobot_port_t* port, const uint8_t* const* requests,
+        const size_t* reply_lens, const size_t* n, uint8_t* reply, size_t size,
+        uint32_t timeout_us, void (*on_header)(void* ctx), void* ctx, size_t* which);
+
+/* account the outcome of a request matched by a caller outside the port
+ * layer, as lobot_port_recv_reply does for its own
+ * @param request Request frame
+ * @param ret Reply length, or negative errno as from lobot_port_recv_reply
+ */
+#ifdef LOBOT_ENABLE_STATS
+void lobot_port_note_reply(struct lobot_port_t* port, const uint8_t* request, int ret);
+#else
+static inline void lobot_port_note_reply(struct lobot_port_t* port,
+        const uint8_t* request, int ret)
+{
+    (void)port;
+    (void)request;
+    (void)ret;
+}
+#endif
+
+#endif
@@ -0,0 +1,525 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "lobot_servo/reactor.h"
+#include "lobot_servo/port.h"
+
+#include "frame.h"
+#include "port_internal.h"
+
+#define REACTOR_MAX_EVENTS 16
+/* retry period of a port whose bus another thread holds */
+#define REACTOR_RETRY_US 1000
+
+/* a queued transaction */
+struct reactor_xfer {
+    uint8_t request[PACKET_LEN_MAX];
+    size_t request_len;
+    size_t reply_len;       /* 0 for commands without reply */
+    uint32_t timeout_us;
+    lobot_reactor_cb cb;
+    void *ctx;
+};
+
+/* per port state, only the transaction at head is in flight, and the bus is
+ * held while it waits for its reply */
+struct reactor_port {
+    struct lobot_port_t *port;
+    int fd;
+    struct reactor_xfer queue[LOBOT_REACTOR_QUEUE_LEN];
+    size_t head;            /* free running */
+    size_t tail;            /* free running */
+    int busy;
+    int chksum_err;
+    uint64_t deadline;
+    int blocked;            /* bus held elsewhere, events off until a retry */
+    int removed;            /* removed during run_once, freed when it ends */
+    struct reactor_port *next_removed;
+};
+
+struct lobot_reactor_t {
+    int epfd;
+    int timerfd;
+    struct reactor_port **ports;
+    size_t nports;
+    size_t pending;
+    int dispatching;        /* inside run_once, ports are removed at its end */
+    struct reactor_port *removed;
+};
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static struct reactor_port* find_port(struct lobot_reactor_t* reactor,
+        struct lobot_port_t* port, size_t* index)
+{
+    size_t i;
+
+    for (i = 0; i < reactor->nports; ++i) {
+        if (reactor->ports[i]->port == port) {
+            if (index) {
+                *index = i;
+            }
+            return reactor->ports[i];
+        }
+    }
+    return NULL;
+}
+
+/* retire the transaction at head of queue and notify its owner */
+static void complete(struct lobot_reactor_t* reactor, struct reactor_port* rp,
+        lobot_error_t err, const uint8_t* reply)
+{
+    struct reactor_xfer xfer = rp->queue[rp->head % LOBOT_REACTOR_QUEUE_LEN];
+
+    if (err == LOBOT_OK && xfer.reply_len > 0) {
+        lobot_port_note_reply(rp->port, xfer.request, xfer.reply_len);
+    } else if (err == LOBOT_TIMEOUT || err == LOBOT_BAD_CHKSUM) {
+        lobot_port_note_reply(rp->port, xfer.request,
+                err == LOBOT_TIMEOUT ? -ETIMEDOUT : -EBADMSG);
+    }
+
+    if (rp->busy) {
+        lobot_port_release(rp->port);
+    }
+    rp->head++;
+    rp->busy = 0;
+    rp->chksum_err = 0;
+    reactor->pending--;
+
+    if (xfer.cb) {
+        if (reply) {
+            xfer.cb(xfer.ctx, rp->port, err, &reply[PACKET_INDEX_PARAM],
+                    xfer.reply_len - PACKET_LEN_0);
+        } else {
+            xfer.cb(xfer.ctx, rp->port, err, NULL, 0);
+        }
+    }
+}
+
+/* stop watching a port whose bus another thread holds, it is retried at the
+ * next run_once instead of waking the loop for bytes that aren't its own */
+static void block(struct lobot_reactor_t* reactor, struct reactor_port* rp)
+{
+    struct epoll_event ev;
+
+    if (!rp->blocked) {
+        memset(&ev, 0, sizeof(ev));
+        ev.data.ptr = rp;
+        epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, rp->fd, &ev);
+        rp->blocked = 1;
+    }
+}
+
+static void unblock(struct lobot_reactor_t* reactor, struct reactor_port* rp)
+{
+    struct epoll_event ev;
+
+    if (rp->blocked) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = rp;
+        epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, rp->fd, &ev);
+        rp->blocked = 0;
+    }
+}
+
+/* put queued transactions of an idle port on the wire
+ * @return number of transactions completed without waiting for a reply
+ */
+static int kick(struct lobot_reactor_t* reactor, struct reactor_port* rp)
+{
+    struct reactor_xfer *xfer;
+    int done = 0;
+
+    while (!rp->removed && !rp->busy && rp->head != rp->tail) {
+        xfer = &rp->queue[rp->head % LOBOT_REACTOR_QUEUE_LEN];
+        /* request and reply are one transaction on the wire, no other
+         * thread may write in between; the loop serves other ports rather
+         * than wait for this one's bus */
+        if (lobot_port_try_acquire(rp->port, LOBOT_PRIO_CONFIG) < 0) {
+            block(reactor, rp);
+            break;
+        }
+        if (lobot_port_write(rp->port, xfer->request, xfer->request_len) !=
+                (int)xfer->request_len) {
+            lobot_port_release(rp->port);
+            complete(reactor, rp, LOBOT_BAD_WRITE, NULL);
+            done++;
+            continue;
+        }
+        if (xfer->reply_len == 0) {
+            lobot_port_release(rp->port);
+            complete(reactor, rp, LOBOT_OK, NULL);
+            done++;
+            continue;
+        }
+        rp->busy = 1;
+        rp->deadline = monotonic_us() + xfer->timeout_us;
+    }
+    return done;
+}
+
+/* consume every complete frame received on a port, unless another thread
+ * holds its bus and is reading them */
+static int drain(struct lobot_reactor_t* reactor, struct reactor_port* rp)
+{
+    uint8_t frame[PACKET_LEN_MAX];
+    struct reactor_xfer *xfer;
+    int done = 0;
+    int ret;
+
+    if (lobot_port_try_acquire(rp->port, LOBOT_PRIO_CONFIG) < 0) {
+        block(reactor, rp);
+        return 0;
+    }
+    while (!rp->removed &&
+            (ret = lobot_port_recv_frame(rp->port, frame, sizeof(frame))) != 0) {
+        if (ret == -EBADMSG) {
+            rp->chksum_err = 1;
+            continue;
+        }
+        if (ret < 0) {
+            /* -EMSGSIZE can't happen with a max sized buffer */
+            done = ret;
+            break;
+        }
+        if (!rp->busy) {
+            continue;
+        }
+        xfer = &rp->queue[rp->head % LOBOT_REACTOR_QUEUE_LEN];
+        if ((size_t)ret == xfer->reply_len &&
+                lobot_frame_answers(xfer->request, frame, ret)) {
+            complete(reactor, rp, LOBOT_OK, frame);
+            done++;
+            done += kick(reactor, rp);
+        }
+    }
+    lobot_port_release(rp->port);
+    return done;
+}
+
+/* fail transactions whose deadline passed */
+static int expire(struct lobot_reactor_t* reactor, uint64_t now)
+{
+    struct reactor_port *rp;
+    int done = 0;
+    size_t i;
+
+    for (i = 0; i < reactor->nports; ++i) {
+        rp = reactor->ports[i];
+        if (rp->busy && now >= rp->deadline) {
+            complete(reactor, rp, rp->chksum_err ? LOBOT_BAD_CHKSUM : LOBOT_TIMEOUT, NULL);
+            done++;
+            done += kick(reactor, rp);
+        }
+    }
+    return done;
+}
+
+/* arm timer for the earliest of wakeup, all reply deadlines and retries of
+ * blocked ports */
+static int arm_timer(struct lobot_reactor_t* reactor, uint64_t wakeup)
+{
+    struct itimerspec its;
+    uint64_t retry = monotonic_us() + REACTOR_RETRY_US;
+    size_t i;
+
+    for (i = 0; i < reactor->nports; ++i) {
+        if (reactor->ports[i]->busy && reactor->ports[i]->deadline < wakeup) {
+            wakeup = reactor->ports[i]->deadline;
+        }
+        if (reactor->ports[i]->blocked && retry < wakeup) {
+            wakeup = retry;
+        }
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = wakeup / 1000000;
+    its.it_value.tv_nsec = (wakeup % 1000000) * 1000;
+    /* an all zero it_value disarms the timer */
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+        its.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(reactor->timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+struct lobot_reactor_t* lobot_reactor_create(void)
+{
+    struct lobot_reactor_t* reactor;
+    struct epoll_event ev;
+
+    reactor = calloc(1, sizeof *reactor);
+    if (reactor == NULL) {
+        return NULL;
+    }
+
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    reactor->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (reactor->epfd < 0 || reactor->timerfd < 0) {
+        goto err;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->timerfd, &ev) < 0) {
+        goto err;
+    }
+
+    return reactor;
+err:
+    lobot_reactor_destroy(reactor);
+    return NULL;
+}
+
+int lobot_reactor_add_port(struct lobot_reactor_t* reactor, struct lobot_port_t* port)
+{
+    struct reactor_port **ports;
+    struct reactor_port *rp;
+    struct epoll_event ev;
+    int fd;
+
+    if (reactor == NULL) {
+        return -EINVAL;
+    }
+    fd = lobot_port_fd(port);
+    if (fd < 0) {
+        return fd;
+    }
+    if (find_port(reactor, port, NULL)) {
+        return -EEXIST;
+    }
+
+    ports = realloc(reactor->ports, (reactor->nports + 1) * sizeof(*ports));
+    if (ports == NULL) {
+        return -ENOMEM;
+    }
+    reactor->ports = ports;
+
+    rp = calloc(1, sizeof *rp);
+    if (rp == NULL) {
+        return -ENOMEM;
+    }
+    rp->port = port;
+    rp->fd = fd;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = rp;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        free(rp);
+        return -errno;
+    }
+
+    reactor->ports[reactor->nports++] = rp;
+    return 0;
+}
+
+/* stop watching a port and fail its pending transactions */
+static void port_free(struct lobot_reactor_t* reactor, struct reactor_port* rp)
+{
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rp->fd, NULL);
+    while (rp->head != rp->tail) {
+        complete(reactor, rp, LOBOT_BAD_PORT, NULL);
+    }
+    free(rp);
+}
+
+/* free ports removed by callbacks, once no event refers to them anymore */
+static void reap(struct lobot_reactor_t* reactor)
+{
+    struct reactor_port *rp;
+
+    while ((rp = reactor->removed) != NULL) {
+        reactor->removed = rp->next_removed;
+        port_free(reactor, rp);
+    }
+}
+
+int lobot_reactor_remove_port(struct lobot_reactor_t* reactor, struct lobot_port_t* port)
+{
+    struct reactor_port *rp;
+    size_t index;
+
+    if (reactor == NULL) {
+        return -EINVAL;
+    }
+    rp = find_port(reactor, port, &index);
+    if (rp == NULL) {
+        return -ENOENT;
+    }
+
+    reactor->ports[index] = reactor->ports[--reactor->nports];
+    if (reactor->dispatching) {
+        rp->removed = 1;
+        rp->next_removed = reactor->removed;
+        reactor->removed = rp;
+        return 0;
+    }
+    port_free(reactor, rp);
+    return 0;
+}
+
+int lobot_reactor_submit(struct lobot_reactor_t* reactor, struct lobot_port_t* port,
+        uint8_t id, lobot_cmd_t cmd, const uint8_t* params, size_t nparams,
+        size_t reply_nparams, uint32_t timeout_us, lobot_reactor_cb cb, void* ctx)
+{
+    struct reactor_port *rp;
+    struct reactor_xfer *xfer;
+
+    if (reactor == NULL || nparams > LOBOT_FRAME_PARAM_MAX ||
+            reply_nparams > LOBOT_FRAME_PARAM_MAX || (nparams && !params)) {
+        return -EINVAL;
+    }
+    rp = find_port(reactor, port, NULL);
+    if (rp == NULL) {
+        return -ENOENT;
+    }
+    if (rp->tail - rp->head >= LOBOT_REACTOR_QUEUE_LEN) {
+        return -EAGAIN;
+    }
+
+    xfer = &rp->queue[rp->tail % LOBOT_REACTOR_QUEUE_LEN];
+    xfer->request_len = lobot_frame_build(id, cmd, params, nparams, xfer->request);
+    xfer->reply_len = reply_nparams ? PACKET_LEN_0 + reply_nparams : 0;
+    xfer->timeout_us = timeout_us == LOBOT_PORT_TIMEOUT_DEFAULT ?
+        lobot_port_get_timeout(port) : timeout_us;
+    xfer->cb = cb;
+    xfer->ctx = ctx;
+    rp->tail++;
+    reactor->pending++;
+
+    return 0;
+}
+
+size_t lobot_reactor_pending(struct lobot_reactor_t* reactor)
+{
+    return reactor ? reactor->pending : 0;
+}
+
+int lobot_reactor_run_once(struct lobot_reactor_t* reactor, uint32_t timeout_us)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    struct reactor_port *rp;
+    uint64_t expiration;
+    int done = 0;
+    int i, n, ret;
+
+    if (reactor == NULL) {
+        return -EINVAL;
+    }
+
+    /* callbacks may remove ports, which then stay allocated until the events
+     * referring to them are dealt with */
+    reactor->dispatching = 1;
+    for (i = 0; i < (int)reactor->nports; ++i) {
+        unblock(reactor, reactor->ports[i]);
+        done += kick(reactor, reactor->ports[i]);
+    }
+
+    ret = arm_timer(reactor, monotonic_us() + timeout_us);
+    if (ret < 0) {
+        goto out;
+    }
+
+    n = epoll_wait(reactor->epfd, events, REACTOR_MAX_EVENTS, -1);
+    if (n < 0) {
+        ret = errno == EINTR ? 0 : -errno;
+        goto out;
+    }
+
+    for (i = 0; i < n; ++i) {
+        rp = events[i].data.ptr;
+        if (rp == NULL) {
+            /* clear timer expiration, deadlines are checked below */
+            if (read(reactor->timerfd, &expiration, sizeof(expiration)) < 0) {
+                expiration = 0;
+            }
+            continue;
+        }
+        if (rp->removed) {
+            continue;
+        }
+        ret = drain(reactor, rp);
+        if (ret < 0) {
+            goto out;
+        }
+        done += ret;
+    }
+
+    done += expire(reactor, monotonic_us());
+    ret = 0;
+out:
+    reactor->dispatching = 0;
+    reap(reactor);
+    return ret < 0 ? ret : done;
+}
+
+int lobot_reactor_run(struct lobot_reactor_t* reactor)
+{
+    int ret;
+
+    if (reactor == NULL) {
+        return -EINVAL;
+    }
+
+    while (reactor->pending > 0) {
+        ret = lobot_reactor_run_once(reactor, LOBOT_PORT_TIMEOUT_US);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+void lobot_reactor_destroy(struct lobot_reactor_t* reactor)
+{
+    if (reactor) {
+        while (reactor->nports > 0) {
+            lobot_reactor_remove_port(reactor, reactor->ports[0]->port);
+        }
+        if (reactor->timerfd >= 0) {
+            close(reactor->timerfd);
+        }
+        if (reactor->epfd >= 0) {
+            close(reactor->epfd);
+        }
+        free(reactor->ports);
+        free(reactor);
+    }
+}
@@ -0,0 +1,243 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lobot_servo/recorder.h"
+
+#define RECORD_MAGIC "LOBOTREC"
+#define RECORD_VERSION 1
+
+struct lobot_recorder_t {
+    struct lobot_record_header *header;
+    struct lobot_record *records;
+    size_t capacity;
+    size_t map_len;
+};
+
+struct lobot_capture_t {
+    const struct lobot_record_header *header;
+    const struct lobot_record *records;
+    uint64_t first;
+    uint64_t count;
+    size_t map_len;
+};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct lobot_recorder_t* lobot_recorder_open(const char* path, size_t capacity)
+{
+    struct lobot_recorder_t *rec;
+    void *map;
+    size_t len;
+    int fd;
+
+    if (path == NULL || capacity == 0) {
+        return NULL;
+    }
+
+    len = sizeof(struct lobot_record_header) + capacity * sizeof(struct lobot_record);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, len) < 0) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    rec = calloc(1, sizeof *rec);
+    if (rec == NULL) {
+        munmap(map, len);
+        return NULL;
+    }
+    rec->header = map;
+    rec->records = (struct lobot_record *)(rec->header + 1);
+    rec->capacity = capacity;
+    rec->map_len = len;
+
+    memcpy(rec->header->magic, RECORD_MAGIC, sizeof(rec->header->magic));
+    rec->header->version = RECORD_VERSION;
+    rec->header->record_size = sizeof(struct lobot_record);
+    rec->header->capacity = capacity;
+    rec->header->start_realtime_ns = clock_ns(CLOCK_REALTIME);
+    rec->header->start_monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+
+    return rec;
+}
+
+void lobot_recorder_put(struct lobot_recorder_t* rec, lobot_record_type_t type,
+        uint8_t id, uint8_t cmd, const void* data, size_t len)
+{
+    const uint8_t *bytes = data;
+    struct lobot_record *r;
+    uint64_t slot, now;
+    size_t n, chunk;
+
+    if (rec == NULL) {
+        return;
+    }
+
+    n = len ? (len + LOBOT_RECORD_PAYLOAD - 1) / LOBOT_RECORD_PAYLOAD : 1;
+    if (n > rec->capacity) {
+        return;
+    }
+    /* consecutive slots, so a chunk isn't interleaved with other threads */
+    slot = __atomic_fetch_add(&rec->header->head, n, __ATOMIC_RELAXED);
+    now = clock_ns(CLOCK_MONOTONIC);
+
+    for (; n > 0; --n, ++slot) {
+        r = &rec->records[slot % rec->capacity];
+        chunk = len < LOBOT_RECORD_PAYLOAD ? len : LOBOT_RECORD_PAYLOAD;
+
+        /* invalidate before overwriting, publish once complete */
+        __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        r->type = type;
+        r->flags = n > 1 ? LOBOT_RECORD_MORE : 0;
+        r->id = id;
+        r->cmd = cmd;
+        r->timestamp_ns = now;
+        r->len = chunk;
+        memcpy(r->payload, bytes, chunk);
+        __atomic_store_n(&r->seq, (uint32_t)(slot + 1), __ATOMIC_RELEASE);
+
+        bytes += chunk;
+        len -= chunk;
+    }
+}
+
+void lobot_recorder_sample(struct lobot_recorder_t* rec, uint8_t id,
+        uint8_t cmd, const void* value, size_t len)
+{
+    if (len <= LOBOT_RECORD_PAYLOAD) {
+        lobot_recorder_put(rec, LOBOT_RECORD_SAMPLE, id, cmd, value, len);
+    }
+}
+
+void lobot_recorder_close(struct lobot_recorder_t* rec)
+{
+    if (rec) {
+        munmap(rec->header, rec->map_len);
+        free(rec);
+    }
+}
+
+struct lobot_capture_t* lobot_capture_open(const char* path)
+{
+    const struct lobot_record_header *header;
+    struct lobot_capture_t *cap;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*header)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    header = map;
+    if (memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != RECORD_VERSION ||
+            header->record_size != sizeof(struct lobot_record) ||
+            sizeof(*header) + header->capacity * sizeof(struct lobot_record) >
+            (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    cap = calloc(1, sizeof *cap);
+    if (cap == NULL) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    cap->header = header;
+    cap->records = (const struct lobot_record *)(header + 1);
+    cap->map_len = st.st_size;
+    cap->count = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    if (cap->count > header->capacity) {
+        cap->first = cap->count - header->capacity;
+        cap->count = header->capacity;
+    }
+
+    return cap;
+}
+
+const struct lobot_record_header* lobot_capture_header(struct lobot_capture_t* cap)
+{
+    return cap ? cap->header : NULL;
+}
+
+size_t lobot_capture_count(struct lobot_capture_t* cap)
+{
+    return cap ? cap->count : 0;
+}
+
+const struct lobot_record* lobot_capture_get(struct lobot_capture_t* cap, size_t index)
+{
+    const struct lobot_record *r;
+    uint64_t slot;
+
+    if (cap == NULL || index >= cap->count) {
+        return NULL;
+    }
+
+    slot = cap->first + index;
+    r = &cap->records[slot % cap->header->capacity];
+    if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != (uint32_t)(slot + 1)) {
+        return NULL;
+    }
+    return r;
+}
+
+void lobot_capture_close(struct lobot_capture_t* cap)
+{
+    if (cap) {
+        munmap((void *)cap->header, cap->map_len);
+        free(cap);
+    }
+}
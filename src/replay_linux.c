@@ -0,0 +1,287 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/recorder.h"
+
+struct replay {
+    struct lobot_capture_t *cap;
+    size_t count;
+    struct lobot_replay_config config;
+    size_t tx;              /* record holding the next byte to be written */
+    size_t tx_off;
+    size_t rx;              /* record holding the next byte to be read */
+    size_t rx_off;
+    uint64_t anchor_ns;     /* when the last write was made */
+    uint64_t anchor_ts;     /* capture time of that write */
+    int failed;
+};
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    nanosleep(&ts, NULL);
+}
+
+/* index of the first record of type at or after i, count if none */
+static size_t next_of(struct replay* rp, uint8_t type, size_t i)
+{
+    const struct lobot_record *r;
+
+    for (; i < rp->count; ++i) {
+        r = lobot_capture_get(rp->cap, i);
+        if (r == NULL) {
+            return rp->count;
+        }
+        if (r->type == type) {
+            return i;
+        }
+    }
+    return rp->count;
+}
+
+/* nanoseconds until the next received chunk is due
+ * @return 0 if due, UINT64_MAX if it follows a write not made yet
+ */
+static uint64_t rx_due(struct replay* rp)
+{
+    const struct lobot_record *r;
+    uint64_t elapsed;
+
+    rp->rx = next_of(rp, LOBOT_RECORD_RX, rp->rx);
+    if (rp->rx >= rp->count || rp->rx > next_of(rp, LOBOT_RECORD_TX, rp->tx)) {
+        return UINT64_MAX;
+    }
+    if (!rp->config.realtime) {
+        return 0;
+    }
+
+    r = lobot_capture_get(rp->cap, rp->rx);
+    if (r == NULL) {
+        return UINT64_MAX;
+    }
+    elapsed = monotonic_ns() - rp->anchor_ns;
+    if (r->timestamp_ns <= rp->anchor_ts + elapsed) {
+        return 0;
+    }
+    return r->timestamp_ns - rp->anchor_ts - elapsed;
+}
+
+static int replay_diverged(struct replay* rp, const uint8_t* buffer, size_t len,
+        size_t at, int expected)
+{
+    size_t i;
+
+    fprintf(stderr, "lobot replay: write diverges from capture at byte %zu of "
+            "write, record %zu: ", at, rp->tx);
+    if (expected < 0) {
+        fprintf(stderr, "capture has no more writes");
+    } else {
+        fprintf(stderr, "expected %02x, got %02x", expected, buffer[at]);
+    }
+    fprintf(stderr, "\nlobot replay: written");
+    for (i = 0; i < len; ++i) {
+        fprintf(stderr, " %02x", buffer[i]);
+    }
+    fprintf(stderr, "\n");
+
+    if (rp->config.abort_on_divergence) {
+        abort();
+    }
+    rp->failed = 1;
+    return -EPROTO;
+}
+
+static int replay_open(void** ctx, const char* dev, void* arg,
+        const struct lobot_port_options* options, struct lobot_port_info* info)
+{
+    const struct lobot_record *r;
+    struct replay *rp;
+
+    (void)options;
+    (void)info;
+
+    rp = calloc(1, sizeof *rp);
+    if (rp == NULL) {
+        return -ENOMEM;
+    }
+    rp->cap = lobot_capture_open(dev);
+    if (rp->cap == NULL) {
+        free(rp);
+        return -ENOENT;
+    }
+    if (arg) {
+        rp->config = *(const struct lobot_replay_config *)arg;
+    }
+    rp->count = lobot_capture_count(rp->cap);
+
+    /* a wrapped ring may start in the middle of a chunk whose head was
+     * overwritten, play from the end of the oldest chunk on */
+    r = lobot_capture_get(rp->cap, 0);
+    if (r && r->seq != 1) {
+        while ((r = lobot_capture_get(rp->cap, rp->tx)) && (r->flags & LOBOT_RECORD_MORE)) {
+            rp->tx++;
+        }
+        if (rp->tx < rp->count) {
+            rp->tx++;
+        }
+    }
+    rp->rx = rp->tx;
+    rp->anchor_ns = monotonic_ns();
+    r = lobot_capture_get(rp->cap, rp->tx);
+    rp->anchor_ts = r ? r->timestamp_ns : 0;
+
+    *ctx = rp;
+    return 0;
+}
+
+static int replay_readv(void* ctx, const struct iovec* iov, int iovcnt)
+{
+    struct replay *rp = ctx;
+    const struct lobot_record *r;
+    size_t total = 0, off = 0, n;
+    int i = 0;
+
+    if (rp->failed) {
+        return -EPROTO;
+    }
+    if (rx_due(rp) != 0) {
+        return 0;
+    }
+
+    /* one recorded read at most, so partial reads play back as they came */
+    while (i < iovcnt) {
+        r = lobot_capture_get(rp->cap, rp->rx);
+        if (r == NULL) {
+            /* the rest of the chunk isn't recorded yet */
+            break;
+        }
+        n = r->len - rp->rx_off;
+        if (n > iov[i].iov_len - off) {
+            n = iov[i].iov_len - off;
+        }
+        memcpy((uint8_t *)iov[i].iov_base + off, &r->payload[rp->rx_off], n);
+        off += n;
+        total += n;
+        rp->rx_off += n;
+        if (off == iov[i].iov_len) {
+            off = 0;
+            i++;
+        }
+        if (rp->rx_off == r->len) {
+            rp->rx++;
+            rp->rx_off = 0;
+            if (!(r->flags & LOBOT_RECORD_MORE)) {
+                break;
+            }
+        }
+    }
+
+    return total;
+}
+
+static int replay_write(void* ctx, const uint8_t* buffer, size_t len)
+{
+    struct replay *rp = ctx;
+    const struct lobot_record *r = NULL;
+    size_t i;
+
+    if (rp->failed) {
+        return -EPROTO;
+    }
+
+    for (i = 0; i < len; ++i) {
+        if (rp->tx_off == 0) {
+            rp->tx = next_of(rp, LOBOT_RECORD_TX, rp->tx);
+        }
+        r = rp->tx < rp->count ? lobot_capture_get(rp->cap, rp->tx) : NULL;
+        if (r == NULL) {
+            return replay_diverged(rp, buffer, len, i, -1);
+        }
+        if (r->payload[rp->tx_off] != buffer[i]) {
+            return replay_diverged(rp, buffer, len, i, r->payload[rp->tx_off]);
+        }
+        if (++rp->tx_off == r->len) {
+            rp->tx++;
+            rp->tx_off = 0;
+        }
+    }
+
+    if (r) {
+        rp->anchor_ns = monotonic_ns();
+        rp->anchor_ts = r->timestamp_ns;
+    }
+    return len;
+}
+
+static int replay_poll(void* ctx, uint32_t timeout_us)
+{
+    struct replay *rp = ctx;
+    uint64_t due, timeout_ns = (uint64_t)timeout_us * 1000;
+
+    if (rp->failed) {
+        return -EPROTO;
+    }
+
+    due = rx_due(rp);
+    if (due == 0) {
+        return 1;
+    }
+    if (due <= timeout_ns) {
+        sleep_ns(due);
+        return 1;
+    }
+    /* only real time playback lets timeouts take their time */
+    if (rp->config.realtime) {
+        sleep_ns(timeout_ns);
+    }
+    return 0;
+}
+
+static void replay_close(void* ctx)
+{
+    struct replay *rp = ctx;
+
+    lobot_capture_close(rp->cap);
+    free(rp);
+}
+
+const struct lobot_transport lobot_transport_replay = {
+    "replay", replay_open, replay_readv, replay_write, replay_poll, NULL, NULL,
+    replay_close,
+};
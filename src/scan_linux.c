@@ -0,0 +1,210 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#include "frame.h"
+#include "port_internal.h"
+
+/* bus time left after a probe's request and reply for the servo's
+ * turnaround, so the next probe can't collide with a late reply */
+#define SCAN_GAP_US 400
+/* slack on a calibrated turnaround, which then replaces SCAN_GAP_US */
+#define SCAN_GAP_MARGIN_US 100
+
+struct scan_state {
+    struct lobot_port_t *port;
+    uint64_t sent_us[LOBOT_ID_MAX + 1];
+    uint8_t probed[LOBOT_ID_MAX + 1];
+    uint8_t found[LOBOT_ID_MAX + 1];
+    int64_t srtt_us;        /* smoothed probe round trip, 0 until measured */
+    int64_t rttvar_us;
+    size_t outstanding;     /* probes not answered yet */
+    size_t corrupt;         /* replies dropped for a bad checksum */
+};
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* take a probe round trip into the estimate, RFC 6298 style */
+static void scan_rtt_sample(struct scan_state *scan, int64_t rtt)
+{
+    int64_t err;
+
+    if (scan->srtt_us == 0) {
+        scan->srtt_us = rtt;
+        scan->rttvar_us = rtt / 2;
+        return;
+    }
+    err = rtt - scan->srtt_us;
+    scan->rttvar_us += ((err < 0 ? -err : err) - scan->rttvar_us) / 4;
+    scan->srtt_us += err / 8;
+}
+
+/* collect replies until deadline or until every probe is answered, whichever
+ * probe they answer
+ * @return 0 on success, negative errno on failure
+ */
+static int scan_collect(struct scan_state *scan, uint64_t deadline)
+{
+    uint8_t frame[PACKET_LEN_MAX];
+    uint8_t id;
+    uint64_t now;
+    int ret;
+
+    for (;;) {
+        ret = lobot_port_recv_frame(scan->port, frame, sizeof(frame));
+        if (ret == -EBADMSG) {
+            scan->corrupt++;
+            continue;
+        }
+        if (ret == -EMSGSIZE) {
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        now = monotonic_us();
+        if (ret > 0) {
+            /* replies carry the servo's ID, echoed requests have no parameter */
+            id = frame[PACKET_INDEX_ID];
+            if (ret == PACKET_LEN_1 && frame[PACKET_INDEX_CMD] == LOBOT_CMD_ID_READ &&
+                    id <= LOBOT_ID_MAX && scan->probed[id] && !scan->found[id]) {
+                scan->found[id] = 1;
+                scan->outstanding--;
+                scan_rtt_sample(scan, (int64_t)(now - scan->sent_us[id]));
+            }
+            continue;
+        }
+
+        if (now >= deadline || scan->outstanding == 0) {
+            return 0;
+        }
+        ret = lobot_port_wait(scan->port, deadline - now);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+}
+
+lobot_error_t lobot_scan(struct lobot_port_t *port, const uint8_t* ids, size_t n,
+        uint8_t* found_ids, size_t* n_found, size_t* n_corrupt)
+{
+    struct scan_state scan;
+    struct lobot_port_info info;
+    uint8_t request[PACKET_LEN_0];
+    struct lobot_port_calibration cal;
+    uint64_t slot_us, gap_us, rto_us, last_us = 0, now;
+    size_t i, count;
+    uint8_t id;
+    int ret = 0;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+    if (ids == NULL) {
+        n = LOBOT_ID_MAX + 1;
+    }
+    if (n > LOBOT_ID_MAX + 1 || !found_ids || !n_found) {
+        return LOBOT_BAD_ARG;
+    }
+    if (lobot_port_info(port, &info) < 0 || info.byte_time_ns == 0) {
+        info.byte_time_ns = 10000000000ull / LOBOT_PORT_BAUD;
+    }
+
+    gap_us = SCAN_GAP_US;
+    if (lobot_port_calibration(port, &cal) == 0 && cal.rtt_us) {
+        gap_us = cal.turnaround_us + SCAN_GAP_MARGIN_US;
+    }
+
+    /* probes go out at bus pace, one request and reply apart, so the
+     * adapter's latency is paid once for the scan rather than per probe */
+    slot_us = ((uint64_t)(PACKET_LEN_0 + PACKET_LEN_1) * info.byte_time_ns + 999) / 1000 +
+        gap_us;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.port = port;
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    for (i = 0; i < n; ++i) {
+        id = ids ? ids[i] : (uint8_t)i;
+        if (id > LOBOT_ID_MAX || scan.probed[id]) {
+            continue;
+        }
+        if (last_us) {
+            ret = scan_collect(&scan, last_us + slot_us);
+            if (ret < 0) {
+                break;
+            }
+        }
+
+        lobot_frame_build(id, LOBOT_CMD_ID_READ, NULL, 0, request);
+        now = monotonic_us();
+        if (lobot_port_write(port, request, PACKET_LEN_0) != PACKET_LEN_0) {
+            ret = -EIO;
+            break;
+        }
+        scan.probed[id] = 1;
+        scan.outstanding++;
+        scan.sent_us[id] = now;
+        last_us = now;
+    }
+
+    /* the last probes' replies may still be on their way, wait as long as
+     * the measured round trips suggest, the port's timeout until measured */
+    if (ret == 0 && last_us) {
+        rto_us = lobot_port_get_timeout(port);
+        if (scan.srtt_us && (uint64_t)(scan.srtt_us + 4 * scan.rttvar_us) < rto_us) {
+            rto_us = scan.srtt_us + 4 * scan.rttvar_us;
+        }
+        if (rto_us < 2 * slot_us) {
+            rto_us = 2 * slot_us;
+        }
+        ret = scan_collect(&scan, last_us + rto_us);
+    }
+    lobot_port_release(port);
+
+    for (i = 0, count = 0; i <= LOBOT_ID_MAX; ++i) {
+        if (scan.found[i]) {
+            found_ids[count++] = i;
+        }
+    }
+    *n_found = count;
+    if (n_corrupt) {
+        *n_corrupt = scan.corrupt;
+    }
+
+    if (ret == -EIO) {
+        return LOBOT_BAD_WRITE;
+    }
+    if (ret < 0) {
+        return LOBOT_BAD_PORT;
+    }
+    return LOBOT_OK;
+}
@@ -0,0 +1,372 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include "lobot_servo/sched.h"
+#include "lobot_servo/port.h"
+
+#include "frame.h"
+
+/* slack on a read's airtime for host and adapter scheduling jitter */
+#define SCHED_REPLY_MARGIN_US 2000
+
+struct sched_task {
+    struct lobot_sched_task task;
+    int used;
+    int pending;            /* released and waiting for the bus */
+    uint32_t airtime_us;
+    uint32_t window_us;     /* min(deadline, period), what the task's
+                               transaction must fit in */
+    uint64_t release_us;    /* next release, or release of the pending one */
+    uint64_t due_us;        /* absolute deadline of the pending transaction */
+};
+
+struct lobot_sched_t {
+    struct lobot_port_t *port;
+    struct lobot_sched_config config;
+    uint32_t byte_time_ns;
+    struct sched_task tasks[LOBOT_SCHED_TASKS_MAX];
+    struct lobot_sched_stats stats;
+};
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* density of the task set with candidate added, -1 if the set can't be
+ * scheduled within the bus share
+ * For each task, the longest transaction with a later deadline may have just
+ * taken the bus when it is released, so its blocking is added to the density.
+ */
+static float sched_density(struct lobot_sched_t *sched, const struct sched_task *candidate)
+{
+    const struct sched_task *set[LOBOT_SCHED_TASKS_MAX + 1];
+    uint32_t blocking;
+    float density = 0;
+    size_t i, j, n = 0;
+
+    for (i = 0; i < LOBOT_SCHED_TASKS_MAX; ++i) {
+        if (sched->tasks[i].used) {
+            set[n++] = &sched->tasks[i];
+        }
+    }
+    if (candidate) {
+        set[n++] = candidate;
+    }
+
+    for (i = 0; i < n; ++i) {
+        density += (float)set[i]->airtime_us / set[i]->window_us;
+    }
+    for (i = 0; i < n; ++i) {
+        blocking = 0;
+        for (j = 0; j < n; ++j) {
+            if (set[j]->window_us > set[i]->window_us && set[j]->airtime_us > blocking) {
+                blocking = set[j]->airtime_us;
+            }
+        }
+        if (density + (float)blocking / set[i]->window_us > sched->config.bus_share) {
+            return -1;
+        }
+    }
+    return density;
+}
+
+/* mark tasks whose release time has come as pending */
+static void sched_release(struct lobot_sched_t *sched, uint64_t now)
+{
+    struct sched_task *t;
+    uint64_t skipped;
+    size_t i;
+
+    for (i = 0; i < LOBOT_SCHED_TASKS_MAX; ++i) {
+        t = &sched->tasks[i];
+        if (!t->used || t->pending || t->release_us > now) {
+            continue;
+        }
+        /* a full period behind, catch up instead of running a burst */
+        if (t->task.period_us && now - t->release_us >= t->task.period_us) {
+            skipped = (now - t->release_us) / t->task.period_us;
+            t->release_us += skipped * t->task.period_us;
+            sched->stats.missed += skipped;
+        }
+        t->pending = 1;
+        t->due_us = t->release_us + (t->task.deadline_us ? t->task.deadline_us :
+                t->task.period_us);
+    }
+}
+
+/* pending task with the earliest deadline, or NULL */
+static struct sched_task* sched_pick(struct lobot_sched_t *sched)
+{
+    struct sched_task *best = NULL;
+    size_t i;
+
+    for (i = 0; i < LOBOT_SCHED_TASKS_MAX; ++i) {
+        if (sched->tasks[i].used && sched->tasks[i].pending &&
+                (best == NULL || sched->tasks[i].due_us < best->due_us)) {
+            best = &sched->tasks[i];
+        }
+    }
+    return best;
+}
+
+/* run one task's transaction and retire or re-arm it */
+static void sched_run(struct lobot_sched_t *sched, struct sched_task *t)
+{
+    struct lobot_sched_task task = t->task;
+    struct lobot_sched_result result;
+    uint8_t request[PACKET_LEN_MAX];
+    uint8_t reply[PACKET_LEN_MAX];
+    size_t len, reply_params;
+    uint64_t now;
+    uint32_t timeout;
+    int ret;
+
+    len = lobot_frame_build(task.id, task.cmd, task.params, task.nparams, request);
+    reply_params = lobot_cmd_reply_params(task.cmd);
+    if (reply_params) {
+        /* a reply later than its airtime allows is lost, and waiting past
+         * the deadline only delays the other tasks; shorter than the
+         * airtime no reply can make it at all */
+        lobot_port_acquire(sched->port, LOBOT_PRIO_FEEDBACK);
+        now = monotonic_us();
+        timeout = t->airtime_us + SCHED_REPLY_MARGIN_US;
+        if (t->due_us > now && t->due_us - now < timeout) {
+            timeout = (uint32_t)(t->due_us - now);
+        }
+        if (timeout < t->airtime_us) {
+            timeout = t->airtime_us;
+        }
+        ret = lobot_port_transact(sched->port, request, len, reply,
+                PACKET_LEN_0 + reply_params, timeout);
+        lobot_port_release(sched->port);
+    } else {
+        lobot_port_acquire(sched->port, LOBOT_PRIO_SETPOINT);
+        ret = lobot_port_write(sched->port, request, len);
+        lobot_port_release(sched->port);
+        if (ret >= 0 && (size_t)ret != len) {
+            ret = -EIO;
+        }
+    }
+
+    result.task = (int)(t - sched->tasks);
+    result.err = ret < 0 ? ret : 0;
+    result.reply = ret >= 0 && reply_params ? reply : NULL;
+    result.lateness_us = (int64_t)(monotonic_us() - t->due_us);
+
+    sched->stats.jobs++;
+    if (result.lateness_us > 0) {
+        sched->stats.missed++;
+    }
+    if (result.lateness_us > sched->stats.worst_lateness_us) {
+        sched->stats.worst_lateness_us = result.lateness_us;
+    }
+
+    /* retire before the callback, which may add tasks */
+    t->pending = 0;
+    if (task.period_us) {
+        t->release_us += task.period_us;
+    } else {
+        t->used = 0;
+        sched->stats.load = sched_density(sched, NULL);
+    }
+
+    if (task.done) {
+        task.done(task.ctx, &result);
+    }
+}
+
+struct lobot_sched_t* lobot_sched_create(struct lobot_port_t* port,
+        const struct lobot_sched_config* config)
+{
+    struct lobot_sched_t *sched;
+    struct lobot_port_calibration cal;
+    struct lobot_port_info info;
+
+    if (port == NULL) {
+        return NULL;
+    }
+
+    sched = calloc(1, sizeof *sched);
+    if (sched == NULL) {
+        return NULL;
+    }
+
+    sched->port = port;
+    if (config) {
+        sched->config = *config;
+    }
+    if (sched->config.turnaround_us == 0) {
+        sched->config.turnaround_us = 500;
+        if (lobot_port_calibration(port, &cal) == 0 && cal.rtt_us) {
+            sched->config.turnaround_us = cal.turnaround_us + 2 * cal.latency_us;
+        }
+    }
+    if (sched->config.bus_share <= 0 || sched->config.bus_share > 1) {
+        sched->config.bus_share = 0.9f;
+    }
+
+    /* 10 bits per byte on the wire */
+    if (sched->config.baud) {
+        sched->byte_time_ns = 10000000000ull / sched->config.baud;
+    } else if (lobot_port_info(port, &info) == 0 && info.byte_time_ns) {
+        sched->byte_time_ns = info.byte_time_ns;
+    } else {
+        sched->byte_time_ns = 10000000000ull / LOBOT_PORT_BAUD;
+    }
+
+    return sched;
+}
+
+uint32_t lobot_sched_airtime_us(struct lobot_sched_t* sched,
+        const struct lobot_sched_task* task)
+{
+    uint64_t ns, reply_params;
+
+    if (sched == NULL || task == NULL) {
+        return 0;
+    }
+
+    ns = (uint64_t)(PACKET_LEN_0 + task->nparams) * sched->byte_time_ns;
+    reply_params = lobot_cmd_reply_params(task->cmd);
+    if (reply_params) {
+        ns += (uint64_t)sched->config.turnaround_us * 1000;
+        ns += (PACKET_LEN_0 + reply_params) * sched->byte_time_ns;
+    }
+    return (uint32_t)((ns + 999) / 1000);
+}
+
+int lobot_sched_add(struct lobot_sched_t* sched, const struct lobot_sched_task* task)
+{
+    struct sched_task candidate;
+    float density;
+    size_t i;
+
+    if (sched == NULL || task == NULL || task->nparams > LOBOT_FRAME_PARAM_MAX) {
+        return -EINVAL;
+    }
+    if (task->period_us == 0 && task->deadline_us == 0) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < LOBOT_SCHED_TASKS_MAX; ++i) {
+        if (!sched->tasks[i].used) {
+            break;
+        }
+    }
+    if (i == LOBOT_SCHED_TASKS_MAX) {
+        return -EMFILE;
+    }
+
+    memset(&candidate, 0, sizeof candidate);
+    candidate.task = *task;
+    candidate.used = 1;
+    candidate.airtime_us = lobot_sched_airtime_us(sched, task);
+    candidate.window_us = task->period_us;
+    if (task->deadline_us && (task->period_us == 0 || task->deadline_us < task->period_us)) {
+        candidate.window_us = task->deadline_us;
+    }
+    candidate.release_us = monotonic_us() + task->offset_us;
+
+    density = sched_density(sched, &candidate);
+    if (density < 0) {
+        return -ENOSPC;
+    }
+
+    sched->tasks[i] = candidate;
+    sched->stats.load = density;
+    return (int)i;
+}
+
+int lobot_sched_remove(struct lobot_sched_t* sched, int task)
+{
+    if (sched == NULL || task < 0 || task >= LOBOT_SCHED_TASKS_MAX ||
+            !sched->tasks[task].used) {
+        return -ENOENT;
+    }
+
+    sched->tasks[task].used = 0;
+    sched->stats.load = sched_density(sched, NULL);
+    return 0;
+}
+
+int lobot_sched_run_once(struct lobot_sched_t* sched, uint32_t timeout_us)
+{
+    struct sched_task *t;
+    struct timespec ts;
+    uint64_t now, wake;
+    size_t i;
+    int ran = 0;
+
+    if (sched == NULL) {
+        return -EINVAL;
+    }
+
+    now = monotonic_us();
+    wake = now + timeout_us;
+    for (i = 0; i < LOBOT_SCHED_TASKS_MAX; ++i) {
+        t = &sched->tasks[i];
+        if (t->used && (t->pending || t->release_us < wake)) {
+            wake = t->pending ? now : t->release_us;
+        }
+    }
+    if (wake > now) {
+        ts.tv_sec = wake / 1000000;
+        ts.tv_nsec = (wake % 1000000) * 1000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    }
+
+    /* run what is released by now, earliest deadline first; releases coming
+     * due meanwhile wait for the next call, so it returns in bounded time */
+    now = monotonic_us();
+    for (;;) {
+        sched_release(sched, now);
+        t = sched_pick(sched);
+        if (t == NULL) {
+            break;
+        }
+        sched_run(sched, t);
+        ran++;
+    }
+
+    return ran;
+}
+
+void lobot_sched_stats(struct lobot_sched_t* sched, struct lobot_sched_stats* stats_out)
+{
+    if (sched == NULL || stats_out == NULL) {
+        return;
+    }
+
+    *stats_out = sched->stats;
+}
+
+void lobot_sched_destroy(struct lobot_sched_t* sched)
+{
+    free(sched);
+}
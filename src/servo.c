@@ -17,106 +17,293 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 
 #include "lobot_servo/servo.h"
 #include "lobot_servo/port.h"
 
-#define PACKET_INDEX_HEADER 0
-#define PACKET_INDEX_ID     2
-#define PACKET_INDEX_LEN    3
-#define PACKET_INDEX_CMD    4
-#define PACKET_INDEX_PARAM  5
-
-/* Total packet length */
-#define PACKET_LEN_0       6        /* zero parameter */
-#define PACKET_LEN_1       7        /* 1 uint8 parameter */
-#define PACKET_LEN_2       8        /* 1 uint16 parameter */
-#define PACKET_LEN_4       10       /* 2 uint16 parameters */
-
-typedef enum {
-    LOBOT_CMD_MOVE_TIME_WRITE      = 1,
-    LOBOT_CMD_MOVE_TIME_READ       = 2,
-    LOBOT_CMD_MOVE_TIME_WAIT_WRITE = 7,
-    LOBOT_CMD_MOVE_TIME_WAIT_READ  = 8,
-    LOBOT_CMD_MOVE_START           = 11,
-    LOBOT_CMD_MOVE_STOP            = 12,
-    LOBOT_CMD_ID_WRITE             = 13,
-    LOBOT_CMD_ID_READ              = 14,
-    LOBOT_CMD_ANGLE_OFFSET_ADJUST  = 17,
-    LOBOT_CMD_ANGLE_OFFSET_WRITE   = 18,
-    LOBOT_CMD_ANGLE_OFFSET_READ    = 19,
-    LOBOT_CMD_ANGLE_LIMIT_WRITE    = 20,
-    LOBOT_CMD_ANGLE_LIMIT_READ     = 21,
-    LOBOT_CMD_VIN_LIMIT_WRITE      = 22,
-    LOBOT_CMD_VIN_LIMIT_READ       = 23,
-    LOBOT_CMD_TEMP_MAX_LIMIT_WRITE = 24,
-    LOBOT_CMD_TEMP_MAX_LIMIT_READ  = 25,
-    LOBOT_CMD_TEMP_READ            = 26,
-    LOBOT_CMD_VIN_READ             = 27,
-    LOBOT_CMD_POS_READ             = 28,
-    LOBOT_CMD_OR_MOTOR_MODE_WRITE  = 29,
-    LOBOT_CMD_OR_MOTOR_MODE_READ   = 30,
-    LOBOT_CMD_LOAD_OR_UNLOAD_WRITE = 31,
-    LOBOT_CMD_LOAD_OR_UNLOAD_READ  = 32,
-    LOBOT_CMD_LED_CTRL_WRITE       = 33,
-    LOBOT_CMD_LED_CTRL_READ        = 34,
-    LOBOT_CMD_LED_ERROR_WRITE      = 35,
-    LOBOT_CMD_LED_ERROR_READ       = 36,
-} cmd_t;
-
-static const uint8_t LOBOT_FRAME_HEADER = 0x55;
-
-#define LOW_BYTE(a) ((uint8_t)((a) & 0xFF))
-#define HIGH_BYTE(a) ((uint8_t)(((a) >> 8) & 0xFF))
-
-static uint8_t check_sum(uint8_t *buffer)
-{
-    uint8_t checksum = 0;
-    int i;
-    for (i = PACKET_INDEX_ID; i < (PACKET_INDEX_ID + buffer[PACKET_INDEX_LEN]); ++i) {
-        checksum += buffer[i];
-    }
-    return ~(checksum & 0xFF);
-}
+#include "frame.h"
+#include "port_internal.h"
+#include "shadow.h"
+#include "health.h"
 
 static void lobot_packet_0(uint8_t id, cmd_t cmd, uint8_t *buffer)
 {
-    buffer[PACKET_INDEX_HEADER] = LOBOT_FRAME_HEADER;
-    buffer[PACKET_INDEX_HEADER+1] = LOBOT_FRAME_HEADER;
-    buffer[PACKET_INDEX_ID] = id;
-    buffer[PACKET_INDEX_LEN] = PACKET_LEN_0 - 3;
-    buffer[PACKET_INDEX_CMD] = (uint8_t)cmd;
-    buffer[PACKET_LEN_0 - 1] = check_sum(buffer);
+    lobot_frame_build(id, cmd, NULL, 0, buffer);
 }
 
 static void lobot_packet_1(uint8_t id, cmd_t cmd, uint8_t param, uint8_t *buffer)
 {
-    buffer[PACKET_INDEX_HEADER] = LOBOT_FRAME_HEADER;
-    buffer[PACKET_INDEX_HEADER+1] = LOBOT_FRAME_HEADER;
-    buffer[PACKET_INDEX_ID] = id;
-    buffer[PACKET_INDEX_LEN] = PACKET_LEN_1 - 3;
-    buffer[PACKET_INDEX_CMD] = (uint8_t)cmd;
-    buffer[PACKET_INDEX_PARAM] = param;
-    buffer[PACKET_LEN_1 - 1] = check_sum(buffer);
+    lobot_frame_build(id, cmd, &param, 1, buffer);
 }
 
 static void lobot_packet_4(uint8_t id, cmd_t cmd, uint16_t v1, uint16_t v2, uint8_t *buffer)
 {
-    buffer[PACKET_INDEX_HEADER] = LOBOT_FRAME_HEADER;
-    buffer[PACKET_INDEX_HEADER+1] = LOBOT_FRAME_HEADER;
-    buffer[PACKET_INDEX_ID] = id;
-    buffer[PACKET_INDEX_LEN] = PACKET_LEN_4 - 3;
-    buffer[PACKET_INDEX_CMD] = (uint8_t)cmd;
-    buffer[PACKET_INDEX_PARAM] = LOW_BYTE(v1);
-    buffer[PACKET_INDEX_PARAM+1] = HIGH_BYTE(v1);
-    buffer[PACKET_INDEX_PARAM+2] = LOW_BYTE(v2);
-    buffer[PACKET_INDEX_PARAM+3] = HIGH_BYTE(v2);
-    buffer[PACKET_LEN_4 - 1] = check_sum(buffer);
+    const uint8_t params[4] = {LOW_BYTE(v1), HIGH_BYTE(v1), LOW_BYTE(v2), HIGH_BYTE(v2)};
+
+    lobot_frame_build(id, cmd, params, sizeof(params), buffer);
+}
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* map negative errno returned by the port layer to lobot_error_t */
+static lobot_error_t lobot_port_error(int err)
+{
+    switch (err) {
+        case -ETIMEDOUT:
+            return LOBOT_TIMEOUT;
+        case -EAGAIN:
+            return LOBOT_NO_REPLY;
+        case -EBADMSG:
+            return LOBOT_BAD_CHKSUM;
+        case -EIO:
+            return LOBOT_BAD_WRITE;
+        default:
+            return LOBOT_BAD_PORT;
+    }
+}
+
+/* read a command's reply parameters, little endian */
+static uint16_t reply_u16(const uint8_t *reply)
+{
+    return reply[PACKET_INDEX_PARAM] | reply[PACKET_INDEX_PARAM + 1] << 8;
+}
+
+/* write a command at a bus priority, a short write is reported as
+ * LOBOT_BAD_WRITE */
+static lobot_error_t lobot_write(struct lobot_port_t *port, lobot_prio_t prio,
+        uint8_t *buffer, size_t len)
+{
+    int ret;
+
+    lobot_port_acquire(port, prio);
+    ret = lobot_port_write(port, buffer, len);
+    lobot_port_release(port);
+
+    if (ret < 0) {
+        return ret == -ENODEV ? LOBOT_BAD_PORT : LOBOT_BAD_WRITE;
+    }
+    return (size_t)ret == len ? LOBOT_OK : LOBOT_BAD_WRITE;
+}
+
+/* issue a read command at a bus priority and wait for its reply, within the
+ * port's timeout, or with link health tracking within the servo's timeout and
+ * retries */
+static lobot_error_t lobot_read(struct lobot_port_t *port, lobot_prio_t prio,
+        uint8_t id, cmd_t cmd, uint8_t *buffer, size_t len)
+{
+    uint8_t request[PACKET_LEN_0];
+    struct lobot_health *health;
+    uint32_t attempt;
+    uint64_t start, now;
+    int ret;
+
+    lobot_packet_0(id, cmd, request);
+    lobot_port_acquire(port, prio);
+    health = lobot_port_health(port);
+    for (attempt = 0; ; ++attempt) {
+        start = monotonic_us();
+        ret = lobot_port_transact(port, request, PACKET_LEN_0, buffer, len,
+                health_timeout(health, id, attempt, lobot_port_get_timeout(port)));
+        now = monotonic_us();
+        /* a retried request's reply may answer an earlier attempt, Karn's
+         * rule keeps it out of the round trip estimate */
+        health_note(health, id, ret, attempt ? -1 : (int64_t)(now - start), now);
+        if (!health_retry(health, id, ret, attempt)) {
+            break;
+        }
+        lobot_port_yield(port, prio);
+    }
+    lobot_port_release(port);
+    if (ret < 0) {
+        return lobot_port_error(ret);
+    }
+
+    return LOBOT_OK;
+}
+
+/* one read command of a sweep */
+struct sweep_item {
+    uint8_t id;
+    cmd_t cmd;
+    size_t reply_len;
+};
+
+struct sweep_state {
+    struct lobot_port_t *port;
+    const struct sweep_item *items;
+    size_t n;
+    size_t sent;        /* number of requests written or skipped so far */
+    size_t failed;      /* index of a request that failed to write, or n */
+    struct lobot_health *health;
+    uint64_t sent_us[2];    /* write time of the last requests, by index parity */
+    uint8_t request[2][PACKET_LEN_0];   /* last requests, by index parity */
+    size_t current;         /* item whose reply is awaited */
+    size_t npending;        /* requests on the wire from current on, 1 or 2 */
+    uint64_t overlap_ns;    /* how long a request written on a reply's header
+                               takes to reach the bus */
+    uint32_t byte_time_ns;  /* 0 if the port's timing is unknown, the sweep
+                               then waits for each reply before the next */
+    uint8_t early[PACKET_LEN_MAX];  /* reply to the next item, arrived while
+                                       waiting for the current one */
+    int early_len;
+    uint64_t early_us;
+};
+
+/* check whether an item's servo is down and to be skipped */
+static int sweep_skip(struct sweep_state *sweep, size_t i)
+{
+    return health_skip(sweep->health, sweep->items[i].id, monotonic_us());
+}
+
+static void sweep_send_next(struct sweep_state *sweep)
+{
+    const struct sweep_item *item;
+    uint8_t *request;
+
+    if (sweep->sent >= sweep->n) {
+        return;
+    }
+
+    item = &sweep->items[sweep->sent];
+    request = sweep->request[sweep->sent & 1];
+    lobot_packet_0(item->id, item->cmd, request);
+    sweep->sent_us[sweep->sent & 1] = monotonic_us();
+    if (lobot_port_write(sweep->port, request, PACKET_LEN_0) != PACKET_LEN_0) {
+        sweep->failed = sweep->sent;
+    } else if (sweep->sent == sweep->current + 1) {
+        /* its reply may overtake the one awaited */
+        sweep->npending = 2;
+    }
+    sweep->sent++;
+}
+
+/* reply header seen: pipeline the next request, unless it would reach the bus
+ * before the rest of the reply is off it, a more urgent transaction is
+ * waiting for the bus, which then gets it at the reply's end, or the next
+ * servo is down, which the sweep then skips */
+static void sweep_on_header(void *ctx)
+{
+    struct sweep_state *sweep = ctx;
+    size_t tail;
+
+    if (sweep->sent == 0 || sweep->sent >= sweep->n) {
+        return;
+    }
+    tail = sweep->items[sweep->sent - 1].reply_len - (PACKET_INDEX_LEN + 1);
+    if (sweep->byte_time_ns != 0 &&
+            (uint64_t)tail * sweep->byte_time_ns <= sweep->overlap_ns &&
+            !sweep_skip(sweep, sweep->sent) &&
+            !lobot_port_contended(sweep->port, LOBOT_PRIO_FEEDBACK)) {
+        sweep_send_next(sweep);
+    }
+}
+
+/* issue a series of read commands, keeping the bus busy
+ * On a port calibrated with echo, the next request is written as soon as the
+ * header of the current reply is seen when the adapter's measured latency
+ * keeps it off the bus until the reply is over, so its transmission overlaps
+ * the tail of the reply and the adapter's turnaround. Otherwise each reply is
+ * awaited before the next request. Replies are matched to items by ID and
+ * command, so a missing or corrupted reply only fails its own item.
+ * The sweep holds the bus at LOBOT_PRIO_FEEDBACK and hands it over between
+ * frames whenever a more urgent transaction is waiting. With link health
+ * tracking, replies are awaited within each servo's timeout, and items of
+ * down servos fail with LOBOT_NO_REPLY without being sent.
+ * @param done Called for every item in order, with the reply frame on success
+ */
+static void lobot_sweep(struct lobot_port_t *port, const struct sweep_item *items,
+        size_t n, void (*done)(void *ctx, size_t i, lobot_error_t err,
+            const uint8_t *reply), void *ctx)
+{
+    struct sweep_state sweep;
+    struct lobot_port_calibration cal;
+    struct lobot_port_info info;
+    const uint8_t *pending[2];
+    size_t reply_lens[2];
+    uint8_t reply[PACKET_LEN_MAX];
+    uint64_t now;
+    size_t i, which;
+    int ret;
+
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.port = port;
+    sweep.items = items;
+    sweep.n = n;
+    sweep.failed = n;
+    lobot_port_acquire(port, LOBOT_PRIO_FEEDBACK);
+    sweep.health = lobot_port_health(port);
+    /* latency both ways: the header's way in, and the request's way out */
+    if (lobot_port_calibration(port, &cal) == 0 && cal.echo &&
+            lobot_port_info(port, &info) == 0) {
+        sweep.overlap_ns = 2 * (uint64_t)cal.latency_us * 1000;
+        sweep.byte_time_ns = info.byte_time_ns;
+    }
+    for (i = 0; i < n; ++i) {
+        sweep.current = i;
+        sweep.npending = sweep.sent > i + 1 && sweep.failed != i + 1 ? 2 : 1;
+        if (sweep.sent == i) {
+            if (sweep_skip(&sweep, i)) {
+                sweep.sent++;
+                done(ctx, i, LOBOT_NO_REPLY, NULL);
+                continue;
+            }
+            lobot_port_yield(port, LOBOT_PRIO_FEEDBACK);
+            sweep_send_next(&sweep);
+        }
+        if (sweep.failed == i) {
+            done(ctx, i, LOBOT_BAD_WRITE, NULL);
+            continue;
+        }
+        if (sweep.early_len > 0) {
+            health_note(sweep.health, items[i].id, sweep.early_len,
+                    (int64_t)(sweep.early_us - sweep.sent_us[i & 1]), sweep.early_us);
+            sweep.early_len = 0;
+            done(ctx, i, LOBOT_OK, sweep.early);
+            continue;
+        }
+
+        /* the next request may be on the wire already or go out on the
+         * header, its reply overtaking a lost one is kept for it */
+        pending[0] = sweep.request[i & 1];
+        pending[1] = sweep.request[(i + 1) & 1];
+        reply_lens[0] = items[i].reply_len;
+        reply_lens[1] = i + 1 < n ? items[i + 1].reply_len : items[i].reply_len;
+        ret = lobot_port_recv_replies(port, pending, reply_lens, &sweep.npending,
+                reply, sizeof(reply),
+                health_timeout(sweep.health, items[i].id, 0, lobot_port_get_timeout(port)),
+                sweep_on_header, &sweep, &which);
+        now = monotonic_us();
+        if (ret > 0 && which == 1) {
+            memcpy(sweep.early, reply, ret);
+            sweep.early_len = ret;
+            sweep.early_us = now;
+            ret = -EAGAIN;
+        }
+        health_note(sweep.health, items[i].id, ret, (int64_t)(now - sweep.sent_us[i & 1]), now);
+        if (ret < 0) {
+            done(ctx, i, lobot_port_error(ret), NULL);
+        } else {
+            done(ctx, i, LOBOT_OK, reply);
+        }
+    }
+    lobot_port_release(port);
 }
 
 lobot_error_t lobot_set_id(struct lobot_port_t *port, uint8_t id, uint8_t new_id)
 {
     uint8_t buffer[PACKET_LEN_1];
+    struct lobot_shadow *shadow;
+    struct shadow_entry *from, *to;
+    lobot_error_t ret;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
@@ -124,35 +311,70 @@ lobot_error_t lobot_set_id(struct lobot_port_t *port, uint8_t id, uint8_t new_id
 
     lobot_packet_1(id, LOBOT_CMD_ID_WRITE, new_id, buffer);
 
-    lobot_port_write(port, buffer, PACKET_LEN_1);
-
-    return LOBOT_OK;
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    ret = lobot_write(port, LOBOT_PRIO_CONFIG, buffer, PACKET_LEN_1);
+    shadow = lobot_port_shadow(port);
+    from = shadow_entry(shadow, id);
+    to = shadow_entry(shadow, new_id);
+    /* registers move along with the servo */
+    if (ret == LOBOT_OK && from && to && from != to) {
+        *to = *from;
+        to->valid |= SHADOW_ID;
+        from->valid = 0;
+    } else if (shadow && from != to) {
+        lobot_shadow_invalidate(port, id);
+        lobot_shadow_invalidate(port, new_id);
+    }
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_get_id(struct lobot_port_t *port, uint8_t id, uint8_t* id_out)
 {
     uint8_t buffer[PACKET_LEN_1];
+    lobot_error_t ret;
+
+    struct lobot_shadow *shadow;
+    struct shadow_entry *e;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
     }
 
-    lobot_packet_0(id, LOBOT_CMD_ID_READ, buffer);
-    lobot_port_write(port, buffer, PACKET_LEN_0);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    e = shadow_entry(shadow, id);
+    if (shadow) {
+        shadow->stats.reads++;
+        if (e && (e->valid & SHADOW_ID)) {
+            shadow->stats.read_hits++;
+            *id_out = id;
+            ret = LOBOT_OK;
+            goto out;
+        }
+    }
 
-    lobot_port_read(port, buffer, PACKET_LEN_1);
-    if(check_sum(buffer) != buffer[PACKET_INDEX_ID + buffer[PACKET_INDEX_LEN]]){
-        return LOBOT_BAD_CHKSUM;
+    ret = lobot_read(port, LOBOT_PRIO_CONFIG, id, LOBOT_CMD_ID_READ, buffer, PACKET_LEN_1);
+    if (ret != LOBOT_OK) {
+        goto out;
     }
 
     *id_out = buffer[PACKET_INDEX_PARAM];
+    e = shadow_entry(shadow, *id_out);
+    if (e) {
+        e->valid |= SHADOW_ID;
+    }
 
-    return LOBOT_OK;
+out:
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_set_pos(struct lobot_port_t *port, uint8_t id, uint16_t position, uint16_t time)
 {
     uint8_t buffer[PACKET_LEN_4];
+    struct lobot_shadow *shadow;
+    lobot_error_t ret;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
@@ -164,37 +386,184 @@ lobot_error_t lobot_set_pos(struct lobot_port_t *port, uint8_t id, uint16_t posi
         time = LOBOT_MOVETIME_MS_MAX;
     }
 
+    lobot_port_acquire(port, LOBOT_PRIO_SETPOINT);
+    shadow = lobot_port_shadow(port);
+    if (shadow_move_elide(shadow, id, position, time)) {
+        lobot_port_release(port);
+        return LOBOT_OK;
+    }
+
     lobot_packet_4(id, LOBOT_CMD_MOVE_TIME_WRITE, position, time, buffer);
 
-    lobot_port_write(port, buffer, PACKET_LEN_4);
+    ret = lobot_write(port, LOBOT_PRIO_SETPOINT, buffer, PACKET_LEN_4);
+    if (ret == LOBOT_OK) {
+        shadow_move_ack(shadow, id, position, time);
+    } else {
+        shadow_drop(shadow, id, SHADOW_MOVE);
+    }
+    lobot_port_release(port);
+    return ret;
+}
 
-    return LOBOT_OK;
+lobot_error_t lobot_set_pos_multi(struct lobot_port_t *port, const uint8_t* ids,
+        const uint16_t* positions, const uint16_t* times, size_t n)
+{
+    struct lobot_frame_desc frames[LOBOT_ID_MAX + 2];
+    uint8_t buffer[(LOBOT_ID_MAX + 1) * PACKET_LEN_4 + PACKET_LEN_0];
+    struct lobot_frame_desc *f;
+    struct lobot_shadow *shadow;
+    uint16_t position, time;
+    lobot_error_t ret;
+    size_t i, count = 0;
+    int len;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+    if (n == 0 || n > LOBOT_ID_MAX + 1 || !ids || !positions || !times) {
+        return LOBOT_BAD_ARG;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_SETPOINT);
+    shadow = lobot_port_shadow(port);
+    for (i = 0; i < n; ++i) {
+        position = positions[i];
+        time = times[i];
+        if(position > LOBOT_ANGLE_RAW_MAX) {
+            position = LOBOT_ANGLE_RAW_MAX;
+        }
+        if(time > LOBOT_MOVETIME_MS_MAX) {
+            time = LOBOT_MOVETIME_MS_MAX;
+        }
+        /* joints already heading there keep going without a new move */
+        if (shadow_move_elide(shadow, ids[i], position, time)) {
+            continue;
+        }
+        f = &frames[count++];
+        f->id = ids[i];
+        f->cmd = LOBOT_CMD_MOVE_TIME_WAIT_WRITE;
+        f->nparams = 4;
+        f->params[0] = LOW_BYTE(position);
+        f->params[1] = HIGH_BYTE(position);
+        f->params[2] = LOW_BYTE(time);
+        f->params[3] = HIGH_BYTE(time);
+    }
+    if (count == 0) {
+        lobot_port_release(port);
+        return LOBOT_OK;
+    }
+    /* servos hold staged moves until MOVE_START, so all joints start together */
+    f = &frames[count];
+    f->id = LOBOT_ID_BROADCAST;
+    f->cmd = LOBOT_CMD_MOVE_START;
+    f->nparams = 0;
+
+    len = lobot_frames_encode(frames, count + 1, buffer, sizeof(buffer));
+    ret = lobot_write(port, LOBOT_PRIO_SETPOINT, buffer, len);
+    for (i = 0; shadow && i < count; ++i) {
+        f = &frames[i];
+        if (ret == LOBOT_OK) {
+            shadow_move_ack(shadow, f->id, f->params[0] | f->params[1] << 8,
+                    f->params[2] | f->params[3] << 8);
+        } else {
+            shadow_drop(shadow, f->id, SHADOW_MOVE);
+        }
+    }
+    lobot_port_release(port);
+    return ret;
+}
+
+lobot_error_t lobot_stop(struct lobot_port_t *port, uint8_t id)
+{
+    uint8_t buffer[PACKET_LEN_0];
+    struct lobot_shadow *shadow;
+    lobot_error_t ret;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    lobot_packet_0(id, LOBOT_CMD_MOVE_STOP, buffer);
+
+    lobot_port_acquire(port, LOBOT_PRIO_ESTOP);
+    ret = lobot_write(port, LOBOT_PRIO_ESTOP, buffer, PACKET_LEN_0);
+    /* the servos hold wherever they stopped, not at the last setpoint */
+    shadow = lobot_port_shadow(port);
+    shadow_drop(shadow, id, SHADOW_MOVE);
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_get_pos(struct lobot_port_t *port, uint8_t id, uint16_t* pos_out)
 {
     uint8_t buffer[PACKET_LEN_2];
+    lobot_error_t ret;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
     }
 
-    lobot_packet_0(id, LOBOT_CMD_POS_READ, buffer);
-    lobot_port_write(port, buffer, PACKET_LEN_0);
-
-    lobot_port_read(port, buffer, PACKET_LEN_2);
-    if(check_sum(buffer) != buffer[PACKET_INDEX_ID + buffer[PACKET_INDEX_LEN]]){
-        return LOBOT_BAD_CHKSUM;
+    ret = lobot_read(port, LOBOT_PRIO_FEEDBACK, id, LOBOT_CMD_POS_READ, buffer, PACKET_LEN_2);
+    if (ret != LOBOT_OK) {
+        return ret;
     }
 
-    *pos_out = *((uint16_t*)(&buffer[PACKET_INDEX_PARAM]));
+    *pos_out = reply_u16(buffer);
 
     return LOBOT_OK;
 }
 
+struct read_positions_ctx {
+    uint16_t *out;
+    lobot_error_t *status;
+    lobot_error_t ret;
+};
+
+static void read_positions_done(void *ctx, size_t i, lobot_error_t err,
+        const uint8_t *reply)
+{
+    struct read_positions_ctx *rp = ctx;
+
+    if (err == LOBOT_OK) {
+        rp->out[i] = reply_u16(reply);
+    } else if (rp->ret == LOBOT_OK) {
+        rp->ret = err;
+    }
+    if (rp->status) {
+        rp->status[i] = err;
+    }
+}
+
+lobot_error_t lobot_read_positions(struct lobot_port_t *port, const uint8_t* ids,
+        size_t n, uint16_t* pos_out, lobot_error_t* status)
+{
+    struct sweep_item items[LOBOT_ID_MAX + 1];
+    struct read_positions_ctx ctx = {pos_out, status, LOBOT_OK};
+    size_t i;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+    if (n > LOBOT_ID_MAX + 1 || (n && (!ids || !pos_out))) {
+        return LOBOT_BAD_ARG;
+    }
+
+    for (i = 0; i < n; ++i) {
+        items[i].id = ids[i];
+        items[i].cmd = LOBOT_CMD_POS_READ;
+        items[i].reply_len = PACKET_LEN_2;
+    }
+    lobot_sweep(port, items, n, read_positions_done, &ctx);
+
+    return ctx.ret;
+}
+
 lobot_error_t lobot_set_offset(struct lobot_port_t *port, uint8_t id, int8_t offset)
 {
     uint8_t buffer[PACKET_LEN_1];
+    struct lobot_shadow *shadow;
+    struct shadow_entry *e;
+    lobot_error_t ret;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
@@ -207,39 +576,82 @@ lobot_error_t lobot_set_offset(struct lobot_port_t *port, uint8_t id, int8_t off
         offset = 125;
     }
 
-    lobot_packet_1(id, LOBOT_CMD_ANGLE_OFFSET_ADJUST, offset, buffer);
-    lobot_port_write(port, buffer, PACKET_LEN_1);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    e = shadow_entry(shadow, id);
+    if (shadow) {
+        shadow->stats.writes++;
+        if (e && (e->valid & SHADOW_OFFSET) && e->offset == offset) {
+            shadow->stats.writes_elided++;
+            lobot_port_release(port);
+            return LOBOT_OK;
+        }
+    }
 
-    lobot_packet_0(id, LOBOT_CMD_ANGLE_OFFSET_WRITE, buffer);
-    lobot_port_write(port, buffer, PACKET_LEN_0);
+    lobot_packet_1(id, LOBOT_CMD_ANGLE_OFFSET_ADJUST, offset, buffer);
+    ret = lobot_write(port, LOBOT_PRIO_CONFIG, buffer, PACKET_LEN_1);
+    if (ret == LOBOT_OK) {
+        lobot_packet_0(id, LOBOT_CMD_ANGLE_OFFSET_WRITE, buffer);
+        ret = lobot_write(port, LOBOT_PRIO_CONFIG, buffer, PACKET_LEN_0);
+    }
 
-    return LOBOT_OK;
+    if (ret == LOBOT_OK && e) {
+        e->valid |= SHADOW_OFFSET;
+        e->offset = offset;
+    } else {
+        shadow_drop(shadow, id, SHADOW_OFFSET);
+    }
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_get_offset(struct lobot_port_t *port, uint8_t id, int8_t* offset_out)
 {
     uint8_t buffer[PACKET_LEN_1];
+    lobot_error_t ret;
+
+    struct lobot_shadow *shadow;
+    struct shadow_entry *e;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
     }
 
-    lobot_packet_0(id, LOBOT_CMD_ANGLE_OFFSET_READ, buffer);
-    lobot_port_write(port, buffer, PACKET_LEN_0);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    e = shadow_entry(shadow, id);
+    if (shadow) {
+        shadow->stats.reads++;
+        if (e && (e->valid & SHADOW_OFFSET)) {
+            shadow->stats.read_hits++;
+            *offset_out = e->offset;
+            ret = LOBOT_OK;
+            goto out;
+        }
+    }
 
-    lobot_port_read(port, buffer, PACKET_LEN_1);
-    if(check_sum(buffer) != buffer[PACKET_INDEX_ID + buffer[PACKET_INDEX_LEN]]){
-        return LOBOT_BAD_CHKSUM;
+    ret = lobot_read(port, LOBOT_PRIO_CONFIG, id, LOBOT_CMD_ANGLE_OFFSET_READ, buffer, PACKET_LEN_1);
+    if (ret != LOBOT_OK) {
+        goto out;
     }
 
     *offset_out = buffer[PACKET_INDEX_PARAM];
+    if (e) {
+        e->valid |= SHADOW_OFFSET;
+        e->offset = *offset_out;
+    }
 
-    return LOBOT_OK;
+out:
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_set_limit(struct lobot_port_t *port, uint8_t id, uint16_t min, uint16_t max)
 {
     uint8_t buffer[PACKET_LEN_4];
+    struct lobot_shadow *shadow;
+    struct shadow_entry *e;
+    lobot_error_t ret;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
@@ -251,38 +663,81 @@ lobot_error_t lobot_set_limit(struct lobot_port_t *port, uint8_t id, uint16_t mi
         max = LOBOT_ANGLE_RAW_MAX;
     }
 
-    lobot_packet_4(id, LOBOT_CMD_ANGLE_LIMIT_WRITE, min, max, buffer);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    e = shadow_entry(shadow, id);
+    if (shadow) {
+        shadow->stats.writes++;
+        if (e && (e->valid & SHADOW_LIMIT) && e->limit_min == min &&
+                e->limit_max == max) {
+            shadow->stats.writes_elided++;
+            lobot_port_release(port);
+            return LOBOT_OK;
+        }
+    }
 
-    lobot_port_write(port, buffer, PACKET_LEN_4);
+    lobot_packet_4(id, LOBOT_CMD_ANGLE_LIMIT_WRITE, min, max, buffer);
 
-    return LOBOT_OK;
+    ret = lobot_write(port, LOBOT_PRIO_CONFIG, buffer, PACKET_LEN_4);
+    if (ret == LOBOT_OK && e) {
+        e->valid |= SHADOW_LIMIT;
+        e->limit_min = min;
+        e->limit_max = max;
+    } else {
+        shadow_drop(shadow, id, SHADOW_LIMIT);
+    }
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_get_limit(struct lobot_port_t *port, uint8_t id, uint16_t* min_out, uint16_t* max_out)
 {
     uint8_t buffer[PACKET_LEN_4];
+    lobot_error_t ret;
+
+    struct lobot_shadow *shadow;
+    struct shadow_entry *e;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
     }
 
-    lobot_packet_0(id, LOBOT_CMD_ANGLE_LIMIT_READ, buffer);
-    lobot_port_write(port, buffer, PACKET_LEN_0);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    e = shadow_entry(shadow, id);
+    if (shadow) {
+        shadow->stats.reads++;
+        if (e && (e->valid & SHADOW_LIMIT)) {
+            shadow->stats.read_hits++;
+            *min_out = e->limit_min;
+            *max_out = e->limit_max;
+            ret = LOBOT_OK;
+            goto out;
+        }
+    }
 
-    lobot_port_read(port, buffer, PACKET_LEN_4);
-    if(check_sum(buffer) != buffer[PACKET_INDEX_ID + buffer[PACKET_INDEX_LEN]]){
-        return LOBOT_BAD_CHKSUM;
+    ret = lobot_read(port, LOBOT_PRIO_CONFIG, id, LOBOT_CMD_ANGLE_LIMIT_READ, buffer, PACKET_LEN_4);
+    if (ret != LOBOT_OK) {
+        goto out;
     }
 
-    *min_out = *((uint16_t*)(&buffer[PACKET_INDEX_PARAM]));
-    *max_out = *((uint16_t*)(&buffer[PACKET_INDEX_PARAM+2]));
+    *min_out = reply_u16(buffer);
+    *max_out = reply_u16(buffer + 2);
+    if (e) {
+        e->valid |= SHADOW_LIMIT;
+        e->limit_min = *min_out;
+        e->limit_max = *max_out;
+    }
 
-    return LOBOT_OK;
+out:
+    lobot_port_release(port);
+    return ret;
 }
 
 lobot_error_t lobot_set_load(struct lobot_port_t *port, uint8_t id, uint8_t enable_load)
 {
     uint8_t buffer[PACKET_LEN_1];
+    lobot_error_t ret;
 
     if (port == NULL) {
         return LOBOT_BAD_PORT;
@@ -294,7 +749,187 @@ lobot_error_t lobot_set_load(struct lobot_port_t *port, uint8_t id, uint8_t enab
 
     lobot_packet_1(id, LOBOT_CMD_LOAD_OR_UNLOAD_WRITE, enable_load, buffer);
 
-    lobot_port_write(port, buffer, PACKET_LEN_1);
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    ret = lobot_write(port, LOBOT_PRIO_CONFIG, buffer, PACKET_LEN_1);
+    /* unloading drops the held position, loading holds wherever the servo
+     * was moved to by hand */
+    shadow_drop(lobot_port_shadow(port), id, SHADOW_MOVE);
+    lobot_port_release(port);
+    return ret;
+}
+
+lobot_error_t lobot_get_load(struct lobot_port_t *port, uint8_t id, uint8_t* load_out)
+{
+    uint8_t buffer[PACKET_LEN_1];
+    lobot_error_t ret;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    ret = lobot_read(port, LOBOT_PRIO_CONFIG, id, LOBOT_CMD_LOAD_OR_UNLOAD_READ, buffer, PACKET_LEN_1);
+    if (ret != LOBOT_OK) {
+        return ret;
+    }
+
+    *load_out = buffer[PACKET_INDEX_PARAM];
 
     return LOBOT_OK;
 }
+
+lobot_error_t lobot_get_vin(struct lobot_port_t *port, uint8_t id, uint16_t* vin_out)
+{
+    uint8_t buffer[PACKET_LEN_2];
+    lobot_error_t ret;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    ret = lobot_read(port, LOBOT_PRIO_FEEDBACK, id, LOBOT_CMD_VIN_READ, buffer, PACKET_LEN_2);
+    if (ret != LOBOT_OK) {
+        return ret;
+    }
+
+    *vin_out = reply_u16(buffer);
+
+    return LOBOT_OK;
+}
+
+lobot_error_t lobot_get_temp(struct lobot_port_t *port, uint8_t id, uint8_t* temp_out)
+{
+    uint8_t buffer[PACKET_LEN_1];
+    lobot_error_t ret;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    ret = lobot_read(port, LOBOT_PRIO_FEEDBACK, id, LOBOT_CMD_TEMP_READ, buffer, PACKET_LEN_1);
+    if (ret != LOBOT_OK) {
+        return ret;
+    }
+
+    *temp_out = buffer[PACKET_INDEX_PARAM];
+
+    return LOBOT_OK;
+}
+
+lobot_error_t lobot_get_led_error(struct lobot_port_t *port, uint8_t id, uint8_t* flags_out)
+{
+    uint8_t buffer[PACKET_LEN_1];
+    lobot_error_t ret;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    ret = lobot_read(port, LOBOT_PRIO_FEEDBACK, id, LOBOT_CMD_LED_ERROR_READ, buffer, PACKET_LEN_1);
+    if (ret != LOBOT_OK) {
+        return ret;
+    }
+
+    *flags_out = buffer[PACKET_INDEX_PARAM];
+
+    return LOBOT_OK;
+}
+
+/* read command and reply length of every lobot_read_state field */
+static const struct state_field {
+    unsigned mask;
+    cmd_t cmd;
+    size_t reply_len;
+} state_fields[] = {
+    {LOBOT_STATE_POS      , LOBOT_CMD_POS_READ           , PACKET_LEN_2},
+    {LOBOT_STATE_VIN      , LOBOT_CMD_VIN_READ           , PACKET_LEN_2},
+    {LOBOT_STATE_TEMP     , LOBOT_CMD_TEMP_READ          , PACKET_LEN_1},
+    {LOBOT_STATE_LOAD     , LOBOT_CMD_LOAD_OR_UNLOAD_READ, PACKET_LEN_1},
+    {LOBOT_STATE_LED_ERROR, LOBOT_CMD_LED_ERROR_READ     , PACKET_LEN_1},
+};
+
+#define STATE_FIELDS (sizeof(state_fields) / sizeof(state_fields[0]))
+
+struct read_state_ctx {
+    const struct sweep_item *items;
+    size_t n;
+    struct lobot_state_soa *state;
+    lobot_error_t ret;
+};
+
+static void read_state_done(void *ctx, size_t i, lobot_error_t err,
+        const uint8_t *reply)
+{
+    struct read_state_ctx *rs = ctx;
+    struct lobot_state_soa *state = rs->state;
+    size_t servo = i % rs->n;
+
+    if (err != LOBOT_OK) {
+        if (rs->ret == LOBOT_OK) {
+            rs->ret = err;
+        }
+        if (state->status && state->status[servo] == LOBOT_OK) {
+            state->status[servo] = err;
+        }
+        return;
+    }
+
+    switch (rs->items[i].cmd) {
+        case LOBOT_CMD_POS_READ:
+            state->position[servo] = reply_u16(reply);
+            break;
+        case LOBOT_CMD_VIN_READ:
+            state->vin_mv[servo] = reply_u16(reply);
+            break;
+        case LOBOT_CMD_TEMP_READ:
+            state->temp_c[servo] = reply[PACKET_INDEX_PARAM];
+            break;
+        case LOBOT_CMD_LOAD_OR_UNLOAD_READ:
+            state->loaded[servo] = reply[PACKET_INDEX_PARAM];
+            break;
+        case LOBOT_CMD_LED_ERROR_READ:
+            state->led_error[servo] = reply[PACKET_INDEX_PARAM];
+            break;
+        default:
+            break;
+    }
+}
+
+lobot_error_t lobot_read_state(struct lobot_port_t *port, const uint8_t* ids,
+        size_t n, unsigned fields_mask, struct lobot_state_soa* state)
+{
+    struct sweep_item items[STATE_FIELDS * (LOBOT_ID_MAX + 1)];
+    struct read_state_ctx ctx = {items, n, state, LOBOT_OK};
+    size_t f, i, count = 0;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+    if (n > LOBOT_ID_MAX + 1 || !state || (n && !ids) ||
+            ((fields_mask & LOBOT_STATE_POS) && !state->position) ||
+            ((fields_mask & LOBOT_STATE_VIN) && !state->vin_mv) ||
+            ((fields_mask & LOBOT_STATE_TEMP) && !state->temp_c) ||
+            ((fields_mask & LOBOT_STATE_LOAD) && !state->loaded) ||
+            ((fields_mask & LOBOT_STATE_LED_ERROR) && !state->led_error)) {
+        return LOBOT_BAD_ARG;
+    }
+
+    /* field by field, so item i belongs to servo i % n */
+    for (f = 0; f < STATE_FIELDS; ++f) {
+        if (!(fields_mask & state_fields[f].mask)) {
+            continue;
+        }
+        for (i = 0; i < n; ++i, ++count) {
+            items[count].id = ids[i];
+            items[count].cmd = state_fields[f].cmd;
+            items[count].reply_len = state_fields[f].reply_len;
+        }
+    }
+    if (state->status) {
+        for (i = 0; i < n; ++i) {
+            state->status[i] = LOBOT_OK;
+        }
+    }
+    lobot_sweep(port, items, count, read_state_done, &ctx);
+
+    return ctx.ret;
+}
@@ -0,0 +1,104 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#include "port_internal.h"
+#include "shadow.h"
+
+lobot_error_t lobot_shadow_enable(struct lobot_port_t *port, uint16_t pos_deadband)
+{
+    struct lobot_shadow *shadow;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    if (shadow == NULL) {
+        shadow = calloc(1, sizeof *shadow);
+        if (shadow == NULL) {
+            lobot_port_release(port);
+            return LOBOT_NO_MEMORY;
+        }
+        lobot_port_set_shadow(port, shadow);
+    }
+    shadow->deadband = pos_deadband;
+    lobot_port_release(port);
+
+    return LOBOT_OK;
+}
+
+void lobot_shadow_disable(struct lobot_port_t *port)
+{
+    if (port) {
+        /* not under a transaction of another thread */
+        lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+        free(lobot_port_shadow(port));
+        lobot_port_set_shadow(port, NULL);
+        lobot_port_release(port);
+    }
+}
+
+void lobot_shadow_invalidate(struct lobot_port_t *port, uint8_t id)
+{
+    struct lobot_shadow *shadow;
+    struct shadow_entry *e;
+
+    if (port == NULL) {
+        return;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    e = shadow_entry(shadow, id);
+    if (e) {
+        e->valid = 0;
+    } else if (shadow && id == LOBOT_ID_BROADCAST) {
+        memset(shadow->entry, 0, sizeof(shadow->entry));
+    }
+    lobot_port_release(port);
+}
+
+lobot_error_t lobot_shadow_stats(struct lobot_port_t *port,
+        struct lobot_shadow_stats* stats_out)
+{
+    struct lobot_shadow *shadow;
+    lobot_error_t ret = LOBOT_OK;
+
+    if (port == NULL) {
+        return LOBOT_BAD_PORT;
+    }
+
+    lobot_port_acquire(port, LOBOT_PRIO_CONFIG);
+    shadow = lobot_port_shadow(port);
+    if (shadow == NULL || stats_out == NULL) {
+        ret = LOBOT_BAD_ARG;
+    } else {
+        *stats_out = shadow->stats;
+    }
+    lobot_port_release(port);
+
+    return ret;
+}
@@ -0,0 +1,115 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#ifndef MOGI_LOBOT__SHADOW_H_
+#define MOGI_LOBOT__SHADOW_H_
+
+#include <stdint.h>
+
+#include "lobot_servo/servo.h"
+
+/* registers a shadow entry holds */
+#define SHADOW_MOVE   (1 << 0)
+#define SHADOW_OFFSET (1 << 1)
+#define SHADOW_LIMIT  (1 << 2)
+#define SHADOW_ID     (1 << 3)
+
+/* last acknowledged register values of a servo */
+struct shadow_entry {
+    uint8_t valid;          /* SHADOW_* of registers held */
+    uint16_t position;
+    uint16_t time;
+    int8_t offset;
+    uint16_t limit_min;
+    uint16_t limit_max;
+};
+
+struct lobot_shadow {
+    uint16_t deadband;
+    struct lobot_shadow_stats stats;
+    struct shadow_entry entry[LOBOT_ID_MAX + 1];
+};
+
+/* shadow entry of a servo, NULL if the cache is off or id is broadcast */
+static inline struct shadow_entry* shadow_entry(struct lobot_shadow* shadow, uint8_t id)
+{
+    if (shadow == NULL || id > LOBOT_ID_MAX) {
+        return NULL;
+    }
+    return &shadow->entry[id];
+}
+
+/* forget a register of every servo, after a broadcast write */
+static inline void shadow_forget(struct lobot_shadow* shadow, uint8_t reg)
+{
+    int id;
+
+    if (shadow) {
+        for (id = 0; id <= LOBOT_ID_MAX; ++id) {
+            shadow->entry[id].valid &= ~reg;
+        }
+    }
+}
+
+/* forget a register of a servo, of every servo for broadcast */
+static inline void shadow_drop(struct lobot_shadow* shadow, uint8_t id, uint8_t reg)
+{
+    struct shadow_entry *e = shadow_entry(shadow, id);
+
+    if (e) {
+        e->valid &= ~reg;
+    } else {
+        shadow_forget(shadow, reg);
+    }
+}
+
+/* check whether a move repeats the acknowledged one, counting the write
+ * @return 1 if the move can be elided
+ */
+static inline int shadow_move_elide(struct lobot_shadow* shadow, uint8_t id,
+        uint16_t position, uint16_t time)
+{
+    struct shadow_entry *e = shadow_entry(shadow, id);
+
+    if (shadow == NULL) {
+        return 0;
+    }
+    shadow->stats.writes++;
+    if (e && (e->valid & SHADOW_MOVE) && e->time == time &&
+            (e->position > position ? e->position - position :
+             position - e->position) <= shadow->deadband) {
+        shadow->stats.writes_elided++;
+        return 1;
+    }
+    return 0;
+}
+
+static inline void shadow_move_ack(struct lobot_shadow* shadow, uint8_t id,
+        uint16_t position, uint16_t time)
+{
+    struct shadow_entry *e = shadow_entry(shadow, id);
+
+    if (e) {
+        e->valid |= SHADOW_MOVE;
+        e->position = position;
+        e->time = time;
+    } else {
+        shadow_forget(shadow, SHADOW_MOVE);
+    }
+}
+
+#endif
@@ -0,0 +1,697 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "lobot_servo/sim.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#include "frame.h"
+
+/* frames that can be waiting for their turn on the bus */
+#define SIM_TX_QUEUE_LEN 64
+/* requests taken off the port ahead of their airtime, more wait in the port */
+#define SIM_RX_QUEUE_LEN 16
+
+#define PARAM_U16(frame, i) ((uint16_t)((frame)[PACKET_INDEX_PARAM + (i)] | \
+            ((frame)[PACKET_INDEX_PARAM + (i) + 1] << 8)))
+
+struct sim_servo {
+    uint8_t id;
+    float move_from;
+    uint16_t target;
+    uint16_t time_ms;
+    uint64_t move_start_us;
+    int staged;
+    uint16_t staged_target;
+    uint16_t staged_time_ms;
+    int8_t offset;
+    uint16_t limit_min;
+    uint16_t limit_max;
+    uint16_t vin_min_mv;
+    uint16_t vin_max_mv;
+    uint8_t temp_max_c;
+    uint8_t motor_mode;
+    uint16_t motor_speed;
+    uint8_t loaded;
+    uint8_t led_off;
+    uint8_t led_error;
+};
+
+/* a frame on the bus, its bytes go out one byte time apart from start_us */
+struct sim_tx {
+    uint64_t start_us;
+    uint8_t data[PACKET_LEN_MAX];
+    size_t len;
+    size_t sent;
+    int reply;
+};
+
+/* a request on the bus, acted upon once its last byte is through at end_us */
+struct sim_rx {
+    uint64_t start_us;
+    uint64_t end_us;
+    uint8_t data[PACKET_LEN_MAX];
+    uint8_t echo[PACKET_LEN_MAX];   /* the request as the bus carried it */
+    size_t len;
+    int on_wire;
+    int collided;
+};
+
+struct lobot_sim_t {
+    struct lobot_port_t *port;
+    struct lobot_sim_config config;
+    uint32_t byte_time_ns;
+    uint32_t rand_state;
+
+    pthread_mutex_t lock;
+    struct sim_servo servos[LOBOT_SIM_SERVOS_MAX];
+    size_t nservos;
+    struct lobot_sim_stats stats;
+
+    struct sim_tx tx[SIM_TX_QUEUE_LEN];
+    size_t ntx;
+    struct sim_rx rx[SIM_RX_QUEUE_LEN];
+    size_t nrx;
+    uint64_t line_free_us;  /* the host's requests go out one after another */
+
+    pthread_t thread;
+    int running;
+    int started;
+};
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* xorshift, good enough to inject faults reproducibly */
+static float sim_random(struct lobot_sim_t *sim)
+{
+    uint32_t x = sim->rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rand_state = x;
+    return (x >> 8) / 16777216.0f;
+}
+
+static uint64_t airtime_us(struct lobot_sim_t *sim, size_t len)
+{
+    return (uint64_t)len * sim->byte_time_ns / 1000;
+}
+
+/* time the k-th byte of a frame has fully gone out */
+static uint64_t byte_due_us(struct lobot_sim_t *sim, const struct sim_tx *tx, size_t k)
+{
+    return tx->start_us + (uint64_t)(k + 1) * sim->byte_time_ns / 1000;
+}
+
+/* a collision keeps the dominant bits of both frames from the first byte
+ * still to go out */
+static void collide(struct sim_tx *tx, const uint8_t *other, size_t len)
+{
+    size_t k;
+
+    for (k = tx->sent; k < tx->len; ++k) {
+        tx->data[k] &= other[(k - tx->sent) % len];
+    }
+}
+
+static uint16_t servo_position(const struct sim_servo *servo, uint64_t now)
+{
+    float frac;
+
+    if (servo->time_ms == 0 || now >= servo->move_start_us + servo->time_ms * 1000ULL) {
+        return servo->target;
+    }
+    frac = (float)(now - servo->move_start_us) / (servo->time_ms * 1000.0f);
+    return (uint16_t)(servo->move_from + (servo->target - servo->move_from) * frac + 0.5f);
+}
+
+static void servo_move(struct sim_servo *servo, uint16_t target, uint16_t time_ms,
+        uint64_t now)
+{
+    if (target < servo->limit_min) {
+        target = servo->limit_min;
+    }
+    if (target > servo->limit_max) {
+        target = servo->limit_max;
+    }
+    servo->move_from = servo_position(servo, now);
+    servo->target = target;
+    servo->time_ms = time_ms;
+    servo->move_start_us = now;
+    servo->loaded = 1;
+}
+
+static void servo_init(struct sim_servo *servo, uint8_t id)
+{
+    memset(servo, 0, sizeof(*servo));
+    servo->id = id;
+    servo->target = (LOBOT_ANGLE_RAW_MIN + LOBOT_ANGLE_RAW_MAX) / 2;
+    servo->move_from = servo->target;
+    servo->limit_min = LOBOT_ANGLE_RAW_MIN;
+    servo->limit_max = LOBOT_ANGLE_RAW_MAX;
+    servo->vin_min_mv = 4500;
+    servo->vin_max_mv = 12000;
+    servo->temp_max_c = 85;
+}
+
+/* queue a frame to go on the bus from start_us, keeping the queue sorted
+ * @return queued frame, NULL if the queue is full
+ */
+static struct sim_tx* schedule(struct lobot_sim_t *sim, const uint8_t *data,
+        size_t len, uint64_t start_us, int reply)
+{
+    size_t i;
+
+    if (sim->ntx >= SIM_TX_QUEUE_LEN) {
+        sim->stats.overflows++;
+        return NULL;
+    }
+    for (i = sim->ntx; i > 0 && sim->tx[i - 1].start_us > start_us; --i) {
+        sim->tx[i] = sim->tx[i - 1];
+    }
+    sim->tx[i].start_us = start_us;
+    memcpy(sim->tx[i].data, data, len);
+    sim->tx[i].len = len;
+    sim->tx[i].sent = 0;
+    sim->tx[i].reply = reply;
+    sim->ntx++;
+    return &sim->tx[i];
+}
+
+/* apply a command to a servo
+ * @param reply Reply parameters, if the command is a read
+ * @return number of reply parameters
+ */
+static size_t execute(struct sim_servo *servo, const uint8_t *frame,
+        uint64_t now, uint8_t *reply)
+{
+    const uint8_t *param = &frame[PACKET_INDEX_PARAM];
+    size_t nparams = frame[PACKET_INDEX_LEN] - 3;
+    int32_t pos;
+    uint16_t v;
+
+#define NEED(n) if (nparams < (n)) return 0
+#define REPLY_U16(i, val) do { v = (val); reply[i] = LOW_BYTE(v); reply[(i) + 1] = HIGH_BYTE(v); } while (0)
+
+    switch (frame[PACKET_INDEX_CMD]) {
+        case LOBOT_CMD_MOVE_TIME_WRITE:
+            NEED(4);
+            servo_move(servo, PARAM_U16(frame, 0), PARAM_U16(frame, 2), now);
+            return 0;
+        case LOBOT_CMD_MOVE_TIME_READ:
+            REPLY_U16(0, servo->target);
+            REPLY_U16(2, servo->time_ms);
+            return 4;
+        case LOBOT_CMD_MOVE_TIME_WAIT_WRITE:
+            NEED(4);
+            servo->staged = 1;
+            servo->staged_target = PARAM_U16(frame, 0);
+            servo->staged_time_ms = PARAM_U16(frame, 2);
+            return 0;
+        case LOBOT_CMD_MOVE_TIME_WAIT_READ:
+            REPLY_U16(0, servo->staged_target);
+            REPLY_U16(2, servo->staged_time_ms);
+            return 4;
+        case LOBOT_CMD_MOVE_START:
+            if (servo->staged) {
+                servo_move(servo, servo->staged_target, servo->staged_time_ms, now);
+                servo->staged = 0;
+            }
+            return 0;
+        case LOBOT_CMD_MOVE_STOP:
+            servo_move(servo, servo_position(servo, now), 0, now);
+            return 0;
+        case LOBOT_CMD_ID_WRITE:
+            NEED(1);
+            if (param[0] <= LOBOT_ID_MAX) {
+                servo->id = param[0];
+            }
+            return 0;
+        case LOBOT_CMD_ID_READ:
+            reply[0] = servo->id;
+            return 1;
+        case LOBOT_CMD_ANGLE_OFFSET_ADJUST:
+            NEED(1);
+            servo->offset = (int8_t)param[0];
+            return 0;
+        case LOBOT_CMD_ANGLE_OFFSET_WRITE:
+            /* offset is kept across power cycles, nothing to model */
+            return 0;
+        case LOBOT_CMD_ANGLE_OFFSET_READ:
+            reply[0] = (uint8_t)servo->offset;
+            return 1;
+        case LOBOT_CMD_ANGLE_LIMIT_WRITE:
+            NEED(4);
+            servo->limit_min = PARAM_U16(frame, 0);
+            servo->limit_max = PARAM_U16(frame, 2);
+            return 0;
+        case LOBOT_CMD_ANGLE_LIMIT_READ:
+            REPLY_U16(0, servo->limit_min);
+            REPLY_U16(2, servo->limit_max);
+            return 4;
+        case LOBOT_CMD_VIN_LIMIT_WRITE:
+            NEED(4);
+            servo->vin_min_mv = PARAM_U16(frame, 0);
+            servo->vin_max_mv = PARAM_U16(frame, 2);
+            return 0;
+        case LOBOT_CMD_VIN_LIMIT_READ:
+            REPLY_U16(0, servo->vin_min_mv);
+            REPLY_U16(2, servo->vin_max_mv);
+            return 4;
+        case LOBOT_CMD_TEMP_MAX_LIMIT_WRITE:
+            NEED(1);
+            servo->temp_max_c = param[0];
+            return 0;
+        case LOBOT_CMD_TEMP_MAX_LIMIT_READ:
+            reply[0] = servo->temp_max_c;
+            return 1;
+        case LOBOT_CMD_TEMP_READ:
+            /* a loaded motor runs warmer */
+            reply[0] = servo->loaded ? 38 : 30;
+            return 1;
+        case LOBOT_CMD_VIN_READ:
+            REPLY_U16(0, servo->loaded ? 7300 : 7400);
+            return 2;
+        case LOBOT_CMD_POS_READ:
+            pos = (int32_t)servo_position(servo, now) + servo->offset;
+            REPLY_U16(0, pos < 0 ? 0 : pos > UINT16_MAX ? UINT16_MAX : (uint16_t)pos);
+            return 2;
+        case LOBOT_CMD_OR_MOTOR_MODE_WRITE:
+            NEED(4);
+            servo->motor_mode = param[0];
+            servo->motor_speed = PARAM_U16(frame, 2);
+            return 0;
+        case LOBOT_CMD_OR_MOTOR_MODE_READ:
+            reply[0] = servo->motor_mode;
+            reply[1] = 0;
+            REPLY_U16(2, servo->motor_speed);
+            return 4;
+        case LOBOT_CMD_LOAD_OR_UNLOAD_WRITE:
+            NEED(1);
+            servo->loaded = param[0] != 0;
+            return 0;
+        case LOBOT_CMD_LOAD_OR_UNLOAD_READ:
+            reply[0] = servo->loaded;
+            return 1;
+        case LOBOT_CMD_LED_CTRL_WRITE:
+            NEED(1);
+            servo->led_off = param[0] != 0;
+            return 0;
+        case LOBOT_CMD_LED_CTRL_READ:
+            reply[0] = servo->led_off;
+            return 1;
+        case LOBOT_CMD_LED_ERROR_WRITE:
+            NEED(1);
+            servo->led_error = param[0];
+            return 0;
+        case LOBOT_CMD_LED_ERROR_READ:
+            reply[0] = servo->led_error;
+            return 1;
+        default:
+            return 0;
+    }
+#undef NEED
+#undef REPLY_U16
+}
+
+/* put a request read from the port on the bus after the ones before it */
+static void receive(struct lobot_sim_t *sim, const uint8_t *frame, size_t len,
+        uint64_t now)
+{
+    struct sim_rx *rx = &sim->rx[sim->nrx++];
+
+    rx->start_us = now > sim->line_free_us ? now : sim->line_free_us;
+    rx->end_us = rx->start_us + airtime_us(sim, len);
+    memcpy(rx->data, frame, len);
+    memcpy(rx->echo, frame, len);
+    rx->len = len;
+    rx->on_wire = 0;
+    rx->collided = 0;
+    sim->line_free_us = rx->end_us;
+}
+
+/* a request and a reply overlapping on the wire garble each other, no servo
+ * acts on the request */
+static void collide_request(struct lobot_sim_t *sim, struct sim_rx *rx,
+        struct sim_tx *tx)
+{
+    size_t k;
+
+    for (k = 0; k < rx->len; ++k) {
+        rx->echo[k] &= tx->data[k % tx->len];
+    }
+    collide(tx, rx->data, rx->len);
+    rx->collided = 1;
+    sim->stats.collisions++;
+}
+
+/* a request's first byte is going out, check it against replies on the wire;
+ * replies scheduled later check the request themselves */
+static void start_request(struct lobot_sim_t *sim, struct sim_rx *rx)
+{
+    struct sim_tx *tx;
+    size_t i;
+
+    for (i = 0; i < sim->ntx; ++i) {
+        tx = &sim->tx[i];
+        if (tx->reply && tx->start_us < rx->end_us &&
+                byte_due_us(sim, tx, tx->len - 1) > rx->start_us) {
+            collide_request(sim, rx, tx);
+        }
+    }
+    rx->on_wire = 1;
+}
+
+/* act on a request whose last byte is through */
+static void handle(struct lobot_sim_t *sim, struct sim_rx *rx)
+{
+    uint8_t params[LOBOT_FRAME_PARAM_MAX];
+    uint8_t reply[PACKET_LEN_MAX];
+    uint8_t bus[PACKET_LEN_MAX];
+    const uint8_t *frame = rx->data;
+    uint8_t id = frame[PACKET_INDEX_ID];
+    uint64_t now = rx->end_us, start, end;
+    size_t i, k, nparams, reply_len = 0;
+    int repliers = 0;
+    struct sim_rx *next;
+    struct sim_tx *tx;
+
+    sim->stats.requests++;
+    if (sim->config.echo) {
+        schedule(sim, rx->echo, rx->len, rx->start_us, 0);
+    }
+    if (rx->collided) {
+        return;
+    }
+
+    for (i = 0; i < sim->nservos; ++i) {
+        if (id != LOBOT_ID_BROADCAST && sim->servos[i].id != id) {
+            continue;
+        }
+        nparams = execute(&sim->servos[i], frame, now, params);
+        if (nparams == 0) {
+            continue;
+        }
+        reply_len = lobot_frame_build(sim->servos[i].id, frame[PACKET_INDEX_CMD],
+                params, nparams, reply);
+        /* replies on the same tick collide, the bus keeps dominant bits */
+        for (k = 0; k < reply_len; ++k) {
+            bus[k] = repliers ? (bus[k] & reply[k]) : reply[k];
+        }
+        repliers++;
+    }
+    if (repliers == 0) {
+        return;
+    }
+    if (repliers > 1) {
+        sim->stats.collisions++;
+    }
+
+    if (sim_random(sim) < sim->config.drop_rate) {
+        sim->stats.dropped++;
+        return;
+    }
+    if (sim_random(sim) < sim->config.corrupt_rate) {
+        k = (size_t)(sim_random(sim) * reply_len) % reply_len;
+        bus[k] ^= 1u << ((size_t)(sim_random(sim) * 8) % 8);
+        sim->stats.corrupted++;
+    }
+
+    /* an earlier reply still on the wire collides with this one */
+    start = now + sim->config.reply_delay_us;
+    end = start + airtime_us(sim, reply_len);
+    for (i = 0; i < sim->ntx; ++i) {
+        tx = &sim->tx[i];
+        if (tx->reply && tx->start_us < end && byte_due_us(sim, tx, tx->len - 1) > start) {
+            memcpy(reply, tx->data, tx->len);
+            collide(tx, bus, reply_len);
+            for (k = 0; k < reply_len; ++k) {
+                bus[k] &= reply[k % tx->len];
+            }
+            sim->stats.collisions++;
+        }
+    }
+    tx = schedule(sim, bus, reply_len, start, 1);
+    if (tx == NULL) {
+        return;
+    }
+    sim->stats.replies++;
+
+    /* so does a request already going out behind this one */
+    for (next = rx + 1; next < &sim->rx[sim->nrx]; ++next) {
+        if (next->on_wire && next->start_us < end && next->end_us > start) {
+            collide_request(sim, next, tx);
+        }
+    }
+}
+
+struct lobot_sim_t* lobot_sim_create(struct lobot_port_t* port,
+        const struct lobot_sim_config* config)
+{
+    struct lobot_port_info info;
+    struct lobot_sim_t *sim;
+    size_t i;
+
+    if (port == NULL || config == NULL || config->n > LOBOT_SIM_SERVOS_MAX ||
+            (config->n && !config->ids) || lobot_port_info(port, &info) < 0) {
+        return NULL;
+    }
+
+    sim = calloc(1, sizeof *sim);
+    if (sim == NULL) {
+        return NULL;
+    }
+
+    sim->port = port;
+    sim->config = *config;
+    sim->config.ids = NULL;
+    if (sim->config.baud == 0) {
+        sim->config.baud = info.baud;
+    }
+    sim->byte_time_ns = 10000000000ULL / sim->config.baud;
+    sim->rand_state = config->seed ? config->seed : 0x2545F491;
+    pthread_mutex_init(&sim->lock, NULL);
+
+    sim->nservos = config->n;
+    for (i = 0; i < config->n; ++i) {
+        servo_init(&sim->servos[i], config->ids[i]);
+    }
+
+    return sim;
+}
+
+/* put the bytes that are due on the bus and drop the frames that are done */
+static void transmit(struct lobot_sim_t *sim, uint64_t now)
+{
+    struct sim_tx *tx;
+    size_t i, j, n;
+
+    for (i = 0, j = 0; i < sim->ntx; ++i) {
+        tx = &sim->tx[i];
+        for (n = tx->sent; n < tx->len && byte_due_us(sim, tx, n) <= now; ++n) {
+        }
+        if (n > tx->sent) {
+            lobot_port_write(sim->port, &tx->data[tx->sent], n - tx->sent);
+            tx->sent = n;
+        }
+        if (tx->sent < tx->len) {
+            if (j != i) {
+                sim->tx[j] = *tx;
+            }
+            j++;
+        }
+    }
+    sim->ntx = j;
+}
+
+int lobot_sim_run_once(struct lobot_sim_t* sim, uint32_t timeout_us)
+{
+    uint8_t frame[PACKET_LEN_MAX];
+    uint64_t now, wait, due;
+    struct timespec ts;
+    size_t i, j;
+    int full, ret = 0;
+
+    if (sim == NULL) {
+        return -EINVAL;
+    }
+
+    now = monotonic_us();
+    wait = timeout_us;
+    pthread_mutex_lock(&sim->lock);
+    for (i = 0; i < sim->ntx + sim->nrx; ++i) {
+        due = i < sim->ntx ? byte_due_us(sim, &sim->tx[i], sim->tx[i].sent) :
+            sim->rx[i - sim->ntx].on_wire ? sim->rx[i - sim->ntx].end_us :
+            sim->rx[i - sim->ntx].start_us;
+        due = due > now ? due - now : 0;
+        if (due < wait) {
+            wait = due;
+        }
+    }
+    full = sim->nrx == SIM_RX_QUEUE_LEN;
+    pthread_mutex_unlock(&sim->lock);
+    if (wait > 0 && full) {
+        /* requests left in the port hold the host back like a busy line */
+        ts.tv_sec = wait / 1000000;
+        ts.tv_nsec = (wait % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    } else if (wait > 0) {
+        ret = lobot_port_poll(sim->port, wait);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    /* take requests in before sending, a byte due now may still collide */
+    now = monotonic_us();
+    pthread_mutex_lock(&sim->lock);
+    while (sim->nrx < SIM_RX_QUEUE_LEN &&
+            (ret = lobot_port_recv_frame(sim->port, frame, sizeof(frame))) != 0) {
+        if (ret > 0) {
+            receive(sim, frame, ret, now);
+        } else if (ret != -EBADMSG && ret != -EMSGSIZE) {
+            break;
+        }
+    }
+    for (i = 0; i < sim->nrx && sim->rx[i].start_us <= now; ++i) {
+        if (!sim->rx[i].on_wire) {
+            start_request(sim, &sim->rx[i]);
+        }
+    }
+    for (i = 0; i < sim->nrx && sim->rx[i].end_us <= now; ++i) {
+        handle(sim, &sim->rx[i]);
+    }
+    for (j = 0; i < sim->nrx; ++i, ++j) {
+        sim->rx[j] = sim->rx[i];
+    }
+    sim->nrx = j;
+    transmit(sim, now);
+    pthread_mutex_unlock(&sim->lock);
+
+    return ret < 0 && ret != -EBADMSG && ret != -EMSGSIZE ? ret : 0;
+}
+
+static void* sim_thread(void *arg)
+{
+    struct lobot_sim_t *sim = arg;
+
+    while (__atomic_load_n(&sim->running, __ATOMIC_ACQUIRE)) {
+        if (lobot_sim_run_once(sim, 10000) < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int lobot_sim_start(struct lobot_sim_t* sim)
+{
+    int ret;
+
+    if (sim == NULL) {
+        return -EINVAL;
+    }
+    if (sim->started) {
+        return -EBUSY;
+    }
+
+    __atomic_store_n(&sim->running, 1, __ATOMIC_RELEASE);
+    ret = pthread_create(&sim->thread, NULL, sim_thread, sim);
+    if (ret != 0) {
+        __atomic_store_n(&sim->running, 0, __ATOMIC_RELEASE);
+        return -ret;
+    }
+    sim->started = 1;
+    return 0;
+}
+
+void lobot_sim_stop(struct lobot_sim_t* sim)
+{
+    if (sim && sim->started) {
+        __atomic_store_n(&sim->running, 0, __ATOMIC_RELEASE);
+        pthread_join(sim->thread, NULL);
+        sim->started = 0;
+    }
+}
+
+int lobot_sim_servo(struct lobot_sim_t* sim, uint8_t id,
+        struct lobot_sim_servo* servo_out)
+{
+    struct sim_servo *servo;
+    uint64_t now = monotonic_us();
+    size_t i;
+
+    if (sim == NULL || servo_out == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&sim->lock);
+    for (i = 0; i < sim->nservos; ++i) {
+        servo = &sim->servos[i];
+        if (servo->id != id) {
+            continue;
+        }
+        servo_out->id = servo->id;
+        servo_out->position = servo_position(servo, now);
+        servo_out->target = servo->target;
+        servo_out->time_ms = servo->time_ms;
+        servo_out->offset = servo->offset;
+        servo_out->limit_min = servo->limit_min;
+        servo_out->limit_max = servo->limit_max;
+        servo_out->vin_mv = servo->loaded ? 7300 : 7400;
+        servo_out->temp_c = servo->loaded ? 38 : 30;
+        servo_out->loaded = servo->loaded;
+        servo_out->led_error = servo->led_error;
+        pthread_mutex_unlock(&sim->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return -ENOENT;
+}
+
+void lobot_sim_stats(struct lobot_sim_t* sim, struct lobot_sim_stats* stats_out)
+{
+    if (sim && stats_out) {
+        pthread_mutex_lock(&sim->lock);
+        *stats_out = sim->stats;
+        pthread_mutex_unlock(&sim->lock);
+    }
+}
+
+void lobot_sim_destroy(struct lobot_sim_t* sim)
+{
+    if (sim) {
+        lobot_sim_stop(sim);
+        pthread_mutex_destroy(&sim->lock);
+        free(sim);
+    }
+}
@@ -0,0 +1,392 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <math.h>
+
+#include "lobot_servo/trajectory.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/port.h"
+
+#include "frame.h"
+
+/* points checked between a move's ends against the curve */
+#define FIT_SAMPLES 8
+
+struct traj_joint {
+    uint8_t id;
+    lobot_interp_t interp;
+    struct lobot_waypoint wps[LOBOT_TRAJ_WAYPOINTS_MAX];
+    size_t head;            /* free running */
+    size_t tail;            /* free running */
+    int active;             /* a move is in progress */
+    uint32_t seg_end;       /* end time of the move in progress */
+    struct lobot_trajectory_status status;
+};
+
+struct lobot_trajectory_t {
+    struct lobot_port_t *port;
+    struct lobot_trajectory_config config;
+    float frames_per_ms;    /* bus budget for moves */
+    float tokens;
+    uint32_t last_ms;
+    int started;
+    struct traj_joint joints[LOBOT_TRAJ_JOINTS_MAX];
+    size_t njoints;
+};
+
+static struct traj_joint* find_joint(struct lobot_trajectory_t* traj, uint8_t id)
+{
+    size_t i;
+
+    for (i = 0; i < traj->njoints; ++i) {
+        if (traj->joints[i].id == id) {
+            return &traj->joints[i];
+        }
+    }
+    return NULL;
+}
+
+static const struct lobot_waypoint* waypoint(const struct traj_joint *joint, size_t i)
+{
+    return &joint->wps[(joint->head + i) % LOBOT_TRAJ_WAYPOINTS_MAX];
+}
+
+/* position of the segment between a and b at time t */
+static float interpolate(lobot_interp_t interp, const struct lobot_waypoint *a,
+        const struct lobot_waypoint *b, float t_ms)
+{
+    float T = (b->t_ms - a->t_ms) / 1000.0f;
+    float s = (t_ms - a->t_ms) / 1000.0f;
+    float dp = b->position - a->position;
+    float u, c3, c4, c5;
+
+    if (T <= 0) {
+        return b->position;
+    }
+
+    switch (interp) {
+        case LOBOT_INTERP_CUBIC:
+            u = s / T;
+            return (2*u*u*u - 3*u*u + 1) * a->position +
+                (u*u*u - 2*u*u + u) * T * a->velocity +
+                (-2*u*u*u + 3*u*u) * b->position +
+                (u*u*u - u*u) * T * b->velocity;
+        case LOBOT_INTERP_QUINTIC:
+            c3 = (20*dp - (8*b->velocity + 12*a->velocity)*T -
+                    (3*a->acceleration - b->acceleration)*T*T) / (2*T*T*T);
+            c4 = (-30*dp + (14*b->velocity + 16*a->velocity)*T +
+                    (3*a->acceleration - 2*b->acceleration)*T*T) / (2*T*T*T*T);
+            c5 = (12*dp - 6*(b->velocity + a->velocity)*T -
+                    (a->acceleration - b->acceleration)*T*T) / (2*T*T*T*T*T);
+            return a->position + a->velocity*s + a->acceleration/2*s*s +
+                c3*s*s*s + c4*s*s*s*s + c5*s*s*s*s*s;
+        case LOBOT_INTERP_LINEAR:
+        default:
+            return a->position + dp * s / T;
+    }
+}
+
+/* position of a joint's curve at time t, held at the ends of the stream */
+static float evaluate(const struct traj_joint *joint, float t_ms)
+{
+    size_t n = joint->tail - joint->head;
+    size_t i;
+
+    if (t_ms <= waypoint(joint, 0)->t_ms) {
+        return waypoint(joint, 0)->position;
+    }
+    for (i = 1; i < n; ++i) {
+        if (t_ms <= waypoint(joint, i)->t_ms) {
+            return interpolate(joint->interp, waypoint(joint, i - 1),
+                    waypoint(joint, i), t_ms);
+        }
+    }
+    return waypoint(joint, n - 1)->position;
+}
+
+/* check whether a linear move from t0 to t1 stays within tolerance */
+static int fits(const struct traj_joint *joint, uint32_t t0, uint32_t t1, float tolerance)
+{
+    float p0 = evaluate(joint, t0);
+    float p1 = evaluate(joint, t1);
+    float t;
+    int k;
+
+    for (k = 1; k < FIT_SAMPLES; ++k) {
+        t = t0 + (float)(t1 - t0) * k / FIT_SAMPLES;
+        if (fabsf(p0 + (p1 - p0) * (t - t0) / (t1 - t0) - evaluate(joint, t)) > tolerance) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* plan the next move of a joint starting at t0
+ * @return move duration in ms, 0 once the stream is exhausted
+ */
+static uint32_t plan(struct lobot_trajectory_t* traj, struct traj_joint *joint,
+        uint32_t t0, float *target)
+{
+    const struct lobot_trajectory_config *config = &traj->config;
+    uint32_t t_last, d, dmax;
+
+    /* drop waypoints the curve has moved past */
+    while (joint->tail - joint->head > 1 && waypoint(joint, 1)->t_ms <= t0) {
+        joint->head++;
+    }
+
+    t_last = waypoint(joint, joint->tail - joint->head - 1)->t_ms;
+    if (t_last <= t0) {
+        return 0;
+    }
+
+    dmax = t_last - t0;
+    if (dmax > config->segment_max_ms) {
+        dmax = config->segment_max_ms;
+    }
+    for (d = dmax; d > config->segment_min_ms; d = d * 3 / 4) {
+        if (fits(joint, t0, t0 + d, config->tolerance)) {
+            break;
+        }
+    }
+    if (d < config->segment_min_ms) {
+        d = dmax < config->segment_min_ms ? dmax : config->segment_min_ms;
+    }
+
+    *target = evaluate(joint, t0 + d);
+    return d;
+}
+
+struct lobot_trajectory_t* lobot_trajectory_create(struct lobot_port_t* port,
+        const struct lobot_trajectory_config* config)
+{
+    struct lobot_trajectory_t *traj;
+    struct lobot_port_info info;
+    uint32_t byte_time_ns;
+
+    if (port == NULL) {
+        return NULL;
+    }
+
+    traj = calloc(1, sizeof *traj);
+    if (traj == NULL) {
+        return NULL;
+    }
+
+    traj->port = port;
+    if (config) {
+        traj->config = *config;
+    }
+    if (traj->config.bus_share <= 0 || traj->config.bus_share > 1) {
+        traj->config.bus_share = 0.5f;
+    }
+    if (traj->config.tolerance <= 0) {
+        traj->config.tolerance = 2;
+    }
+    if (traj->config.segment_min_ms == 0) {
+        traj->config.segment_min_ms = 20;
+    }
+    if (traj->config.segment_max_ms < traj->config.segment_min_ms) {
+        traj->config.segment_max_ms = 500;
+    }
+    if (traj->config.segment_max_ms > LOBOT_MOVETIME_MS_MAX) {
+        traj->config.segment_max_ms = LOBOT_MOVETIME_MS_MAX;
+    }
+
+    /* 10 bits per byte on the wire */
+    if (traj->config.baud) {
+        byte_time_ns = 10000000000ull / traj->config.baud;
+    } else if (lobot_port_info(port, &info) == 0 && info.byte_time_ns) {
+        byte_time_ns = info.byte_time_ns;
+    } else {
+        byte_time_ns = 10000000000ull / LOBOT_PORT_BAUD;
+    }
+    traj->frames_per_ms = 1000000.0f / ((float)byte_time_ns * PACKET_LEN_4) *
+        traj->config.bus_share;
+
+    return traj;
+}
+
+int lobot_trajectory_add_joint(struct lobot_trajectory_t* traj, uint8_t id,
+        lobot_interp_t interp)
+{
+    struct traj_joint *joint;
+
+    if (traj == NULL || id > LOBOT_ID_MAX || interp > LOBOT_INTERP_QUINTIC) {
+        return -EINVAL;
+    }
+    if (find_joint(traj, id)) {
+        return -EEXIST;
+    }
+    if (traj->njoints >= LOBOT_TRAJ_JOINTS_MAX) {
+        return -ENOSPC;
+    }
+
+    joint = &traj->joints[traj->njoints++];
+    joint->id = id;
+    joint->interp = interp;
+    return 0;
+}
+
+int lobot_trajectory_push(struct lobot_trajectory_t* traj, uint8_t id,
+        const struct lobot_waypoint* wp)
+{
+    struct traj_joint *joint;
+
+    if (traj == NULL || wp == NULL) {
+        return -EINVAL;
+    }
+    joint = find_joint(traj, id);
+    if (joint == NULL) {
+        return -ENOENT;
+    }
+    if (joint->tail != joint->head &&
+            wp->t_ms <= waypoint(joint, joint->tail - joint->head - 1)->t_ms) {
+        return -EINVAL;
+    }
+    if (joint->tail - joint->head >= LOBOT_TRAJ_WAYPOINTS_MAX) {
+        return -EAGAIN;
+    }
+
+    joint->wps[joint->tail % LOBOT_TRAJ_WAYPOINTS_MAX] = *wp;
+    joint->tail++;
+    return 0;
+}
+
+int lobot_trajectory_update(struct lobot_trajectory_t* traj, uint32_t now_ms)
+{
+    uint8_t buffer[LOBOT_TRAJ_JOINTS_MAX * PACKET_LEN_4];
+    struct traj_joint *due[LOBOT_TRAJ_JOINTS_MAX];
+    uint32_t due_ms[LOBOT_TRAJ_JOINTS_MAX];
+    struct traj_joint *joint;
+    uint8_t params[4];
+    size_t ndue = 0, len = 0, i, j;
+    uint32_t t0, d, time;
+    float target;
+    int sent = 0, ret;
+
+    if (traj == NULL) {
+        return -EINVAL;
+    }
+
+    /* refill bus budget, allowing a burst of one move per joint */
+    if (traj->started) {
+        traj->tokens += (now_ms - traj->last_ms) * traj->frames_per_ms;
+    } else {
+        traj->tokens = traj->njoints;
+        traj->started = 1;
+    }
+    if (traj->tokens > traj->njoints) {
+        traj->tokens = traj->njoints;
+    }
+    traj->last_ms = now_ms;
+
+    /* collect joints whose move ends, most lagging first */
+    for (i = 0; i < traj->njoints; ++i) {
+        joint = &traj->joints[i];
+        if (joint->tail == joint->head) {
+            continue;
+        }
+        t0 = joint->active ? joint->seg_end : waypoint(joint, 0)->t_ms;
+        if (t0 > now_ms) {
+            continue;
+        }
+        for (j = ndue; j > 0 && due_ms[j - 1] > t0; --j) {
+            due[j] = due[j - 1];
+            due_ms[j] = due_ms[j - 1];
+        }
+        due[j] = joint;
+        due_ms[j] = t0;
+        ndue++;
+    }
+
+    for (i = 0; i < ndue && traj->tokens >= 1; ++i) {
+        joint = due[i];
+        /* a late joint moves on from now, its servo catching up on the way */
+        t0 = due_ms[i] > now_ms ? due_ms[i] : now_ms;
+        d = plan(traj, joint, t0, &target);
+        if (d == 0) {
+            /* stream over, the servo holds the last waypoint; a later stream
+             * starts from its own first waypoint, not from this stale one */
+            joint->active = 0;
+            joint->head = joint->tail;
+            continue;
+        }
+
+        if (target < LOBOT_ANGLE_RAW_MIN) {
+            target = LOBOT_ANGLE_RAW_MIN;
+        }
+        if (target > LOBOT_ANGLE_RAW_MAX) {
+            target = LOBOT_ANGLE_RAW_MAX;
+        }
+        time = d;
+        params[0] = LOW_BYTE((uint16_t)lroundf(target));
+        params[1] = HIGH_BYTE((uint16_t)lroundf(target));
+        params[2] = LOW_BYTE(time);
+        params[3] = HIGH_BYTE(time);
+        len += lobot_frame_build(joint->id, LOBOT_CMD_MOVE_TIME_WRITE, params, 4,
+                &buffer[len]);
+
+        joint->active = 1;
+        joint->seg_end = t0 + d;
+        joint->status.lag_ms = now_ms - due_ms[i];
+        if (joint->status.lag_ms > joint->status.max_lag_ms) {
+            joint->status.max_lag_ms = joint->status.lag_ms;
+        }
+        joint->status.frames++;
+        joint->status.target = target;
+        traj->tokens -= 1;
+        sent++;
+    }
+
+    if (len > 0) {
+        lobot_port_acquire(traj->port, LOBOT_PRIO_SETPOINT);
+        ret = lobot_port_write(traj->port, buffer, len);
+        lobot_port_release(traj->port);
+        if (ret != (int)len) {
+            return -EIO;
+        }
+    }
+    return sent;
+}
+
+int lobot_trajectory_status(struct lobot_trajectory_t* traj, uint8_t id,
+        struct lobot_trajectory_status* status_out)
+{
+    struct traj_joint *joint;
+
+    if (traj == NULL || status_out == NULL) {
+        return -EINVAL;
+    }
+    joint = find_joint(traj, id);
+    if (joint == NULL) {
+        return -ENOENT;
+    }
+
+    *status_out = joint->status;
+    status_out->pending = joint->tail - joint->head;
+    return 0;
+}
+
+void lobot_trajectory_destroy(struct lobot_trajectory_t* traj)
+{
+    free(traj);
+}
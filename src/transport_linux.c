@@ -0,0 +1,399 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+/* termios2 allows arbitrary baud rates, but clashes with <termios.h> */
+#include <asm/termbits.h>
+#include <linux/serial.h>
+
+#include "lobot_servo/port.h"
+
+/* slack on a write's airtime before giving up on a full driver buffer */
+#define FD_WRITE_SLACK_US 20000
+
+/* context of links backed by a file descriptor */
+struct fd_link {
+    int fd;
+    int peer_fd;            /* pty slave kept open so the master never hangs up */
+    char peer[64];
+    uint32_t byte_time_ns;  /* paces the wait for a full driver buffer */
+};
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* configure raw 8N1 at any baud rate with termios2
+ * @return baud rate read back from the driver, 0 on failure
+ */
+static uint32_t set_raw(int fd, uint32_t baud)
+{
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) < 0) {
+        return 0;
+    }
+    tio.c_cflag = BOTHER | CS8 | CLOCAL | CREAD;
+    tio.c_iflag = IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    tio.c_cc[VTIME] = 0;
+    tio.c_cc[VMIN] = 0;
+    if (ioctl(fd, TCSETS2, &tio) < 0 || ioctl(fd, TCGETS2, &tio) < 0) {
+        return 0;
+    }
+    return tio.c_ospeed;
+}
+
+/* ask the driver to push received bytes without batching them
+ * @return 1 if low latency mode is in effect
+ */
+static int set_low_latency(int fd)
+{
+    struct serial_struct serial;
+
+    if (ioctl(fd, TIOCGSERIAL, &serial) < 0) {
+        return 0;
+    }
+    serial.flags |= ASYNC_LOW_LATENCY;
+    if (ioctl(fd, TIOCSSERIAL, &serial) < 0 || ioctl(fd, TIOCGSERIAL, &serial) < 0) {
+        return 0;
+    }
+    return (serial.flags & ASYNC_LOW_LATENCY) != 0;
+}
+
+/* read USB serial adapter latency timer from sysfs, -1 if there is none */
+static int latency_timer_ms(const char* dev)
+{
+    char real[PATH_MAX];
+    char path[PATH_MAX + 64];
+    const char *name;
+    int ms = -1;
+    FILE *f;
+
+    if (realpath(dev, real) == NULL) {
+        return -1;
+    }
+    name = strrchr(real, '/');
+    name = name ? name + 1 : real;
+
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/latency_timer", name);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    if (fscanf(f, "%d", &ms) != 1) {
+        ms = -1;
+    }
+    fclose(f);
+    return ms;
+}
+
+static struct fd_link* fd_link_new(int fd, uint32_t baud)
+{
+    struct fd_link *link = calloc(1, sizeof *link);
+
+    if (link) {
+        link->fd = fd;
+        link->peer_fd = -1;
+        /* 10 bits per byte on the wire */
+        link->byte_time_ns = 10000000000ULL / (baud ? baud : LOBOT_PORT_BAUD);
+    }
+    return link;
+}
+
+static int fd_readv(void* ctx, const struct iovec* iov, int iovcnt)
+{
+    struct fd_link *link = ctx;
+    ssize_t ret = readv(link->fd, iov, iovcnt);
+
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -errno;
+    }
+    return ret;
+}
+
+/* write all bytes, waiting for a full driver buffer to drain for as long as
+ * the bytes left take on the wire, plus some slack
+ * @return bytes written, short if time ran out, negative errno on failure
+ */
+static int fd_write(void* ctx, const uint8_t* buffer, size_t len)
+{
+    struct fd_link *link = ctx;
+    uint64_t now, deadline = 0;
+    struct pollfd pfd;
+    struct timespec ts;
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        ret = write(link->fd, buffer + done, len - done);
+        if (ret > 0) {
+            done += ret;
+            continue;
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return done ? (int)done : -errno;
+        }
+
+        now = monotonic_us();
+        if (deadline == 0) {
+            deadline = now + (uint64_t)(len - done) * link->byte_time_ns / 1000 +
+                FD_WRITE_SLACK_US;
+        }
+        if (now >= deadline) {
+            break;
+        }
+        pfd.fd = link->fd;
+        pfd.events = POLLOUT;
+        ts.tv_sec = (deadline - now) / 1000000;
+        ts.tv_nsec = ((deadline - now) % 1000000) * 1000;
+        if (ppoll(&pfd, 1, &ts, NULL) < 0 && errno != EINTR) {
+            return done ? (int)done : -errno;
+        }
+    }
+    return done;
+}
+
+static int fd_poll(void* ctx, uint32_t timeout_us)
+{
+    struct fd_link *link = ctx;
+    struct pollfd pfd;
+    struct timespec ts;
+    int ret;
+
+    pfd.fd = link->fd;
+    pfd.events = POLLIN;
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+    ret = ppoll(&pfd, 1, &ts, NULL);
+    if (ret < 0) {
+        return errno == EINTR ? 0 : -errno;
+    }
+    return ret;
+}
+
+static int fd_fd(void* ctx)
+{
+    struct fd_link *link = ctx;
+
+    return link->fd;
+}
+
+static const char* fd_peer(void* ctx)
+{
+    struct fd_link *link = ctx;
+
+    return link->peer[0] ? link->peer : NULL;
+}
+
+static void fd_close(void* ctx)
+{
+    struct fd_link *link = ctx;
+
+    if (link) {
+        if (link->peer_fd >= 0) {
+            close(link->peer_fd);
+        }
+        close(link->fd);
+        free(link);
+    }
+}
+
+static int tty_open(void** ctx, const char* dev, void* arg,
+        const struct lobot_port_options* options, struct lobot_port_info* info)
+{
+    struct fd_link *link;
+    uint32_t baud;
+    int fd, err;
+
+    (void)arg;
+
+    fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0) {
+        return -errno;
+    }
+
+    /* close may clobber errno, keep the cause first */
+    if (options->exclusive && ioctl(fd, TIOCEXCL) < 0) {
+        err = errno;
+        close(fd);
+        return -err;
+    }
+
+    errno = 0;
+    baud = set_raw(fd, info->baud);
+    if (baud == 0) {
+        err = errno ? errno : EINVAL;
+        close(fd);
+        return -err;
+    }
+
+    link = fd_link_new(fd, baud);
+    if (link == NULL) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    info->baud = baud;
+    info->exclusive = options->exclusive != 0;
+    info->low_latency = options->low_latency ? set_low_latency(fd) : 0;
+    info->latency_timer_ms = latency_timer_ms(dev);
+
+    if (options->flush) {
+        ioctl(fd, TCFLSH, TCIOFLUSH);
+    }
+
+    *ctx = link;
+    return 0;
+}
+
+static int pty_open(void** ctx, const char* dev, void* arg,
+        const struct lobot_port_options* options, struct lobot_port_info* info)
+{
+    struct fd_link *link;
+    uint32_t baud;
+    int fd;
+
+    (void)dev;
+    (void)arg;
+    (void)options;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    link = fd_link_new(fd, info->baud);
+    if (link == NULL) {
+        close(fd);
+        return -ENOMEM;
+    }
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0 ||
+            ptsname_r(fd, link->peer, sizeof(link->peer)) != 0) {
+        fd_close(link);
+        return -ENODEV;
+    }
+    link->peer_fd = open(link->peer, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (link->peer_fd < 0) {
+        fd_close(link);
+        return -ENODEV;
+    }
+
+    /* settings of the slave apply to data flowing through the pair */
+    baud = set_raw(link->peer_fd, info->baud);
+    if (baud == 0) {
+        fd_close(link);
+        return -EINVAL;
+    }
+    info->baud = baud;
+    link->byte_time_ns = 10000000000ULL / baud;
+
+    *ctx = link;
+    return 0;
+}
+
+static int unix_open(void** ctx, const char* dev, void* arg,
+        const struct lobot_port_options* options, struct lobot_port_info* info)
+{
+    struct sockaddr_un addr;
+    struct fd_link *link;
+    int fd, err;
+
+    (void)arg;
+    (void)options;
+    (void)info;
+
+    if (dev == NULL || strlen(dev) >= sizeof(addr.sun_path)) {
+        return -EINVAL;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, dev);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+        err = errno;
+        close(fd);
+        return -err;
+    }
+
+    link = fd_link_new(fd, info->baud);
+    if (link == NULL) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    *ctx = link;
+    return 0;
+}
+
+static int unix_readv(void* ctx, const struct iovec* iov, int iovcnt)
+{
+    struct fd_link *link = ctx;
+    ssize_t ret = readv(link->fd, iov, iovcnt);
+
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -errno;
+    }
+    /* unlike a tty, a stream socket reads 0 only once the peer is gone */
+    return ret == 0 ? -ECONNRESET : ret;
+}
+
+const struct lobot_transport lobot_transport_tty = {
+    "tty", tty_open, fd_readv, fd_write, fd_poll, fd_fd, fd_peer, fd_close,
+};
+
+const struct lobot_transport lobot_transport_pty = {
+    "pty", pty_open, fd_readv, fd_write, fd_poll, fd_fd, fd_peer, fd_close,
+};
+
+const struct lobot_transport lobot_transport_unix = {
+    "unix", unix_open, unix_readv, fd_write, fd_poll, fd_fd, fd_peer, fd_close,
+};
@@ -0,0 +1,219 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include "lobot_servo/port.h"
+
+/* bytes buffered per direction, must be a power of 2 */
+#define MEM_QUEUE_LEN 4096
+
+/* one direction of a link, eventfd is readable while data is queued */
+struct mem_queue {
+    uint8_t data[MEM_QUEUE_LEN];
+    size_t head;        /* free running */
+    size_t tail;        /* free running */
+    int efd;
+};
+
+struct mem_link {
+    pthread_mutex_t lock;
+    struct mem_queue queues[2];
+    int refs;
+};
+
+/* an end reads queues[side] and writes queues[!side] */
+struct mem_end {
+    struct mem_link *link;
+    int side;
+};
+
+static void mem_link_put(struct mem_link *link)
+{
+    int refs;
+
+    pthread_mutex_lock(&link->lock);
+    refs = --link->refs;
+    pthread_mutex_unlock(&link->lock);
+
+    if (refs == 0) {
+        close(link->queues[0].efd);
+        close(link->queues[1].efd);
+        pthread_mutex_destroy(&link->lock);
+        free(link);
+    }
+}
+
+static int mem_open(void** ctx, const char* dev, void* arg,
+        const struct lobot_port_options* options, struct lobot_port_info* info)
+{
+    (void)dev;
+    (void)options;
+    (void)info;
+
+    *ctx = arg;
+    return 0;
+}
+
+static int mem_readv(void* ctx, const struct iovec* iov, int iovcnt)
+{
+    struct mem_end *end = ctx;
+    struct mem_queue *q = &end->link->queues[end->side];
+    eventfd_t count;
+    size_t done = 0, len, off, chunk;
+    int i;
+
+    pthread_mutex_lock(&end->link->lock);
+    for (i = 0; i < iovcnt; ++i) {
+        len = q->tail - q->head;
+        if (len > iov[i].iov_len) {
+            len = iov[i].iov_len;
+        }
+        off = q->head & (MEM_QUEUE_LEN - 1);
+        chunk = MEM_QUEUE_LEN - off < len ? MEM_QUEUE_LEN - off : len;
+        memcpy(iov[i].iov_base, &q->data[off], chunk);
+        memcpy((uint8_t*)iov[i].iov_base + chunk, q->data, len - chunk);
+        q->head += len;
+        done += len;
+    }
+    if (q->head == q->tail) {
+        eventfd_read(q->efd, &count);
+    }
+    pthread_mutex_unlock(&end->link->lock);
+
+    return done;
+}
+
+static int mem_write(void* ctx, const uint8_t* buffer, size_t len)
+{
+    struct mem_end *end = ctx;
+    struct mem_queue *q = &end->link->queues[!end->side];
+    size_t off, chunk;
+    int ret;
+
+    pthread_mutex_lock(&end->link->lock);
+    if (len > MEM_QUEUE_LEN - (q->tail - q->head)) {
+        len = MEM_QUEUE_LEN - (q->tail - q->head);
+    }
+    off = q->tail & (MEM_QUEUE_LEN - 1);
+    chunk = MEM_QUEUE_LEN - off < len ? MEM_QUEUE_LEN - off : len;
+    memcpy(&q->data[off], buffer, chunk);
+    memcpy(q->data, buffer + chunk, len - chunk);
+    q->tail += len;
+    ret = len > 0 && eventfd_write(q->efd, 1) < 0 ? -errno : (int)len;
+    pthread_mutex_unlock(&end->link->lock);
+
+    return ret;
+}
+
+static int mem_poll(void* ctx, uint32_t timeout_us)
+{
+    struct mem_end *end = ctx;
+    struct pollfd pfd;
+    struct timespec ts;
+    int ret;
+
+    pfd.fd = end->link->queues[end->side].efd;
+    pfd.events = POLLIN;
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+    ret = ppoll(&pfd, 1, &ts, NULL);
+    if (ret < 0) {
+        return errno == EINTR ? 0 : -errno;
+    }
+    return ret;
+}
+
+static int mem_fd(void* ctx)
+{
+    struct mem_end *end = ctx;
+
+    return end->link->queues[end->side].efd;
+}
+
+static void mem_close(void* ctx)
+{
+    struct mem_end *end = ctx;
+
+    mem_link_put(end->link);
+    free(end);
+}
+
+static const struct lobot_transport lobot_transport_mem = {
+    "mem", mem_open, mem_readv, mem_write, mem_poll, mem_fd, NULL, mem_close,
+};
+
+int lobot_port_open_loopback(struct lobot_port_t* ends[2],
+        const struct lobot_port_options* options)
+{
+    struct mem_link *link;
+    struct mem_end *end;
+    int i;
+
+    link = calloc(1, sizeof *link);
+    if (link == NULL) {
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&link->lock, NULL);
+    link->queues[0].efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    link->queues[1].efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    link->refs = 1;
+    if (link->queues[0].efd < 0 || link->queues[1].efd < 0) {
+        mem_link_put(link);
+        return -EMFILE;
+    }
+
+    for (i = 0; i < 2; ++i) {
+        end = calloc(1, sizeof *end);
+        ends[i] = NULL;
+        if (end) {
+            end->link = link;
+            end->side = i;
+            pthread_mutex_lock(&link->lock);
+            link->refs++;
+            pthread_mutex_unlock(&link->lock);
+            ends[i] = lobot_port_open_transport(&lobot_transport_mem, NULL, end, options);
+            if (ends[i] == NULL) {
+                mem_close(end);
+            }
+        }
+        if (ends[i] == NULL) {
+            if (i == 1) {
+                lobot_port_close(ends[0]);
+            }
+            mem_link_put(link);
+            return -ENOMEM;
+        }
+    }
+
+    mem_link_put(link);
+    return 0;
+}
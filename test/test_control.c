@@ -0,0 +1,142 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Control loop checks against the simulated bus: setpoints reach the servo,
+ * states are published every cycle, and a full queue, bad IDs and failed
+ * writes are reported. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include "lobot_servo/control.h"
+#include "lobot_servo/port.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+#define PERIOD_US 5000
+
+/* setpoints reach the servo and its position is published every cycle */
+static int check_loop(struct lobot_port_t *port, struct lobot_sim_t *sim)
+{
+    const uint8_t ids[] = {1, 2};
+    struct lobot_control_config config = {PERIOD_US, ids, sizeof(ids)};
+    struct lobot_control_t *ctl;
+    struct lobot_servo_state state, later;
+    struct lobot_sim_servo servo;
+    int i;
+
+    CHECK(lobot_control_create(NULL, &config) == NULL, "created without a port");
+    config.period_us = 0;
+    CHECK(lobot_control_create(port, &config) == NULL, "created without a period");
+    config.period_us = PERIOD_US;
+    ctl = lobot_control_create(port, &config);
+    CHECK(ctl, "control");
+
+    CHECK(lobot_control_get_state(ctl, 3, &state) == -ENOENT, "servo 3 isn't polled");
+    CHECK(lobot_control_get_state(ctl, 1, &state) == 0, "state");
+    CHECK(state.status == LOBOT_NO_REPLY, "state before the first cycle: %d", state.status);
+    CHECK(lobot_control_set_pos(ctl, LOBOT_ID_BROADCAST, 500, 0) == -EINVAL,
+            "broadcast setpoint queued");
+
+    /* only the latest setpoint of a servo counts */
+    for (i = 0; i < 10; ++i) {
+        CHECK(lobot_control_set_pos(ctl, 2, (uint16_t)(100 + i), 0) == 0, "set_pos");
+    }
+    CHECK(lobot_control_start(ctl) == 0, "start");
+    CHECK(lobot_control_start(ctl) == -EBUSY, "started twice");
+    pause_us(20 * PERIOD_US);
+
+    CHECK(lobot_sim_servo(sim, 2, &servo) == 0, "servo");
+    CHECK(servo.target == 109, "target %u", servo.target);
+    CHECK(lobot_control_get_state(ctl, 2, &state) == 0, "state");
+    CHECK(state.status == LOBOT_OK && state.position == servo.position,
+            "status %d, position %u, servo at %u", state.status, state.position,
+            servo.position);
+    pause_us(4 * PERIOD_US);
+    CHECK(lobot_control_get_state(ctl, 2, &later) == 0, "state");
+    CHECK(later.cycle > state.cycle && later.timestamp_us > state.timestamp_us,
+            "state not refreshed");
+    CHECK(lobot_control_write_errors(ctl) == 0, "%u write errors",
+            (unsigned)lobot_control_write_errors(ctl));
+
+    lobot_control_stop(ctl);
+    lobot_control_destroy(ctl);
+    return 0;
+}
+
+/* a full queue refuses setpoints, and setpoints that can't be written count */
+static int check_errors(struct lobot_port_t *port)
+{
+    struct lobot_control_config config = {PERIOD_US, NULL, 0};
+    struct lobot_control_t *ctl;
+    uint8_t junk[256];
+    int i, ret;
+
+    ctl = lobot_control_create(port, &config);
+    CHECK(ctl, "control");
+    for (i = 0; i < LOBOT_CONTROL_QUEUE_LEN; ++i) {
+        CHECK(lobot_control_set_pos(ctl, (uint8_t)(i % (LOBOT_ID_MAX + 1)), 500, 0) == 0,
+                "set_pos %d", i);
+    }
+    CHECK(lobot_control_set_pos(ctl, 1, 500, 0) == -EAGAIN, "full queue accepted a setpoint");
+
+    /* nobody reads the other end, once its buffer is full writes fall short */
+    memset(junk, 0, sizeof(junk));
+    do {
+        ret = lobot_port_write(port, junk, sizeof(junk));
+    } while (ret == (int)sizeof(junk));
+
+    CHECK(lobot_control_start(ctl) == 0, "start");
+    pause_us(4 * PERIOD_US);
+    CHECK(lobot_control_write_errors(ctl) == 1, "%u write errors",
+            (unsigned)lobot_control_write_errors(ctl));
+    lobot_control_destroy(ctl);
+    return 0;
+}
+
+int main(void)
+{
+    const uint8_t ids[] = {1, 2};
+    struct lobot_sim_config config;
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    int ret;
+
+    /* the control loop owns and closes the port it's given */
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    memset(&config, 0, sizeof(config));
+    config.ids = ids;
+    config.n = sizeof(ids);
+    sim = lobot_sim_create(ends[1], &config);
+    CHECK(sim && lobot_sim_start(sim) == 0, "sim");
+    ret = check_loop(ends[0], sim);
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[1]);
+    if (ret) {
+        return ret;
+    }
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    ret = check_errors(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
@@ -0,0 +1,272 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Replays a 1 kHz joint stream through the decimator onto a simulated servo,
+ * in real time, and checks the fit stays within tolerance, the servo follows,
+ * and bus traffic drops by an order of magnitude. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "lobot_servo/decimator.h"
+#include "lobot_servo/protocol.h"
+#include "lobot_servo/recorder.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+#define SERVO_ID 1
+#define DURATION_MS 2000
+#define TOLERANCE 2.0f
+#define SEGMENT_MAX_MS 200
+/* a move lands at most one segment plus one sample after its input, and
+ * takes up to one more segment to complete */
+#define LAG_MAX_MS (2 * SEGMENT_MAX_MS + 2)
+
+struct move {
+    uint32_t t_ms;          /* input time the move ends at */
+    uint16_t position;
+};
+
+struct replay {
+    struct lobot_port_t *port;
+    uint32_t now_ms;        /* time of the sample being pushed */
+    struct move moves[DURATION_MS];
+    size_t n;
+};
+
+static float trajectory[DURATION_MS];
+static uint16_t servo_pos[DURATION_MS];
+
+/* a planner's joint stream: a slow swing with a faster ripple on top */
+static void make_trajectory(void)
+{
+    size_t t;
+    float s;
+
+    for (t = 0; t < DURATION_MS; ++t) {
+        s = t / 1000.0f;
+        trajectory[t] = 500 + 250 * sinf(2 * (float)M_PI * 0.5f * s) +
+            30 * sinf(2 * (float)M_PI * 2.3f * s);
+    }
+}
+
+/* a move ends at the last sample of its segment, the one before the sample
+ * being pushed */
+static void on_move(void* ctx, uint8_t id, uint16_t position, uint16_t time_ms)
+{
+    struct replay *r = ctx;
+
+    (void)time_ms;
+    r->moves[r->n].t_ms = r->now_ms - 1;
+    r->moves[r->n].position = position;
+    r->n++;
+    lobot_set_pos(r->port, id, position, time_ms);
+}
+
+static void on_gap_move(void* ctx, uint8_t id, uint16_t position, uint16_t time_ms)
+{
+    (void)id;
+    (void)position;
+    *(uint16_t*)ctx = time_ms;
+}
+
+/* a sample after a gap longer than any move stretches its segment, whose
+ * move must be shortened rather than wrap around */
+static int check_gap(void)
+{
+    struct lobot_decimator_config config = {0};
+    struct lobot_decimator_t *dec;
+    uint16_t time_ms = 0;
+
+    config.segment_max_ms = SEGMENT_MAX_MS;
+    config.emit = on_gap_move;
+    config.ctx = &time_ms;
+    dec = lobot_decimator_create(NULL, &config);
+    CHECK(dec, "decimator");
+    lobot_decimator_push(dec, SERVO_ID, 0, 100);
+    lobot_decimator_push(dec, SERVO_ID, 1, 100);
+    lobot_decimator_push(dec, SERVO_ID, 100000, 900);
+    CHECK(lobot_decimator_flush(dec, SERVO_ID) == 1, "flush");
+    CHECK(time_ms == SEGMENT_MAX_MS, "move over a gap takes %u ms", time_ms);
+    lobot_decimator_destroy(dec);
+    return 0;
+}
+
+static void sleep_until(const struct timespec *start, uint32_t ms)
+{
+    struct timespec ts = *start;
+
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* largest distance between the emitted segments and the input samples */
+static float fit_error(const struct replay *r, float p_first)
+{
+    float p0 = p_first, p, err, worst = 0;
+    uint32_t t0 = 0, t;
+    size_t i;
+
+    for (i = 0; i < r->n; ++i) {
+        for (t = t0; t <= r->moves[i].t_ms; ++t) {
+            p = p0 + (r->moves[i].position - p0) * (float)(t - t0) /
+                (float)(r->moves[i].t_ms - t0 ? r->moves[i].t_ms - t0 : 1);
+            err = fabsf(p - trajectory[t]);
+            if (err > worst) {
+                worst = err;
+            }
+        }
+        t0 = r->moves[i].t_ms;
+        p0 = r->moves[i].position;
+    }
+    return worst;
+}
+
+/* largest distance between the servo and the nearest recent setpoint */
+static float tracking_error(void)
+{
+    float err, best, worst = 0;
+    uint32_t t, lag;
+
+    for (t = LAG_MAX_MS; t < DURATION_MS; ++t) {
+        best = 1e9f;
+        for (lag = 0; lag <= LAG_MAX_MS; ++lag) {
+            err = fabsf(servo_pos[t] - trajectory[t - lag]);
+            if (err < best) {
+                best = err;
+            }
+        }
+        if (best > worst) {
+            worst = best;
+        }
+    }
+    return worst;
+}
+
+int main(void)
+{
+    static struct replay replay;
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_config sim_config = {0};
+    struct lobot_decimator_config config = {0};
+    struct lobot_decimator_t *dec;
+    struct lobot_recorder_t *rec;
+    struct lobot_capture_t *cap;
+    const struct lobot_record *record;
+    struct lobot_sim_servo servo;
+    struct lobot_sim_t *sim;
+    struct timespec start;
+    char path[] = "/tmp/lobot_test_decimator_XXXXXX";
+    uint8_t id = SERVO_ID;
+    size_t i, frames = 0;
+    float fit, tracking, fps;
+    uint32_t t;
+    int fd;
+
+    if (check_gap()) {
+        return 1;
+    }
+    make_trajectory();
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    sim_config.ids = &id;
+    sim_config.n = 1;
+    sim = lobot_sim_create(ends[1], &sim_config);
+    CHECK(sim && lobot_sim_start(sim) == 0, "simulator");
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0, "capture file");
+    close(fd);
+    rec = lobot_recorder_open(path, 4096);
+    CHECK(rec, "recorder");
+    lobot_port_set_recorder(ends[0], rec);
+
+    /* start the servo on the trajectory so the replay has no initial jump */
+    CHECK(lobot_set_pos(ends[0], SERVO_ID, (uint16_t)lroundf(trajectory[0]), 0) == LOBOT_OK,
+            "initial move");
+    pause_us(20000);
+
+    replay.port = ends[0];
+    config.tolerance = TOLERANCE;
+    config.segment_max_ms = SEGMENT_MAX_MS;
+    config.emit = on_move;
+    config.ctx = &replay;
+    dec = lobot_decimator_create(ends[0], &config);
+    CHECK(dec, "decimator");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (t = 0; t < DURATION_MS; ++t) {
+        sleep_until(&start, t);
+        replay.now_ms = t;
+        CHECK(lobot_decimator_push(dec, SERVO_ID, t, trajectory[t]) >= 0, "push %u", t);
+        CHECK(lobot_sim_servo(sim, SERVO_ID, &servo) == 0, "servo state");
+        servo_pos[t] = servo.position;
+    }
+    replay.now_ms = DURATION_MS;
+    CHECK(lobot_decimator_flush(dec, SERVO_ID) >= 0, "flush");
+    pause_us((SEGMENT_MAX_MS + 50) * 1000);
+    CHECK(lobot_sim_servo(sim, SERVO_ID, &servo) == 0, "servo state");
+
+    lobot_port_set_recorder(ends[0], NULL);
+    lobot_recorder_close(rec);
+    cap = lobot_capture_open(path);
+    CHECK(cap, "capture");
+    for (i = 0; i < lobot_capture_count(cap); ++i) {
+        record = lobot_capture_get(cap, i);
+        if (record && record->type == LOBOT_RECORD_TX &&
+                record->cmd == LOBOT_CMD_MOVE_TIME_WRITE) {
+            frames++;
+        }
+    }
+    lobot_capture_close(cap);
+    unlink(path);
+
+    fit = fit_error(&replay, roundf(trajectory[0]));
+    tracking = tracking_error();
+    /* the initial move is not part of the replay */
+    fps = (frames - 1) * 1000.0f / DURATION_MS;
+    printf("moves %zu, frames %zu, %.1f frames/s for %d samples/s, "
+            "fit error %.2f, tracking error %.2f, final %u for %.1f\n",
+            replay.n, frames, fps, 1000, fit, tracking, servo.position,
+            trajectory[DURATION_MS - 1]);
+
+    CHECK(frames - 1 == replay.n, "%zu frames on the bus for %zu moves", frames - 1, replay.n);
+    CHECK(fit <= TOLERANCE + 0.5f, "fit error %.2f over tolerance %.1f", fit, TOLERANCE);
+    CHECK(fps <= 1000 / 10, "%.1f frames/s, not an order of magnitude below 1000", fps);
+    CHECK(tracking <= 2 * TOLERANCE + 1, "tracking error %.2f", tracking);
+    CHECK(fabsf(servo.position - trajectory[DURATION_MS - 1]) <= TOLERANCE + 1,
+            "servo ended at %u", servo.position);
+
+    lobot_decimator_destroy(dec);
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* C++ frame layer checks: frames built by make_frame match those the C API
+ * writes, and replies decode to the same values and types. */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "lobot_servo/frame.hpp"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+static_assert(std::is_same<lobot::command_traits<LOBOT_CMD_POS_READ>::reply_type,
+        uint16_t>::value, "positions are read as lobot_get_pos returns them");
+constexpr auto clamped = lobot::make_frame<LOBOT_CMD_MOVE_TIME_WRITE>(1, 1200, 40000);
+static_assert(lobot::detail::u16(&clamped[lobot::param_index]) == LOBOT_ANGLE_RAW_MAX &&
+        lobot::detail::u16(&clamped[lobot::param_index + 2]) == LOBOT_MOVETIME_MS_MAX,
+        "moves clamped at compile time");
+
+/* compare a frame written by the C API with the one make_frame builds */
+template <std::size_t N>
+static int same_frame(struct lobot_port_t* rx, const std::array<uint8_t, N>& expected)
+{
+    uint8_t frame[32];
+    int len = lobot_port_recv_frame(rx, frame, sizeof(frame));
+
+    return len == (int)N && memcmp(frame, expected.data(), N) == 0;
+}
+
+static int check_writes(struct lobot_port_t* ends[2])
+{
+    CHECK(lobot_set_pos(ends[0], 3, 1200, 40000) == LOBOT_OK, "set_pos");
+    CHECK(same_frame(ends[1], lobot::make_frame<LOBOT_CMD_MOVE_TIME_WRITE>(3, 1200, 40000)),
+            "move differs from lobot_set_pos");
+    CHECK(lobot_set_offset(ends[0], 3, -20) == LOBOT_OK, "set_offset");
+    CHECK(same_frame(ends[1], lobot::make_frame<LOBOT_CMD_ANGLE_OFFSET_ADJUST>(3, -20)),
+            "offset differs from lobot_set_offset");
+    CHECK(same_frame(ends[1], lobot::make_frame<LOBOT_CMD_ANGLE_OFFSET_WRITE>(3)),
+            "offset not saved like lobot_set_offset");
+    CHECK(lobot_set_limit(ends[0], 3, 100, 900) == LOBOT_OK, "set_limit");
+    CHECK(same_frame(ends[1], lobot::make_frame<LOBOT_CMD_ANGLE_LIMIT_WRITE>(3, 100, 900)),
+            "limit differs from lobot_set_limit");
+    CHECK(lobot_stop(ends[0], lobot::broadcast) == LOBOT_OK, "stop");
+    CHECK(same_frame(ends[1], lobot::make_frame<LOBOT_CMD_MOVE_STOP>(lobot::broadcast)),
+            "stop differs from lobot_stop");
+    return 0;
+}
+
+static int check_reads(struct lobot_port_t* port)
+{
+    uint16_t pos = 0, pos_c = 0, vin = 0, vin_c = 0;
+    int8_t offset = 0, offset_c = 0;
+
+    CHECK(lobot_set_offset(port, 1, -7) == LOBOT_OK, "set_offset");
+    CHECK(lobot_get_pos(port, 1, &pos_c) == LOBOT_OK, "get_pos");
+    CHECK(lobot::read<LOBOT_CMD_POS_READ>(port, 1, pos) > 0, "read position");
+    CHECK(pos == pos_c, "position %u, lobot_get_pos %u", pos, pos_c);
+    CHECK(lobot_get_vin(port, 1, &vin_c) == LOBOT_OK, "get_vin");
+    CHECK(lobot::read<LOBOT_CMD_VIN_READ>(port, 1, vin) > 0, "read vin");
+    CHECK(vin == vin_c, "vin %u, lobot_get_vin %u", vin, vin_c);
+    CHECK(lobot_get_offset(port, 1, &offset_c) == LOBOT_OK, "get_offset");
+    CHECK(lobot::read<LOBOT_CMD_ANGLE_OFFSET_READ>(port, 1, offset) > 0, "read offset");
+    CHECK(offset == offset_c && offset == -7, "offset %d, lobot_get_offset %d",
+            offset, offset_c);
+    return 0;
+}
+
+int main(void)
+{
+    const uint8_t ids[] = {1};
+    struct lobot_sim_config config;
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    int ret;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    ret = check_writes(ends);
+
+    memset(&config, 0, sizeof(config));
+    config.ids = ids;
+    config.n = sizeof(ids);
+    sim = lobot_sim_create(ends[1], &config);
+    CHECK(sim && lobot_sim_start(sim) == 0, "sim");
+    if (ret == 0) {
+        ret = check_reads(ends[0]);
+    }
+
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Batch frame encoder checks: known frames, back to back batches the port
+ * decodes again, and the limits. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/protocol.h"
+
+#include "test_util.h"
+
+/* frames worked out by hand from the protocol description */
+static int check_known(void)
+{
+    const uint8_t stop[] = {0x55, 0x55, 0xFE, 0x03, 0x0C, 0xF2};
+    const uint8_t move[] = {0x55, 0x55, 0x01, 0x07, 0x01, 0xF4, 0x01, 0xE8, 0x03, 0x16};
+    const uint8_t move_params[] = {0xF4, 0x01, 0xE8, 0x03};
+    uint8_t out[LOBOT_FRAME_LEN_MAX];
+
+    CHECK(build_frame(LOBOT_ID_BROADCAST, LOBOT_CMD_MOVE_STOP, NULL, 0, out) ==
+            sizeof(stop), "stop length");
+    CHECK(memcmp(out, stop, sizeof(stop)) == 0, "stop bytes");
+    CHECK(build_frame(1, LOBOT_CMD_MOVE_TIME_WRITE, move_params, 4, out) ==
+            sizeof(move), "move length");
+    CHECK(memcmp(out, move, sizeof(move)) == 0, "move bytes");
+    return 0;
+}
+
+/* a batch is the frames back to back, and decodes frame by frame */
+static int check_batch(struct lobot_port_t *tx, struct lobot_port_t *rx)
+{
+    struct lobot_frame_desc frames[] = {
+        {1, LOBOT_CMD_MOVE_TIME_WAIT_WRITE, 4, {0x10, 0x02, 0x64, 0x00}},
+        {2, LOBOT_CMD_LOAD_OR_UNLOAD_WRITE, 1, {1}},
+        {LOBOT_ID_BROADCAST, LOBOT_CMD_MOVE_START, 0, {0}},
+    };
+    const size_t n = sizeof(frames) / sizeof(frames[0]);
+    uint8_t buffer[3 * LOBOT_FRAME_LEN_MAX], single[LOBOT_FRAME_LEN_MAX];
+    uint8_t frame[LOBOT_FRAME_LEN_MAX];
+    int len, single_len, off = 0;
+    size_t i;
+
+    len = lobot_frames_encode(frames, n, buffer, sizeof(buffer));
+    CHECK(len == 10 + 7 + 6, "batch of %d bytes", len);
+    CHECK(lobot_port_write(tx, buffer, len) == len, "write");
+    for (i = 0; i < n; ++i) {
+        single_len = build_frame(frames[i].id, frames[i].cmd, frames[i].params,
+                frames[i].nparams, single);
+        CHECK(memcmp(buffer + off, single, single_len) == 0, "frame %zu differs", i);
+        off += single_len;
+        CHECK(lobot_port_poll(rx, 100000) > 0, "poll");
+        CHECK(lobot_port_recv_frame(rx, frame, sizeof(frame)) == single_len,
+                "frame %zu not decoded", i);
+        CHECK(memcmp(frame, single, single_len) == 0, "frame %zu decoded wrong", i);
+    }
+    CHECK(off == len, "batch has %d extra bytes", len - off);
+    return 0;
+}
+
+static int check_limits(void)
+{
+    struct lobot_frame_desc frames[2] = {
+        {1, LOBOT_CMD_MOVE_TIME_WRITE, 4, {0}},
+        {2, LOBOT_CMD_MOVE_STOP, 0, {0}},
+    };
+    uint8_t buffer[2 * LOBOT_FRAME_LEN_MAX];
+
+    CHECK(lobot_frames_encode(frames, 0, buffer, 0) == 0, "empty batch");
+    CHECK(lobot_frames_encode(frames, 2, buffer, 16) == 16, "exact fit");
+    CHECK(lobot_frames_encode(frames, 2, buffer, 15) == -ENOSPC, "one byte short");
+    frames[1].nparams = LOBOT_FRAME_PARAM_MAX + 1;
+    CHECK(lobot_frames_encode(frames, 2, buffer, sizeof(buffer)) == -EINVAL,
+            "too many parameters");
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_port_t *ends[2];
+    int ret;
+
+    CHECK(check_known() == 0, "known frames");
+    CHECK(check_limits() == 0, "limits");
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    ret = check_batch(ends[0], ends[1]);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
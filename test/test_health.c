@@ -0,0 +1,190 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Link health tracking checks against the simulated bus: round trips,
+ * retries, taking a missing servo down and probing it again. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+#define MISSING_ID 9
+#define PROBE_US 50000
+#define MAX_TIMEOUT_US 20000
+
+static void health_config(struct lobot_health_config *config, uint32_t retries)
+{
+    lobot_health_config_init(config);
+    config->retries = retries;
+    config->max_timeout_us = MAX_TIMEOUT_US;
+    config->probe_us = PROBE_US;
+    config->probe_max_us = 4 * PROBE_US;
+}
+
+static struct lobot_sim_t* sim_open(struct lobot_port_t *ends[2], float drop_rate)
+{
+    static const uint8_t ids[] = {1, 2};
+    struct lobot_sim_config config;
+    struct lobot_sim_t *sim;
+
+    if (lobot_port_open_loopback(ends, NULL) != 0) {
+        return NULL;
+    }
+    memset(&config, 0, sizeof(config));
+    config.ids = ids;
+    config.n = sizeof(ids);
+    config.drop_rate = drop_rate;
+    config.seed = 3;
+    sim = lobot_sim_create(ends[1], &config);
+    if (sim && lobot_sim_start(sim) != 0) {
+        lobot_sim_destroy(sim);
+        sim = NULL;
+    }
+    return sim;
+}
+
+static void sim_close(struct lobot_sim_t *sim, struct lobot_port_t *ends[2])
+{
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+}
+
+/* replies give a round trip and a timeout within the configured bounds */
+static int check_rtt(struct lobot_port_t *port)
+{
+    struct lobot_health_config config;
+    struct lobot_health_info info;
+    uint16_t pos;
+    int i;
+
+    CHECK(lobot_health_get(port, 1, &info) == LOBOT_BAD_ARG, "tracking on by default");
+    health_config(&config, 0);
+    CHECK(lobot_health_enable(port, &config) == LOBOT_OK, "enable");
+    CHECK(lobot_health_get(port, 1, &info) == LOBOT_OK, "get");
+    CHECK(info.state == LOBOT_HEALTH_UNKNOWN && info.srtt_us == 0, "fresh entry");
+    CHECK(info.timeout_us == MAX_TIMEOUT_US, "unmeasured timeout %u", info.timeout_us);
+
+    for (i = 0; i < 10; ++i) {
+        CHECK(lobot_get_pos(port, 1, &pos) == LOBOT_OK, "get_pos %d", i);
+    }
+    CHECK(lobot_health_get(port, 1, &info) == LOBOT_OK, "get");
+    CHECK(info.state == LOBOT_HEALTH_UP && info.failures == 0, "state %d", info.state);
+    CHECK(info.srtt_us > 0 && info.srtt_us < MAX_TIMEOUT_US, "srtt %u", info.srtt_us);
+    CHECK(info.timeout_us >= config.min_timeout_us && info.timeout_us < MAX_TIMEOUT_US,
+            "timeout %u", info.timeout_us);
+
+    /* servo 2 isn't measured yet and goes by servo 1's round trips */
+    CHECK(lobot_health_get(port, 2, &info) == LOBOT_OK, "get");
+    CHECK(info.timeout_us < MAX_TIMEOUT_US, "unmeasured timeout %u", info.timeout_us);
+
+    lobot_health_reset(port, 1);
+    CHECK(lobot_health_get(port, 1, &info) == LOBOT_OK, "get");
+    CHECK(info.state == LOBOT_HEALTH_UNKNOWN && info.srtt_us == 0, "not reset");
+    lobot_health_disable(port);
+    return 0;
+}
+
+/* a missing servo goes down, is skipped without bus traffic, then probed */
+static int check_down(struct lobot_port_t *port, struct lobot_sim_t *sim)
+{
+    const uint8_t ids[] = {1, MISSING_ID};
+    struct lobot_health_config config;
+    struct lobot_health_info info;
+    struct lobot_sim_stats before, after;
+    lobot_error_t status[2];
+    uint16_t pos[2];
+
+    health_config(&config, 2);
+    CHECK(lobot_health_enable(port, &config) == LOBOT_OK, "enable");
+
+    /* one getter and its two retries miss dead_after replies */
+    CHECK(lobot_get_pos(port, MISSING_ID, &pos[0]) == LOBOT_TIMEOUT, "missing servo answered");
+    CHECK(lobot_health_get(port, MISSING_ID, &info) == LOBOT_OK, "get");
+    CHECK(info.state == LOBOT_HEALTH_DOWN && info.failures == 3,
+            "state %d after %u failures", info.state, info.failures);
+
+    lobot_sim_stats(sim, &before);
+    CHECK(lobot_read_positions(port, ids, 2, pos, status) == LOBOT_NO_REPLY, "sweep");
+    lobot_sim_stats(sim, &after);
+    CHECK(status[0] == LOBOT_OK && status[1] == LOBOT_NO_REPLY, "status %d %d",
+            status[0], status[1]);
+    CHECK(after.requests - before.requests == 1, "down servo probed early");
+
+    pause_us(PROBE_US + 10000);
+    lobot_sim_stats(sim, &before);
+    lobot_read_positions(port, ids, 2, pos, status);
+    lobot_sim_stats(sim, &after);
+    CHECK(after.requests - before.requests == 2, "due probe not sent");
+    CHECK(status[0] == LOBOT_OK && status[1] == LOBOT_TIMEOUT, "status %d %d",
+            status[0], status[1]);
+
+    lobot_health_reset(port, LOBOT_ID_BROADCAST);
+    CHECK(lobot_health_get(port, MISSING_ID, &info) == LOBOT_OK, "get");
+    CHECK(info.state == LOBOT_HEALTH_UNKNOWN, "reset all kept state %d", info.state);
+    lobot_health_disable(port);
+    return 0;
+}
+
+/* retries hide lost replies from the caller */
+static int check_retry(struct lobot_port_t *port, struct lobot_sim_t *sim)
+{
+    struct lobot_health_config config;
+    struct lobot_sim_stats stats;
+    uint16_t pos;
+    int i;
+
+    health_config(&config, 4);
+    CHECK(lobot_health_enable(port, &config) == LOBOT_OK, "enable");
+    for (i = 0; i < 50; ++i) {
+        CHECK(lobot_get_pos(port, 1, &pos) == LOBOT_OK, "get_pos %d", i);
+    }
+    lobot_sim_stats(sim, &stats);
+    CHECK(stats.dropped > 0, "no reply dropped");
+    lobot_health_disable(port);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    int ret;
+
+    sim = sim_open(ends, 0);
+    CHECK(sim, "sim");
+    ret = check_rtt(ends[0]);
+    if (ret == 0) {
+        ret = check_down(ends[0], sim);
+    }
+    sim_close(sim, ends);
+    if (ret) {
+        return ret;
+    }
+
+    sim = sim_open(ends, 0.2f);
+    CHECK(sim, "sim");
+    ret = check_retry(ends[0], sim);
+    sim_close(sim, ends);
+    return ret;
+}
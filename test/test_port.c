@@ -0,0 +1,335 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Port layer checks on a loopback pair. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/protocol.h"
+#include "lobot_servo/reactor.h"
+
+#include "test_util.h"
+
+/* stray bytes short of a frame must not keep poll returning at once */
+static int check_poll_partial(struct lobot_port_t *tx, struct lobot_port_t *rx)
+{
+    const uint8_t junk[] = {0x55, 0x55};
+    uint8_t frame[16];
+    uint64_t start;
+    int ret;
+
+    CHECK(lobot_port_write(tx, junk, sizeof(junk)) == sizeof(junk), "write");
+    CHECK(lobot_port_poll(rx, 20000) > 0, "new bytes not reported");
+    CHECK(lobot_port_recv_frame(rx, frame, sizeof(frame)) == 0, "partial frame decoded");
+
+    start = monotonic_us();
+    ret = lobot_port_poll(rx, 20000);
+    CHECK(ret == 0, "poll on a partial frame returned %d", ret);
+    CHECK(monotonic_us() - start >= 15000, "poll on a partial frame returned early");
+    return 0;
+}
+
+#define WAITERS 4
+
+struct waiter {
+    struct lobot_port_t *port;
+    int *order;
+    int *next;
+    int index;
+};
+
+static void* waiter_thread(void *arg)
+{
+    struct waiter *w = arg;
+
+    lobot_port_acquire(w->port, LOBOT_PRIO_FEEDBACK);
+    w->order[(*w->next)++] = w->index;
+    lobot_port_release(w->port);
+    return NULL;
+}
+
+/* waiters of a class get the bus in the order they asked for it */
+static int check_fifo(struct lobot_port_t *port)
+{
+    struct waiter waiters[WAITERS];
+    pthread_t threads[WAITERS];
+    int order[WAITERS];
+    int next = 0;
+    int i;
+
+    lobot_port_acquire(port, LOBOT_PRIO_FEEDBACK);
+    for (i = 0; i < WAITERS; ++i) {
+        waiters[i].port = port;
+        waiters[i].order = order;
+        waiters[i].next = &next;
+        waiters[i].index = i;
+        CHECK(pthread_create(&threads[i], NULL, waiter_thread, &waiters[i]) == 0, "thread");
+        pause_us(10000);
+    }
+    lobot_port_release(port);
+    for (i = 0; i < WAITERS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < WAITERS; ++i) {
+        CHECK(order[i] == i, "waiter %d served as %d", order[i], i);
+    }
+    return 0;
+}
+
+static void* holder_thread(void *arg)
+{
+    struct waiter *w = arg;
+
+    lobot_port_acquire(w->port, LOBOT_PRIO_CONFIG);
+    __atomic_store_n(w->next, 1, __ATOMIC_RELEASE);
+    lobot_port_release(w->port);
+    return NULL;
+}
+
+/* a reactor transaction keeps the bus until its reply or timeout */
+static int check_reactor_hold(struct lobot_port_t *port)
+{
+    struct lobot_reactor_t *reactor;
+    struct waiter w;
+    pthread_t thread;
+    int got = 0;
+
+    reactor = lobot_reactor_create();
+    CHECK(reactor, "reactor");
+    CHECK(lobot_reactor_add_port(reactor, port) == 0, "add port");
+    CHECK(lobot_reactor_submit(reactor, port, 1, LOBOT_CMD_POS_READ, NULL, 0, 2,
+                50000, NULL, NULL) == 0, "submit");
+    CHECK(lobot_reactor_run_once(reactor, 0) >= 0, "run");
+
+    w.port = port;
+    w.next = &got;
+    CHECK(pthread_create(&thread, NULL, holder_thread, &w) == 0, "thread");
+    pause_us(20000);
+    CHECK(!__atomic_load_n(&got, __ATOMIC_ACQUIRE), "bus taken during a transaction");
+    CHECK(lobot_reactor_run(reactor) == 0, "run");
+    pthread_join(thread, NULL);
+    CHECK(got, "bus not handed over");
+    lobot_reactor_destroy(reactor);
+    return 0;
+}
+
+struct timed_hold {
+    struct lobot_port_t *port;
+    uint32_t hold_us;
+    int held;
+};
+
+static void* timed_holder_thread(void *arg)
+{
+    struct timed_hold *h = arg;
+
+    lobot_port_acquire(h->port, LOBOT_PRIO_CONFIG);
+    __atomic_store_n(&h->held, 1, __ATOMIC_RELEASE);
+    pause_us(h->hold_us);
+    lobot_port_release(h->port);
+    return NULL;
+}
+
+static void record_done(void *ctx, struct lobot_port_t *port, lobot_error_t err,
+        const uint8_t *params, size_t nparams)
+{
+    (void)port;
+    (void)err;
+    (void)params;
+    (void)nparams;
+    *(uint64_t *)ctx = monotonic_us();
+}
+
+/* a bus held by another thread holds up its own port, not the others */
+static int check_reactor_no_stall(struct lobot_port_t *a, struct lobot_port_t *b)
+{
+    const uint8_t param = 1;
+    struct lobot_reactor_t *reactor;
+    struct timed_hold hold = {a, 100000, 0};
+    uint64_t start, done_a = 0, done_b = 0;
+    pthread_t thread;
+
+    reactor = lobot_reactor_create();
+    CHECK(reactor, "reactor");
+    CHECK(lobot_reactor_add_port(reactor, a) == 0, "add a");
+    CHECK(lobot_reactor_add_port(reactor, b) == 0, "add b");
+    CHECK(pthread_create(&thread, NULL, timed_holder_thread, &hold) == 0, "thread");
+    while (!__atomic_load_n(&hold.held, __ATOMIC_ACQUIRE)) {
+        pause_us(1000);
+    }
+    start = monotonic_us();
+    CHECK(lobot_reactor_submit(reactor, a, 1, LOBOT_CMD_LOAD_OR_UNLOAD_WRITE, &param, 1,
+                0, 0, record_done, &done_a) == 0, "submit a");
+    CHECK(lobot_reactor_submit(reactor, b, 1, LOBOT_CMD_LOAD_OR_UNLOAD_WRITE, &param, 1,
+                0, 0, record_done, &done_b) == 0, "submit b");
+    CHECK(lobot_reactor_run(reactor) == 0, "run");
+    pthread_join(thread, NULL);
+    CHECK(done_b && done_b - start < 50000, "port b waited %u us",
+            (unsigned)(done_b - start));
+    CHECK(done_a && done_a - start >= 90000, "port a written while held");
+    lobot_reactor_destroy(reactor);
+    return 0;
+}
+
+struct remover {
+    struct lobot_reactor_t *reactor;
+    struct lobot_port_t *ports[2];
+    int ok;
+    int bad_port;
+};
+
+static void remove_other(void *ctx, struct lobot_port_t *port, lobot_error_t err,
+        const uint8_t *params, size_t nparams)
+{
+    struct remover *r = ctx;
+
+    (void)params;
+    (void)nparams;
+    if (err == LOBOT_OK) {
+        r->ok++;
+        lobot_reactor_remove_port(r->reactor, r->ports[r->ports[0] == port]);
+    } else if (err == LOBOT_BAD_PORT) {
+        r->bad_port++;
+    }
+}
+
+/* a callback removing a port whose event is still to be dispatched */
+static int check_reactor_remove(struct lobot_port_t *a, struct lobot_port_t *peer_a,
+        struct lobot_port_t *b, struct lobot_port_t *peer_b)
+{
+    struct lobot_frame_desc desc = {1, LOBOT_CMD_POS_READ, 2, {0xF4, 0x01}};
+    uint8_t reply[LOBOT_FRAME_LEN_MAX];
+    struct remover r;
+    int len;
+
+    r.reactor = lobot_reactor_create();
+    CHECK(r.reactor, "reactor");
+    r.ports[0] = a;
+    r.ports[1] = b;
+    r.ok = r.bad_port = 0;
+    CHECK(lobot_reactor_add_port(r.reactor, a) == 0, "add a");
+    CHECK(lobot_reactor_add_port(r.reactor, b) == 0, "add b");
+    CHECK(lobot_reactor_submit(r.reactor, a, 1, LOBOT_CMD_POS_READ, NULL, 0, 2,
+                50000, remove_other, &r) == 0, "submit a");
+    CHECK(lobot_reactor_submit(r.reactor, b, 1, LOBOT_CMD_POS_READ, NULL, 0, 2,
+                50000, remove_other, &r) == 0, "submit b");
+    /* both replies are waiting, so one epoll_wait reports both ports */
+    len = lobot_frames_encode(&desc, 1, reply, sizeof(reply));
+    CHECK(lobot_port_write(peer_a, reply, len) == len, "reply a");
+    CHECK(lobot_port_write(peer_b, reply, len) == len, "reply b");
+    CHECK(lobot_reactor_run_once(r.reactor, 50000) >= 0, "run");
+    CHECK(r.ok == 1 && r.bad_port == 1, "%d ok, %d removed", r.ok, r.bad_port);
+    CHECK(lobot_reactor_pending(r.reactor) == 0, "transactions left");
+    lobot_reactor_destroy(r.reactor);
+    return 0;
+}
+
+struct drain {
+    int fd;
+    size_t want;
+    size_t total;
+};
+
+static void* drain_thread(void *arg)
+{
+    struct drain *d = arg;
+    uint8_t buffer[256];
+    uint64_t end = monotonic_us() + 2000000;
+    ssize_t ret;
+
+    while (d->total < d->want && monotonic_us() < end) {
+        ret = read(d->fd, buffer, sizeof(buffer));
+        if (ret > 0) {
+            d->total += ret;
+        }
+        pause_us(1000);
+    }
+    return NULL;
+}
+
+/* a batch larger than the driver buffer is written whole while it drains */
+static int check_pty_write(void)
+{
+    static uint8_t batch[16384];
+    struct lobot_port_t *port;
+    struct drain d = {-1, sizeof(batch), 0};
+    pthread_t thread;
+    int ret;
+
+    port = lobot_port_open_transport(&lobot_transport_pty, NULL, NULL, NULL);
+    CHECK(port != NULL, "pty");
+    d.fd = open(lobot_port_peer(port), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    CHECK(d.fd >= 0, "peer");
+    CHECK(pthread_create(&thread, NULL, drain_thread, &d) == 0, "thread");
+    ret = lobot_port_write(port, batch, sizeof(batch));
+    pthread_join(thread, NULL);
+    close(d.fd);
+    lobot_port_close(port);
+    CHECK(ret == (int)sizeof(batch), "short write %d", ret);
+    CHECK(d.total == sizeof(batch), "peer read %zu", d.total);
+    return 0;
+}
+
+/* a failed open keeps the transport's cause in errno */
+static int check_open_errno(void)
+{
+    errno = 0;
+    CHECK(lobot_port_open_transport(&lobot_transport_unix,
+            "/nonexistent/lobot.sock", NULL, NULL) == NULL, "opened");
+    CHECK(errno == ENOENT, "errno %d", errno);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_port_t *ends[2], *others[2];
+    int ret;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    CHECK(lobot_port_open_loopback(others, NULL) == 0, "loopback");
+    ret = check_poll_partial(ends[0], ends[1]);
+    if (ret == 0) {
+        ret = check_fifo(ends[0]);
+    }
+    if (ret == 0) {
+        ret = check_reactor_hold(ends[0]);
+    }
+    if (ret == 0) {
+        ret = check_reactor_no_stall(ends[0], others[0]);
+    }
+    if (ret == 0) {
+        ret = check_reactor_remove(ends[0], ends[1], others[0], others[1]);
+    }
+    if (ret == 0) {
+        ret = check_pty_write();
+    }
+    if (ret == 0) {
+        ret = check_open_errno();
+    }
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    lobot_port_close(others[0]);
+    lobot_port_close(others[1]);
+    return ret;
+}
@@ -0,0 +1,232 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Reactor checks against two simulated buses: replies, per port order,
+ * timeouts, a full queue, submissions from callbacks and ports running side
+ * by side. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/reactor.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+#define BUSES 2
+/* servo turnaround, long enough to tell side by side ports from queued ones */
+#define REPLY_DELAY_US 30000
+
+struct bus {
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    uint8_t id;
+};
+
+/* completions recorded by done */
+struct log {
+    int order[LOBOT_REACTOR_QUEUE_LEN + 1];
+    lobot_error_t err[LOBOT_REACTOR_QUEUE_LEN + 1];
+    uint16_t value[LOBOT_REACTOR_QUEUE_LEN + 1];
+    int n;
+};
+
+struct call {
+    struct log *log;
+    int index;
+    /* submit a position read of this servo when done, 0 for none */
+    struct lobot_reactor_t *reactor;
+    uint8_t resubmit_id;
+};
+
+static void done(void *ctx, struct lobot_port_t *port, lobot_error_t err,
+        const uint8_t *params, size_t nparams)
+{
+    struct call *c = ctx;
+    struct log *log = c->log;
+    uint8_t id;
+
+    log->order[log->n] = c->index;
+    log->err[log->n] = err;
+    log->value[log->n] = nparams >= 2 ? (uint16_t)(params[0] | params[1] << 8) :
+        nparams == 1 ? params[0] : 0;
+    log->n++;
+    if (c->resubmit_id) {
+        id = c->resubmit_id;
+        c->index += 100;
+        c->resubmit_id = 0;
+        /* queued behind a burst of writes still going out */
+        lobot_reactor_submit(c->reactor, port, id, LOBOT_CMD_POS_READ, NULL, 0, 2,
+                500000, done, c);
+    }
+}
+
+static int bus_open(struct bus *bus, uint8_t id)
+{
+    struct lobot_sim_config config;
+
+    CHECK(lobot_port_open_loopback(bus->ends, NULL) == 0, "loopback");
+    memset(&config, 0, sizeof(config));
+    bus->id = id;
+    config.ids = &bus->id;
+    config.n = 1;
+    config.reply_delay_us = REPLY_DELAY_US;
+    bus->sim = lobot_sim_create(bus->ends[1], &config);
+    CHECK(bus->sim && lobot_sim_start(bus->sim) == 0, "sim");
+    return 0;
+}
+
+static void bus_close(struct bus *bus)
+{
+    lobot_sim_destroy(bus->sim);
+    lobot_port_close(bus->ends[0]);
+    lobot_port_close(bus->ends[1]);
+}
+
+/* replies decode, complete in submission order, a missing servo times out */
+static int check_order(struct lobot_reactor_t *reactor, struct bus *bus)
+{
+    const uint8_t move[] = {0x2C, 0x01, 0x00, 0x00};
+    struct lobot_sim_servo servo;
+    struct call calls[4];
+    struct log log;
+    int i;
+
+    memset(&log, 0, sizeof(log));
+    memset(calls, 0, sizeof(calls));
+    for (i = 0; i < 4; ++i) {
+        calls[i].log = &log;
+        calls[i].index = i;
+    }
+    CHECK(lobot_reactor_submit(reactor, bus->ends[0], bus->id, LOBOT_CMD_MOVE_TIME_WRITE,
+                move, sizeof(move), 0, LOBOT_PORT_TIMEOUT_DEFAULT, done, &calls[0]) == 0,
+            "submit move");
+    CHECK(lobot_reactor_submit(reactor, bus->ends[0], bus->id, LOBOT_CMD_ID_READ,
+                NULL, 0, 1, LOBOT_PORT_TIMEOUT_DEFAULT, done, &calls[1]) == 0, "submit id");
+    CHECK(lobot_reactor_submit(reactor, bus->ends[0], bus->id + 1, LOBOT_CMD_POS_READ,
+                NULL, 0, 2, 5000, done, &calls[2]) == 0, "submit missing");
+    CHECK(lobot_reactor_submit(reactor, bus->ends[0], bus->id, LOBOT_CMD_POS_READ,
+                NULL, 0, 2, LOBOT_PORT_TIMEOUT_DEFAULT, done, &calls[3]) == 0,
+            "submit position");
+    CHECK(lobot_reactor_pending(reactor) == 4, "%zu pending", lobot_reactor_pending(reactor));
+    CHECK(lobot_reactor_run(reactor) == 0, "run");
+    CHECK(lobot_reactor_pending(reactor) == 0, "left pending");
+
+    CHECK(log.n == 4, "%d completions", log.n);
+    for (i = 0; i < 4; ++i) {
+        CHECK(log.order[i] == i, "completion %d was transaction %d", i, log.order[i]);
+    }
+    CHECK(log.err[0] == LOBOT_OK && log.err[1] == LOBOT_OK && log.err[3] == LOBOT_OK,
+            "errors %d %d %d", log.err[0], log.err[1], log.err[3]);
+    CHECK(log.value[1] == bus->id, "id read %u", log.value[1]);
+    CHECK(log.err[2] == LOBOT_TIMEOUT, "missing servo: %d", log.err[2]);
+    CHECK(lobot_sim_servo(bus->sim, bus->id, &servo) == 0, "servo");
+    CHECK(servo.target == 300 && log.value[3] == servo.position, "position %u, sim %u",
+            log.value[3], servo.position);
+    return 0;
+}
+
+/* a full queue refuses, and a callback may queue more work */
+static int check_queue(struct lobot_reactor_t *reactor, struct bus *bus)
+{
+    static struct call calls[LOBOT_REACTOR_QUEUE_LEN];
+    static struct log log;
+    const uint8_t led = 0;
+    int i;
+
+    memset(&log, 0, sizeof(log));
+    memset(calls, 0, sizeof(calls));
+    for (i = 0; i < LOBOT_REACTOR_QUEUE_LEN; ++i) {
+        calls[i].log = &log;
+        calls[i].index = i;
+        CHECK(lobot_reactor_submit(reactor, bus->ends[0], bus->id, LOBOT_CMD_LED_CTRL_WRITE,
+                    &led, 1, 0, LOBOT_PORT_TIMEOUT_DEFAULT, done, &calls[i]) == 0,
+                "submit %d", i);
+    }
+    CHECK(lobot_reactor_submit(reactor, bus->ends[0], bus->id, LOBOT_CMD_LED_CTRL_WRITE,
+                &led, 1, 0, LOBOT_PORT_TIMEOUT_DEFAULT, NULL, NULL) == -EAGAIN,
+            "full queue accepted a transaction");
+    calls[LOBOT_REACTOR_QUEUE_LEN - 1].reactor = reactor;
+    calls[LOBOT_REACTOR_QUEUE_LEN - 1].resubmit_id = bus->id;
+    CHECK(lobot_reactor_run(reactor) == 0, "run");
+    CHECK(log.n == LOBOT_REACTOR_QUEUE_LEN + 1, "%d completions", log.n);
+    CHECK(log.order[LOBOT_REACTOR_QUEUE_LEN] == LOBOT_REACTOR_QUEUE_LEN - 1 + 100 &&
+            log.err[LOBOT_REACTOR_QUEUE_LEN] == LOBOT_OK, "resubmitted read failed: %d",
+            log.err[LOBOT_REACTOR_QUEUE_LEN]);
+    return 0;
+}
+
+/* reads on different ports wait for their replies side by side */
+static int check_parallel(struct lobot_reactor_t *reactor, struct bus *buses)
+{
+    struct call calls[BUSES];
+    struct log log;
+    uint64_t start, elapsed;
+    int i;
+
+    memset(&log, 0, sizeof(log));
+    memset(calls, 0, sizeof(calls));
+    for (i = 0; i < BUSES; ++i) {
+        calls[i].log = &log;
+        calls[i].index = i;
+        CHECK(lobot_reactor_submit(reactor, buses[i].ends[0], buses[i].id,
+                    LOBOT_CMD_POS_READ, NULL, 0, 2, 500000, done, &calls[i]) == 0,
+                "submit %d", i);
+    }
+    start = monotonic_us();
+    CHECK(lobot_reactor_run(reactor) == 0, "run");
+    elapsed = monotonic_us() - start;
+    CHECK(log.n == BUSES && log.err[0] == LOBOT_OK && log.err[1] == LOBOT_OK,
+            "%d completions", log.n);
+    CHECK(elapsed < BUSES * REPLY_DELAY_US, "reads took %u us, ports didn't overlap",
+            (unsigned)elapsed);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_reactor_t *reactor;
+    struct bus buses[BUSES];
+    int ret = 0, i;
+
+    for (i = 0; i < BUSES; ++i) {
+        CHECK(bus_open(&buses[i], (uint8_t)(i + 1)) == 0, "bus %d", i);
+    }
+    reactor = lobot_reactor_create();
+    CHECK(reactor, "reactor");
+    for (i = 0; i < BUSES; ++i) {
+        CHECK(lobot_reactor_add_port(reactor, buses[i].ends[0]) == 0, "add port %d", i);
+    }
+
+    ret = check_order(reactor, &buses[0]);
+    if (ret == 0) {
+        ret = check_queue(reactor, &buses[0]);
+    }
+    if (ret == 0) {
+        ret = check_parallel(reactor, buses);
+    }
+
+    lobot_reactor_destroy(reactor);
+    for (i = 0; i < BUSES; ++i) {
+        bus_close(&buses[i]);
+    }
+    return ret;
+}
@@ -0,0 +1,205 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+/* Flight recorder checks on a loopback pair. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/protocol.h"
+#include "lobot_servo/recorder.h"
+
+#include "test_util.h"
+
+#define RING "test_recorder.ring"
+#define RING_LEN 512
+
+/* frames of 10 bytes bring the receive ring's end 2 bytes away after 51 */
+#define FRAMES_TO_WRAP 51
+
+/* a read landing across the receive ring's wrap is recorded as one chunk */
+static int check_rx_wrap(struct lobot_port_t *tx, struct lobot_port_t *rx)
+{
+    struct lobot_frame_desc desc = {1, LOBOT_CMD_MOVE_TIME_WRITE, 4, {0}};
+    const struct lobot_record *r, *last = NULL;
+    uint8_t frame[LOBOT_FRAME_LEN_MAX];
+    struct lobot_recorder_t *rec;
+    struct lobot_capture_t *cap;
+    size_t i, n;
+    int len;
+
+    rec = lobot_recorder_open(RING, RING_LEN);
+    CHECK(rec, "recorder");
+    CHECK(lobot_port_set_recorder(rx, rec) == 0, "tap");
+    for (i = 0; i <= FRAMES_TO_WRAP; ++i) {
+        desc.params[0] = (uint8_t)i;
+        len = lobot_frames_encode(&desc, 1, frame, sizeof(frame));
+        CHECK(lobot_port_write(tx, frame, len) == len, "write");
+        CHECK(lobot_port_poll(rx, 100000) > 0, "poll");
+        CHECK(lobot_port_recv_frame(rx, frame, sizeof(frame)) == len, "frame %zu", i);
+    }
+    lobot_port_set_recorder(rx, NULL);
+    lobot_recorder_close(rec);
+
+    cap = lobot_capture_open(RING);
+    CHECK(cap, "capture");
+    n = lobot_capture_count(cap);
+    for (i = 0; i < n; ++i) {
+        r = lobot_capture_get(cap, i);
+        if (r && r->type == LOBOT_RECORD_RX) {
+            last = r;
+        }
+    }
+    CHECK(last && last->len == len && !(last->flags & LOBOT_RECORD_MORE),
+            "last read recorded as %u bytes", last ? last->len : 0);
+    CHECK(memcmp(last->payload, frame, len) == 0, "last read garbled");
+    lobot_capture_close(cap);
+    unlink(RING);
+    return 0;
+}
+
+/* a tapped port records its writes, its reads and the frames decoded from them */
+static int check_tap(struct lobot_port_t *tx, struct lobot_port_t *rx)
+{
+    struct lobot_frame_desc desc = {5, LOBOT_CMD_MOVE_TIME_WRITE, 4, {0xF4, 0x01, 0xE8, 0x03}};
+    const struct lobot_record *r;
+    uint8_t frame[LOBOT_FRAME_LEN_MAX];
+    struct lobot_recorder_t *rec;
+    struct lobot_capture_t *cap;
+    int seen[LOBOT_RECORD_SAMPLE + 1] = {0};
+    size_t i, n;
+    int len;
+
+    rec = lobot_recorder_open(RING, RING_LEN);
+    CHECK(rec, "recorder");
+    CHECK(lobot_port_set_recorder(tx, rec) == 0, "tap tx");
+    CHECK(lobot_port_set_recorder(rx, rec) == 0, "tap rx");
+    len = lobot_frames_encode(&desc, 1, frame, sizeof(frame));
+    CHECK(lobot_port_write(tx, frame, len) == len, "write");
+    CHECK(lobot_port_poll(rx, 100000) > 0, "poll");
+    CHECK(lobot_port_recv_frame(rx, frame, sizeof(frame)) == len, "frame");
+    lobot_port_set_recorder(tx, NULL);
+    lobot_port_set_recorder(rx, NULL);
+    lobot_recorder_close(rec);
+
+    cap = lobot_capture_open(RING);
+    CHECK(cap, "capture");
+    n = lobot_capture_count(cap);
+    for (i = 0; i < n; ++i) {
+        r = lobot_capture_get(cap, i);
+        CHECK(r && r->seq == i + 1, "record %zu out of sequence", i);
+        CHECK(r->type >= LOBOT_RECORD_TX && r->type <= LOBOT_RECORD_SAMPLE, "type %u",
+                r->type);
+        seen[r->type]++;
+        if (r->type == LOBOT_RECORD_TX) {
+            CHECK(r->len == len && memcmp(r->payload, frame, len) == 0,
+                    "write %zu garbled", i);
+        }
+        /* frames are recorded by ID and opcode, with their params only */
+        if (r->type == LOBOT_RECORD_FRAME) {
+            CHECK(r->id == 5 && r->cmd == LOBOT_CMD_MOVE_TIME_WRITE && r->len == 4 &&
+                    memcmp(r->payload, desc.params, 4) == 0, "frame %zu garbled", i);
+        }
+    }
+    CHECK(seen[LOBOT_RECORD_TX] == 1 && seen[LOBOT_RECORD_RX] >= 1 &&
+            seen[LOBOT_RECORD_FRAME] == 1 && seen[LOBOT_RECORD_SAMPLE] == 0,
+            "%d writes, %d reads, %d frames", seen[LOBOT_RECORD_TX],
+            seen[LOBOT_RECORD_RX], seen[LOBOT_RECORD_FRAME]);
+    lobot_capture_close(cap);
+    unlink(RING);
+    return 0;
+}
+
+/* long chunks span records, a full ring keeps the newest ones */
+static int check_ring(void)
+{
+    const struct lobot_record *r;
+    struct lobot_recorder_t *rec;
+    struct lobot_capture_t *cap;
+    uint8_t data[2 * LOBOT_RECORD_PAYLOAD + 5];
+    uint16_t value = 500;
+    size_t i, n;
+
+    for (i = 0; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)i;
+    }
+    rec = lobot_recorder_open(RING, 8);
+    CHECK(rec, "recorder");
+    lobot_recorder_put(rec, LOBOT_RECORD_TX, 1, 0xFF, data, sizeof(data));
+    lobot_recorder_sample(rec, 1, LOBOT_CMD_POS_READ, &value, sizeof(value));
+    lobot_recorder_close(rec);
+
+    cap = lobot_capture_open(RING);
+    CHECK(cap, "capture");
+    CHECK(lobot_capture_count(cap) == 4, "%zu records", lobot_capture_count(cap));
+    for (i = 0; i < 3; ++i) {
+        r = lobot_capture_get(cap, i);
+        CHECK(r && r->type == LOBOT_RECORD_TX, "chunk %zu", i);
+        CHECK(!(r->flags & LOBOT_RECORD_MORE) == (i == 2), "chunk %zu flags %u", i,
+                r->flags);
+        n = i < 2 ? LOBOT_RECORD_PAYLOAD : 5;
+        CHECK(r->len == n && memcmp(r->payload, data + i * LOBOT_RECORD_PAYLOAD, n) == 0,
+                "chunk %zu garbled", i);
+    }
+    r = lobot_capture_get(cap, 3);
+    CHECK(r && r->type == LOBOT_RECORD_SAMPLE && r->cmd == LOBOT_CMD_POS_READ &&
+            r->len == sizeof(value) && memcmp(r->payload, &value, sizeof(value)) == 0,
+            "sample");
+    lobot_capture_close(cap);
+
+    rec = lobot_recorder_open(RING, 8);
+    CHECK(rec, "recorder");
+    for (i = 0; i < 20; ++i) {
+        value = (uint16_t)i;
+        lobot_recorder_sample(rec, 1, LOBOT_CMD_POS_READ, &value, sizeof(value));
+    }
+    lobot_recorder_close(rec);
+
+    cap = lobot_capture_open(RING);
+    CHECK(cap, "capture");
+    CHECK(lobot_capture_count(cap) == 8, "%zu records", lobot_capture_count(cap));
+    for (i = 0; i < 8; ++i) {
+        r = lobot_capture_get(cap, i);
+        CHECK(r && r->seq == 12 + i + 1, "record %zu has seq %u", i, r ? r->seq : 0);
+        memcpy(&value, r->payload, sizeof(value));
+        CHECK(value == 12 + i, "record %zu holds %u", i, value);
+    }
+    lobot_capture_close(cap);
+    unlink(RING);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_port_t *ends[2];
+    int ret;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    ret = check_rx_wrap(ends[0], ends[1]);
+    if (ret == 0) {
+        ret = check_tap(ends[0], ends[1]);
+    }
+    if (ret == 0) {
+        ret = check_ring();
+    }
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
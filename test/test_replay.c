@@ -0,0 +1,81 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+/* Replay of a wrapped capture ring. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/protocol.h"
+#include "lobot_servo/recorder.h"
+
+#include "test_util.h"
+
+#define RING "test_replay.ring"
+#define RING_LEN 4
+
+/* the oldest record held continues a write whose head was overwritten */
+static int record(uint8_t *request, int *request_len, uint8_t *reply, int *reply_len)
+{
+    const uint8_t pos[] = {0xF4, 0x01};
+    uint8_t batch[3 * LOBOT_RECORD_PAYLOAD];
+    struct lobot_recorder_t *rec;
+
+    rec = lobot_recorder_open(RING, RING_LEN);
+    CHECK(rec, "recorder");
+    memset(batch, 0xAA, sizeof(batch));
+    *request_len = build_frame(1, LOBOT_CMD_POS_READ, NULL, 0, request);
+    *reply_len = build_frame(1, LOBOT_CMD_POS_READ, pos, sizeof(pos), reply);
+    lobot_recorder_put(rec, LOBOT_RECORD_TX, 0xFF, 0xFF, batch, sizeof(batch));
+    lobot_recorder_put(rec, LOBOT_RECORD_TX, 1, LOBOT_CMD_POS_READ, request, *request_len);
+    lobot_recorder_put(rec, LOBOT_RECORD_RX, 0xFF, 0xFF, reply, *reply_len);
+    lobot_recorder_close(rec);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_replay_config config;
+    struct lobot_port_t *port;
+    uint8_t request[LOBOT_FRAME_LEN_MAX];
+    uint8_t reply[LOBOT_FRAME_LEN_MAX];
+    uint8_t got[LOBOT_FRAME_LEN_MAX];
+    int request_len, reply_len, ret;
+    uint64_t start;
+
+    CHECK(record(request, &request_len, reply, &reply_len) == 0, "record");
+
+    memset(&config, 0, sizeof(config));
+    port = lobot_port_open_transport(&lobot_transport_replay, RING, &config, NULL);
+    CHECK(port, "replay");
+    ret = lobot_port_transact(port, request, request_len, got, reply_len, 100000);
+    CHECK(ret == reply_len && memcmp(got, reply, reply_len) == 0,
+            "transact after a wrapped chunk: %d", ret);
+
+    /* nothing left to play, as fast as possible playback doesn't wait */
+    start = monotonic_us();
+    CHECK(lobot_port_poll(port, 200000) == 0, "poll");
+    CHECK(monotonic_us() - start < 50000, "poll slept %u us",
+            (unsigned)(monotonic_us() - start));
+
+    lobot_port_close(port);
+    unlink(RING);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Bus scan checks against the simulated bus, clean and with corrupted
+ * replies. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+static const uint8_t servo_ids[] = {1, 2, 5, 9, 17, 40, 120, LOBOT_ID_MAX};
+#define N_SERVOS (sizeof(servo_ids))
+
+/* scan a simulated bus whose replies are corrupted at corrupt_rate */
+static int scan(float corrupt_rate, const uint8_t* ids, size_t n,
+        uint8_t* found, size_t* n_found, size_t* n_corrupt)
+{
+    struct lobot_sim_config config;
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    lobot_error_t err;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    memset(&config, 0, sizeof(config));
+    config.ids = servo_ids;
+    config.n = N_SERVOS;
+    config.corrupt_rate = corrupt_rate;
+    config.seed = 7;
+    sim = lobot_sim_create(ends[1], &config);
+    CHECK(sim && lobot_sim_start(sim) == 0, "sim");
+
+    err = lobot_scan(ends[0], ids, n, found, n_found, n_corrupt);
+
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    CHECK(err == LOBOT_OK, "scan: %d", err);
+    return 0;
+}
+
+/* every found ID is on the bus, and found ones are in ascending order */
+static int check_found(const uint8_t* found, size_t n_found)
+{
+    size_t i, j;
+
+    for (i = 0; i < n_found; ++i) {
+        for (j = 0; j < N_SERVOS && servo_ids[j] != found[i]; ++j);
+        CHECK(j < N_SERVOS, "servo %u isn't on the bus", found[i]);
+        CHECK(i == 0 || found[i - 1] < found[i], "not ascending at %zu", i);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    const uint8_t some[] = {5, 6, 120, 5};
+    uint8_t found[LOBOT_ID_MAX + 1];
+    size_t n_found, n_corrupt;
+
+    /* a clean bus: every servo, nothing else */
+    CHECK(scan(0, NULL, 0, found, &n_found, &n_corrupt) == 0, "full scan");
+    CHECK(n_found == N_SERVOS && n_corrupt == 0, "found %zu, %zu corrupt",
+            n_found, n_corrupt);
+    CHECK(memcmp(found, servo_ids, N_SERVOS) == 0, "wrong servos");
+
+    /* a list of IDs probes only those, each once */
+    CHECK(scan(0, some, sizeof(some), found, &n_found, NULL) == 0, "list scan");
+    CHECK(n_found == 2 && found[0] == 5 && found[1] == 120, "found %zu", n_found);
+
+    /* corrupted replies are reported apart, the servos that answered cleanly
+     * are still returned */
+    CHECK(scan(0.5f, NULL, 0, found, &n_found, &n_corrupt) == 0, "noisy scan");
+    CHECK(check_found(found, n_found) == 0, "noisy scan");
+    CHECK(n_found > 0 && n_corrupt > 0, "found %zu, %zu corrupt", n_found, n_corrupt);
+    CHECK(n_found + n_corrupt <= N_SERVOS, "found %zu, %zu corrupt", n_found, n_corrupt);
+
+    /* with every reply corrupted nothing is found, but the scan succeeds */
+    CHECK(scan(1, NULL, 0, found, &n_found, &n_corrupt) == 0, "corrupt scan");
+    CHECK(n_found == 0 && n_corrupt > 0, "found %zu, %zu corrupt", n_found, n_corrupt);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Bus scheduler checks against the simulated bus: airtime, admission,
+ * earliest deadline first order and periodic releases. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/sched.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+#define PERIOD_US 10000
+
+/* results recorded by done */
+struct log {
+    int task[64];
+    int err[64];
+    int replied[64];
+    int n;
+};
+
+static void done(void *ctx, const struct lobot_sched_result *result)
+{
+    struct log *log = ctx;
+
+    if (log->n < 64) {
+        log->task[log->n] = result->task;
+        log->err[log->n] = result->err;
+        log->replied[log->n] = result->reply != NULL;
+        log->n++;
+    }
+}
+
+static void read_task(struct lobot_sched_task *task, uint8_t id, uint32_t period_us,
+        uint32_t deadline_us, struct log *log)
+{
+    memset(task, 0, sizeof(*task));
+    task->id = id;
+    task->cmd = LOBOT_CMD_POS_READ;
+    task->period_us = period_us;
+    task->deadline_us = deadline_us;
+    task->done = done;
+    task->ctx = log;
+}
+
+/* airtime follows the baud rate, tasks are admitted while they fit the bus */
+static int check_admission(struct lobot_port_t *port)
+{
+    struct lobot_sched_config config = {115200, 500, 0};
+    struct lobot_sched_task task;
+    struct lobot_sched_stats stats;
+    struct lobot_sched_t *sched;
+    int handles[LOBOT_SCHED_TASKS_MAX];
+    int i;
+
+    sched = lobot_sched_create(port, &config);
+    CHECK(sched, "sched");
+
+    /* 14 bytes of 86.8 us and the turnaround, or a 10 byte write alone */
+    read_task(&task, 1, PERIOD_US, 0, NULL);
+    CHECK(lobot_sched_airtime_us(sched, &task) == 1716, "read airtime %u",
+            lobot_sched_airtime_us(sched, &task));
+    task.cmd = LOBOT_CMD_MOVE_TIME_WRITE;
+    task.nparams = 4;
+    CHECK(lobot_sched_airtime_us(sched, &task) == 869, "write airtime %u",
+            lobot_sched_airtime_us(sched, &task));
+
+    /* reads taking 17% of the bus each: five fit in the default 90% */
+    read_task(&task, 1, PERIOD_US, 0, NULL);
+    for (i = 0; i < 5; ++i) {
+        handles[i] = lobot_sched_add(sched, &task);
+        CHECK(handles[i] >= 0, "task %d refused: %d", i, handles[i]);
+    }
+    CHECK(lobot_sched_add(sched, &task) == -ENOSPC, "bus overcommitted");
+    lobot_sched_stats(sched, &stats);
+    CHECK(stats.load > 0.85f && stats.load <= 0.9f, "load %f", stats.load);
+    CHECK(lobot_sched_remove(sched, handles[0]) == 0, "remove");
+    CHECK(lobot_sched_remove(sched, handles[0]) == -ENOENT, "removed twice");
+    CHECK(lobot_sched_add(sched, &task) >= 0, "room not given back");
+    lobot_sched_destroy(sched);
+
+    /* light tasks fill the table before the bus */
+    sched = lobot_sched_create(port, &config);
+    CHECK(sched, "sched");
+    read_task(&task, 1, 10000000, 0, NULL);
+    task.cmd = LOBOT_CMD_MOVE_STOP;
+    for (i = 0; i < LOBOT_SCHED_TASKS_MAX; ++i) {
+        CHECK(lobot_sched_add(sched, &task) >= 0, "task %d refused", i);
+    }
+    CHECK(lobot_sched_add(sched, &task) == -EMFILE, "table overfilled");
+    lobot_sched_destroy(sched);
+    return 0;
+}
+
+/* released together, the earlier deadline goes first */
+static int check_edf(struct lobot_port_t *port)
+{
+    struct lobot_sched_task task;
+    struct lobot_sched_t *sched;
+    struct log log;
+    int late, early, ran = 0;
+
+    memset(&log, 0, sizeof(log));
+    sched = lobot_sched_create(port, NULL);
+    CHECK(sched, "sched");
+    read_task(&task, 1, 0, 50000, &log);
+    late = lobot_sched_add(sched, &task);
+    read_task(&task, 2, 0, 20000, &log);
+    early = lobot_sched_add(sched, &task);
+    CHECK(late >= 0 && early >= 0, "add");
+
+    while (ran < 2) {
+        CHECK(lobot_sched_run_once(sched, 100000) > 0, "nothing ran");
+        ran = log.n;
+    }
+    CHECK(log.task[0] == early && log.task[1] == late, "ran %d then %d",
+            log.task[0], log.task[1]);
+    CHECK(log.err[0] == 0 && log.err[1] == 0 && log.replied[0] && log.replied[1],
+            "errors %d %d", log.err[0], log.err[1]);
+    CHECK(lobot_sched_remove(sched, early) == -ENOENT, "one-shot task kept");
+    lobot_sched_destroy(sched);
+    return 0;
+}
+
+/* a periodic task runs once per period */
+static int check_periodic(struct lobot_port_t *port)
+{
+    struct lobot_sched_task task;
+    struct lobot_sched_stats stats;
+    struct lobot_sched_t *sched;
+    struct log log;
+    uint64_t end;
+    int i;
+
+    memset(&log, 0, sizeof(log));
+    sched = lobot_sched_create(port, NULL);
+    CHECK(sched, "sched");
+    read_task(&task, 1, PERIOD_US, 0, &log);
+    CHECK(lobot_sched_add(sched, &task) >= 0, "add");
+
+    end = monotonic_us() + 10 * PERIOD_US;
+    while (monotonic_us() < end) {
+        CHECK(lobot_sched_run_once(sched, PERIOD_US) >= 0, "run");
+    }
+    lobot_sched_stats(sched, &stats);
+    CHECK(log.n >= 8 && log.n <= 11, "%d jobs in 10 periods", log.n);
+    CHECK(stats.jobs == (uint64_t)log.n, "%u jobs counted", (unsigned)stats.jobs);
+    for (i = 0; i < log.n; ++i) {
+        CHECK(log.err[i] == 0 && log.replied[i], "job %d: %d", i, log.err[i]);
+    }
+    lobot_sched_destroy(sched);
+    return 0;
+}
+
+int main(void)
+{
+    const uint8_t ids[] = {1, 2};
+    struct lobot_sim_config config;
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    int ret;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    memset(&config, 0, sizeof(config));
+    config.ids = ids;
+    config.n = sizeof(ids);
+    sim = lobot_sim_create(ends[1], &config);
+    CHECK(sim && lobot_sim_start(sim) == 0, "sim");
+
+    ret = check_admission(ends[0]);
+    if (ret == 0) {
+        ret = check_edf(ends[0]);
+    }
+    if (ret == 0) {
+        ret = check_periodic(ends[0]);
+    }
+
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+/* Shadow register cache checks against the simulated bus. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+static int check_shadow(struct lobot_port_t *port)
+{
+    struct lobot_shadow_stats stats;
+    uint8_t id;
+
+    CHECK(lobot_shadow_enable(port, 0) == LOBOT_OK, "enable");
+
+    /* an unacknowledged write says nothing about the servo's ID */
+    CHECK(lobot_set_pos(port, 1, 400, 100) == LOBOT_OK, "set_pos");
+    CHECK(lobot_set_offset(port, 1, 5) == LOBOT_OK, "set_offset");
+    CHECK(lobot_set_limit(port, 1, 10, 990) == LOBOT_OK, "set_limit");
+    CHECK(lobot_get_id(port, 1, &id) == LOBOT_OK && id == 1, "get_id");
+    CHECK(lobot_shadow_stats(port, &stats) == LOBOT_OK, "stats");
+    CHECK(stats.read_hits == 0, "ID read answered from cache");
+    CHECK(lobot_get_id(port, 1, &id) == LOBOT_OK && id == 1, "get_id");
+    CHECK(lobot_shadow_stats(port, &stats) == LOBOT_OK, "stats");
+    CHECK(stats.read_hits == 1, "acknowledged ID not cached");
+
+    /* a repeated move is elided, until unloading drops the held position */
+    CHECK(lobot_set_pos(port, 1, 400, 100) == LOBOT_OK, "set_pos");
+    CHECK(lobot_shadow_stats(port, &stats) == LOBOT_OK, "stats");
+    CHECK(stats.writes_elided == 1, "%u writes elided", (unsigned)stats.writes_elided);
+    CHECK(lobot_set_load(port, 1, 0) == LOBOT_OK, "set_load");
+    CHECK(lobot_set_pos(port, 1, 400, 100) == LOBOT_OK, "set_pos");
+    CHECK(lobot_shadow_stats(port, &stats) == LOBOT_OK, "stats");
+    CHECK(stats.writes_elided == 1, "move after unload elided");
+
+    lobot_shadow_disable(port);
+    CHECK(lobot_shadow_stats(port, &stats) == LOBOT_BAD_ARG, "still enabled");
+    return 0;
+}
+
+int main(void)
+{
+    const uint8_t ids[] = {1};
+    struct lobot_sim_config config;
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    int ret;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    memset(&config, 0, sizeof(config));
+    config.ids = ids;
+    config.n = sizeof(ids);
+    sim = lobot_sim_create(ends[1], &config);
+    CHECK(sim && lobot_sim_start(sim) == 0, "sim");
+
+    ret = check_shadow(ends[0]);
+
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
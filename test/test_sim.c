@@ -0,0 +1,239 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+/* Simulated bus checks on a loopback pair. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <time.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/protocol.h"
+#include "lobot_servo/servo.h"
+#include "lobot_servo/sim.h"
+
+#include "test_util.h"
+
+static const uint8_t ids[] = {1, 2};
+
+/* CPU time of the process, simulator thread included */
+static uint64_t cpu_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void on_header(void *ctx)
+{
+    *(uint64_t *)ctx = monotonic_us();
+}
+
+static struct lobot_sim_t* sim_open(struct lobot_port_t *ends[2], uint32_t baud,
+        int echo)
+{
+    struct lobot_sim_config config;
+    struct lobot_sim_t *sim;
+
+    if (lobot_port_open_loopback(ends, NULL) != 0) {
+        return NULL;
+    }
+    memset(&config, 0, sizeof(config));
+    config.ids = ids;
+    config.n = sizeof(ids);
+    config.baud = baud;
+    config.echo = echo;
+    sim = lobot_sim_create(ends[1], &config);
+    if (sim && lobot_sim_start(sim) != 0) {
+        lobot_sim_destroy(sim);
+        sim = NULL;
+    }
+    if (sim == NULL) {
+        lobot_port_close(ends[0]);
+        lobot_port_close(ends[1]);
+    }
+    return sim;
+}
+
+static void sim_close(struct lobot_sim_t *sim, struct lobot_port_t *ends[2])
+{
+    lobot_sim_destroy(sim);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+}
+
+/* reply bytes go out one byte time apart, the header arrives before the tail */
+static int check_paced(struct lobot_port_t *host)
+{
+    uint8_t request[LOBOT_FRAME_LEN_MAX];
+    uint8_t reply[LOBOT_FRAME_LEN_MAX];
+    uint64_t header_us = 0, end_us;
+    int len, ret;
+
+    len = build_frame(1, LOBOT_CMD_POS_READ, NULL, 0, request);
+    CHECK(lobot_port_write(host, request, len) == len, "write");
+    ret = lobot_port_recv_reply(host, request, reply, len + 2, 500000, on_header, &header_us);
+    end_us = monotonic_us();
+    CHECK(ret > 0, "no reply: %d", ret);
+    CHECK(header_us != 0, "header not seen");
+    /* 4 bytes after the header at 1200 baud take 33 ms */
+    CHECK(end_us - header_us >= 20000, "tail %u us after the header",
+            (unsigned)(end_us - header_us));
+    return 0;
+}
+
+/* a request written while a reply is on the wire garbles both */
+static int check_collision(struct lobot_port_t *host, struct lobot_sim_t *sim)
+{
+    const uint8_t move[] = {0x00, 0x00, 0x00, 0x00};
+    uint8_t request[LOBOT_FRAME_LEN_MAX];
+    uint8_t other[LOBOT_FRAME_LEN_MAX];
+    uint8_t reply[LOBOT_FRAME_LEN_MAX];
+    struct lobot_sim_servo servo;
+    struct lobot_sim_stats stats;
+    uint64_t header_us = 0;
+    int len, other_len, ret;
+
+    len = build_frame(1, LOBOT_CMD_POS_READ, NULL, 0, request);
+    other_len = build_frame(2, LOBOT_CMD_MOVE_TIME_WRITE, move, sizeof(move), other);
+    CHECK(lobot_port_write(host, request, len) == len, "write");
+    ret = lobot_port_recv_reply(host, request, reply, len + 2, 5000, on_header, &header_us);
+    CHECK(ret < 0, "reply complete before the collision");
+    CHECK(lobot_port_write(host, other, other_len) == other_len, "write");
+    ret = lobot_port_recv_reply(host, request, reply, len + 2, 200000, NULL, NULL);
+    CHECK(ret < 0, "garbled reply accepted");
+
+    lobot_sim_stats(sim, &stats);
+    CHECK(stats.collisions == 1, "%u collisions", (unsigned)stats.collisions);
+    CHECK(lobot_sim_servo(sim, 2, &servo) == 0, "servo 2");
+    CHECK(servo.target != 0, "garbled request executed");
+    return 0;
+}
+
+/* offset readback saturates instead of wrapping */
+static int check_offset_clamp(struct lobot_port_t *host)
+{
+    uint16_t pos;
+
+    CHECK(lobot_set_pos(host, 1, 0, 0) == LOBOT_OK, "set_pos");
+    CHECK(lobot_set_offset(host, 1, -100) == LOBOT_OK, "set_offset");
+    CHECK(lobot_get_pos(host, 1, &pos) == LOBOT_OK, "get_pos");
+    CHECK(pos == 0, "position %u", (unsigned)pos);
+    return 0;
+}
+
+/* a burst of writes goes on the bus one frame after another */
+static int check_request_paced(struct lobot_port_t *host)
+{
+    struct lobot_port_info info;
+    uint64_t start, airtime_us;
+    uint16_t pos;
+    int i;
+
+    CHECK(lobot_port_info(host, &info) == 0, "info");
+    airtime_us = 20ULL * 10 * info.byte_time_ns / 1000;
+    start = monotonic_us();
+    for (i = 0; i < 20; ++i) {
+        CHECK(lobot_set_pos(host, 1, 500, 0) == LOBOT_OK, "set_pos");
+    }
+    CHECK(lobot_get_pos(host, 1, &pos) == LOBOT_OK, "get_pos");
+    CHECK(monotonic_us() - start >= airtime_us,
+            "20 moves took %u us", (unsigned)(monotonic_us() - start));
+    return 0;
+}
+
+/* echoes of a burst come back whole and in order, none lost */
+static int check_echo_burst(struct lobot_port_t *host, struct lobot_sim_t *sim)
+{
+    uint8_t params[4] = {0};
+    uint8_t request[LOBOT_FRAME_LEN_MAX];
+    uint8_t echo[LOBOT_FRAME_LEN_MAX];
+    struct lobot_sim_stats stats;
+    int i, len, ret;
+
+    for (i = 0; i < 100; ++i) {
+        params[0] = i;
+        len = build_frame(1, LOBOT_CMD_MOVE_TIME_WRITE, params, sizeof(params), request);
+        CHECK(lobot_port_write(host, request, len) == len, "write %d", i);
+    }
+    for (i = 0; i < 100; ++i) {
+        params[0] = i;
+        len = build_frame(1, LOBOT_CMD_MOVE_TIME_WRITE, params, sizeof(params), request);
+        ret = 0;
+        while (ret == 0 && lobot_port_poll(host, 100000) > 0) {
+            ret = lobot_port_recv_frame(host, echo, sizeof(echo));
+        }
+        CHECK(ret == len && memcmp(echo, request, len) == 0, "echo %d: %d", i, ret);
+    }
+    lobot_sim_stats(sim, &stats);
+    CHECK(stats.overflows == 0, "%u overflows", (unsigned)stats.overflows);
+    return 0;
+}
+
+/* stray bytes left on the bus must not keep the simulator spinning */
+static int check_idle(struct lobot_port_t *host)
+{
+    const uint8_t junk[] = {0x55, 0x55};
+    uint64_t cpu;
+
+    CHECK(lobot_port_write(host, junk, sizeof(junk)) == sizeof(junk), "write");
+    cpu = cpu_us();
+    pause_us(200000);
+    cpu = cpu_us() - cpu;
+    CHECK(cpu < 50000, "simulator used %u us of CPU in 200 ms", (unsigned)cpu);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_port_t *ends[2];
+    struct lobot_sim_t *sim;
+    int ret;
+
+    sim = sim_open(ends, 1200, 0);
+    CHECK(sim, "sim");
+    ret = check_paced(ends[0]);
+    if (ret == 0) {
+        ret = check_collision(ends[0], sim);
+    }
+    sim_close(sim, ends);
+    if (ret) {
+        return ret;
+    }
+
+    sim = sim_open(ends, 0, 0);
+    CHECK(sim, "sim");
+    ret = check_offset_clamp(ends[0]);
+    if (ret == 0) {
+        ret = check_request_paced(ends[0]);
+    }
+    if (ret == 0) {
+        ret = check_idle(ends[0]);
+    }
+    sim_close(sim, ends);
+    if (ret) {
+        return ret;
+    }
+
+    sim = sim_open(ends, 0, 1);
+    CHECK(sim, "sim");
+    ret = check_echo_burst(ends[0], sim);
+    sim_close(sim, ends);
+    return ret;
+}
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+/* Pipelined read sweeps against a scripted servo on a loopback pair. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/protocol.h"
+#include "lobot_servo/servo.h"
+
+#include "test_util.h"
+
+/* adapter echo delay, long enough for calibration to allow pipelining */
+#define ECHO_DELAY_US 5000
+/* how long the scripted servo holds the tail of the first reply back */
+#define HOLD_US 100000
+#define HEADER_LEN 4
+
+/* scripted servo: echoes everything, answers ID reads, and answers position
+ * reads with pos_base + id, holding back the tail of servo 1's reply to see
+ * whether the next request is pipelined on its header */
+struct script {
+    struct lobot_port_t *port;
+    int corrupt;                /* send servo 1's reply with a bad checksum */
+    int pipelined;              /* next request arrived during the hold */
+    volatile int running;
+};
+
+/* echo a request and write its reply, if any */
+static void answer(struct script *sc, const uint8_t *request, int len, int hold)
+{
+    uint8_t reply[LOBOT_FRAME_LEN_MAX];
+    uint8_t next[LOBOT_FRAME_LEN_MAX];
+    uint8_t params[2];
+    uint8_t id = request[2];
+    int reply_len, next_len = 0, i;
+
+    pause_us(ECHO_DELAY_US);
+    lobot_port_write(sc->port, request, len);
+    if (request[4] == LOBOT_CMD_ID_READ) {
+        reply_len = build_frame(id, LOBOT_CMD_ID_READ, &id, 1, reply);
+    } else if (request[4] == LOBOT_CMD_POS_READ) {
+        params[0] = 100 + id;
+        params[1] = 0;
+        reply_len = build_frame(id, LOBOT_CMD_POS_READ, params, 2, reply);
+    } else {
+        return;
+    }
+    if (!hold) {
+        lobot_port_write(sc->port, reply, reply_len);
+        return;
+    }
+
+    lobot_port_write(sc->port, reply, HEADER_LEN);
+    for (i = 0; i < HOLD_US / 1000 && next_len <= 0; ++i) {
+        lobot_port_poll(sc->port, 1000);
+        next_len = lobot_port_recv_frame(sc->port, next, sizeof(next));
+    }
+    if (sc->corrupt) {
+        reply[reply_len - 1] ^= 0xFF;
+    }
+    lobot_port_write(sc->port, &reply[HEADER_LEN], reply_len - HEADER_LEN);
+    if (next_len > 0) {
+        sc->pipelined = 1;
+        answer(sc, next, next_len, 0);
+    }
+}
+
+static void* script_thread(void *arg)
+{
+    struct script *sc = arg;
+    uint8_t request[LOBOT_FRAME_LEN_MAX];
+    int len;
+
+    while (sc->running) {
+        lobot_port_poll(sc->port, 10000);
+        while ((len = lobot_port_recv_frame(sc->port, request, sizeof(request))) > 0) {
+            answer(sc, request, len, request[4] == LOBOT_CMD_POS_READ && request[2] == 1);
+        }
+    }
+    return NULL;
+}
+
+/* read servos 1 and 2, servo 1's reply possibly corrupted */
+static int sweep(int calibrate, int corrupt, struct script *sc,
+        uint16_t pos[2], lobot_error_t status[2])
+{
+    const uint8_t ids[] = {1, 2};
+    struct lobot_port_t *ends[2];
+    struct lobot_port_calibration cal;
+    pthread_t thread;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    memset(sc, 0, sizeof(*sc));
+    sc->port = ends[1];
+    sc->corrupt = corrupt;
+    sc->running = 1;
+    CHECK(pthread_create(&thread, NULL, script_thread, sc) == 0, "thread");
+    /* the hold must not time the first read out */
+    lobot_port_set_timeout(ends[0], 4 * HOLD_US);
+
+    if (calibrate) {
+        CHECK(lobot_port_calibrate(ends[0], 2, &cal) == 0, "calibrate");
+        CHECK(cal.echo, "echo not detected");
+        CHECK(lobot_port_get_timeout(ends[0]) == 4 * HOLD_US, "timeout lowered");
+    }
+    pos[0] = pos[1] = 0;
+    lobot_read_positions(ends[0], ids, 2, pos, status);
+
+    sc->running = 0;
+    pthread_join(thread, NULL);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return 0;
+}
+
+int main(void)
+{
+    struct script sc;
+    lobot_error_t status[2];
+    uint16_t pos[2];
+
+    /* timing unknown: no request goes out while a reply is on the wire */
+    CHECK(sweep(0, 0, &sc, pos, status) == 0, "sweep");
+    CHECK(!sc.pipelined, "pipelined on an uncalibrated port");
+    CHECK(status[0] == LOBOT_OK && pos[0] == 101, "servo 1: %d %u", status[0], pos[0]);
+    CHECK(status[1] == LOBOT_OK && pos[1] == 102, "servo 2: %d %u", status[1], pos[1]);
+
+    /* pipelined: a corrupted reply doesn't take the next one down with it */
+    CHECK(sweep(1, 1, &sc, pos, status) == 0, "sweep");
+    CHECK(sc.pipelined, "not pipelined on a calibrated port");
+    CHECK(status[0] != LOBOT_OK, "corrupted reply accepted");
+    CHECK(status[1] == LOBOT_OK && pos[1] == 102, "servo 2: %d %u", status[1], pos[1]);
+    return 0;
+}
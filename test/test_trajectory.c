@@ -0,0 +1,79 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+/* Trajectory executor checks on a loopback pair, driven on a virtual clock. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/trajectory.h"
+
+#include "test_util.h"
+
+static int push_ramp(struct lobot_trajectory_t *traj, uint32_t t_ms)
+{
+    struct lobot_waypoint wp;
+    int i;
+
+    memset(&wp, 0, sizeof(wp));
+    for (i = 0; i <= 4; ++i) {
+        wp.t_ms = t_ms + i * 100;
+        wp.position = 200 + i * 100;
+        CHECK(lobot_trajectory_push(traj, 1, &wp) == 0, "push");
+    }
+    return 0;
+}
+
+/* a stream pushed after the previous one ran out isn't late */
+static int check_restart(struct lobot_trajectory_t *traj)
+{
+    struct lobot_trajectory_status status;
+    uint32_t now;
+
+    CHECK(push_ramp(traj, 0) == 0, "ramp");
+    for (now = 0; now <= 1000; now += 10) {
+        CHECK(lobot_trajectory_update(traj, now) >= 0, "update");
+    }
+    CHECK(lobot_trajectory_status(traj, 1, &status) == 0, "status");
+    CHECK(status.pending == 0, "%u waypoints left", (unsigned)status.pending);
+
+    CHECK(push_ramp(traj, 5000) == 0, "ramp");
+    CHECK(lobot_trajectory_update(traj, 5000) == 1, "update");
+    CHECK(lobot_trajectory_status(traj, 1, &status) == 0, "status");
+    CHECK(status.lag_ms == 0, "lag %u ms", (unsigned)status.lag_ms);
+    return 0;
+}
+
+int main(void)
+{
+    struct lobot_port_t *ends[2];
+    struct lobot_trajectory_t *traj;
+    int ret;
+
+    CHECK(lobot_port_open_loopback(ends, NULL) == 0, "loopback");
+    traj = lobot_trajectory_create(ends[0], NULL);
+    CHECK(traj, "trajectory");
+    CHECK(lobot_trajectory_add_joint(traj, 1, LOBOT_INTERP_LINEAR) == 0, "joint");
+
+    ret = check_restart(traj);
+
+    lobot_trajectory_destroy(traj);
+    lobot_port_close(ends[0]);
+    lobot_port_close(ends[1]);
+    return ret;
+}
@@ -0,0 +1,76 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Helpers shared by the tests. */
+
+#ifndef MOGI_LOBOT__TEST_UTIL_H_
+#define MOGI_LOBOT__TEST_UTIL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include "lobot_servo/protocol.h"
+
+/* fail the calling check, which returns 1, with a message unless cond holds */
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+static inline uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline void pause_us(uint32_t us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+/* encode a single frame into out, room for LOBOT_FRAME_LEN_MAX bytes
+ * @return frame length
+ */
+static inline int build_frame(uint8_t id, uint8_t cmd, const uint8_t *params,
+        uint8_t nparams, uint8_t *out)
+{
+    struct lobot_frame_desc desc;
+
+    desc.id = id;
+    desc.cmd = cmd;
+    desc.nparams = nparams;
+    if (nparams) {
+        memcpy(desc.params, params, nparams);
+    }
+    return lobot_frames_encode(&desc, 1, out, LOBOT_FRAME_LEN_MAX);
+}
+
+#endif
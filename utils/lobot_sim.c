@@ -0,0 +1,195 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "lobot_servo/port.h"
+#include "lobot_servo/sim.h"
+
+#include "parse.h"
+
+#define VERSION_STRING "1.0"
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stdout,
+            "Usage: %s [-i id1[,id2...]] [-b baud] [-t us] [-e] [-c rate] "
+            "[-x rate] [-s seed] [-h] [-v]\n"
+            "\n"
+            "Simulate a bus of LX-15D servos behind a pseudo-terminal, whose "
+            "path is printed on start\n"
+            "\n"
+            "Options:\n"
+            "\t-i|--ids id1[,id2...]         IDs of the simulated servos, default 1\n"
+            "\t-b|--baud baud                Bus baud rate, default 115200\n"
+            "\t-t|--turnaround us            Servo turnaround before replying, default 100\n"
+            "\t-e|--echo                     Echo requests like an adapter without echo cancellation\n"
+            "\t-c|--corrupt rate             Probability [0,1] of a bit error in a reply\n"
+            "\t-x|--drop rate                Probability [0,1] of a reply being lost\n"
+            "\t-s|--seed seed                Random seed for corruption and drops\n"
+            "\n"
+            "\t-v|--version                  Version information\n"
+            "\t-h|--help                     This message\n"
+            "\n"
+            "Examples:\n"
+            "lobot_sim -i 1,2,3 -e\n"
+            "  simulate servos 1 to 3 behind an echoing adapter\n"
+            "LOBOT_DEVICE_PATH=/dev/pts/3 lobot_util pos -i 2\n"
+            "  read position of simulated servo 2\n"
+            , name);
+}
+
+static struct option options[] =
+{
+    {"help", no_argument, 0, 'h'},
+    {"version", no_argument, 0, 'v'},
+
+    {"ids", required_argument, 0, 'i'},
+    {"baud", required_argument, 0, 'b'},
+    {"turnaround", required_argument, 0, 't'},
+    {"echo", no_argument, 0, 'e'},
+    {"corrupt", required_argument, 0, 'c'},
+    {"drop", required_argument, 0, 'x'},
+    {"seed", required_argument, 0, 's'},
+    {0, 0, 0, 0},
+};
+
+static float parse_rate(const char* name, const char* str)
+{
+    char* end;
+    float rate = strtof(str, &end);
+
+    if (end == str || *end != '\0' || rate < 0.0f || rate > 1.0f) {
+        fprintf(stderr, "Error: Invalid rate\n");
+        usage(name);
+        exit(-EINVAL);
+    }
+    return rate;
+}
+
+int main(int argc, char* argv[])
+{
+    struct lobot_port_options port_options;
+    struct lobot_sim_config config = {0};
+    struct lobot_sim_stats stats;
+    struct lobot_port_t* port;
+    struct lobot_sim_t* sim;
+    uint8_t ids[LOBOT_SIM_SERVOS_MAX] = {1};
+    int opt, opt_index = 0;
+    int ret = 0;
+
+    lobot_port_options_init(&port_options);
+    config.ids = ids;
+    config.n = 1;
+    config.reply_delay_us = 100;
+
+    while ((opt = getopt_long(argc, argv, ":i:b:t:ec:x:s:hv",
+                    options, &opt_index)) != -1) {
+        switch (opt) {
+            case 'i':
+                config.n = parse_ids(optarg, ids, LOBOT_SIM_SERVOS_MAX);
+                if (config.n == 0) {
+                    fprintf(stderr, "Error: Servo IDs should be in range of [0, 253]\n");
+                    usage(argv[0]);
+                    exit(-EINVAL);
+                }
+                break;
+            case 'b':
+                port_options.baud = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                config.reply_delay_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                config.echo = 1;
+                break;
+            case 'c':
+                config.corrupt_rate = parse_rate(argv[0], optarg);
+                break;
+            case 'x':
+                config.drop_rate = parse_rate(argv[0], optarg);
+                break;
+            case 's':
+                config.seed = strtoul(optarg, NULL, 10);
+                break;
+            case ':':
+                fprintf(stderr, "Error: Missing argument for option %s\n", argv[optind-1]);
+                usage(argv[0]);
+                exit(-EINVAL);
+            case 'v':
+                fprintf(stdout, "lobot_sim "VERSION_STRING"\n");
+                exit(0);
+            case 'h':
+            default: /* '?' */
+                usage(argv[0]);
+                exit(0);
+        }
+    }
+
+    port = lobot_port_open_transport(&lobot_transport_pty, NULL, NULL,
+            &port_options);
+    if (!port) {
+        fprintf(stderr, "Cannot open pseudo-terminal\n");
+        exit(-ENODEV);
+    }
+
+    sim = lobot_sim_create(port, &config);
+    if (!sim) {
+        fprintf(stderr, "Cannot create simulated bus\n");
+        lobot_port_close(port);
+        exit(-EINVAL);
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    fprintf(stdout, "%s\n", lobot_port_peer(port));
+    fflush(stdout);
+
+    while (running) {
+        ret = lobot_sim_run_once(sim, 100000);
+        if (ret < 0 && ret != -EINTR) {
+            fprintf(stderr, "Bus error: %s\n", strerror(-ret));
+            break;
+        }
+        ret = 0;
+    }
+
+    lobot_sim_stats(sim, &stats);
+    fprintf(stderr, "requests %u, replies %u, dropped %u, corrupted %u, "
+            "collisions %u, overflows %u\n", stats.requests, stats.replies,
+            stats.dropped, stats.corrupted, stats.collisions, stats.overflows);
+
+    lobot_sim_destroy(sim);
+    lobot_port_close(port);
+    return ret;
+}
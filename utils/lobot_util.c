@@ -27,6 +27,9 @@
 
 #include "lobot_servo/servo.h"
 #include "lobot_servo/port.h"
+#include "lobot_servo/recorder.h"
+
+#include "parse.h"
 
 #define VERSION_STRING "1.0"
 
@@ -36,6 +39,7 @@ struct args
 {
     uint8_t id;
     const char* dev_path;
+    const char* file_path;
     const char* command;
     bool write_enable;
     uint16_t write_val1;
@@ -47,6 +51,10 @@ static void func_pos(struct lobot_port_t* port, struct args* args);
 static void func_offset(struct lobot_port_t* port, struct args* args);
 static void func_limit(struct lobot_port_t* port, struct args* args);
 static void func_load(struct lobot_port_t* port, struct args* args);
+static void func_dump(struct lobot_port_t* port, struct args* args);
+static void func_batch(struct lobot_port_t* port, struct args* args);
+static void func_scan(struct lobot_port_t* port, struct args* args);
+static void func_calibrate(struct lobot_port_t* port, struct args* args);
 
 static void usage(const char* name, const char* fmt, ...)
     __attribute__ ((format(printf, 2, 3)));
@@ -55,14 +63,23 @@ static const struct command_table {
     const char* name;
     const char* des;
     void (*func)(struct lobot_port_t* port, struct args* args);
+    bool port;
 } command_table[] = {
-    {"id"    , "Read/Write(-w new_id) servo ID"                      , func_id},
-    {"pos"   , "Read/Write(-w angle,time) servo position"            , func_pos},
-    {"offset", "Read/Write(-w new_offset) servo angle offset"        , func_offset},
-    {"limit" , "Read/Write(-w angle_min,angle_max) servo angle limit", func_limit },
-    {"load"  , "Enable([-w 1])/Disable(-w 0) servo load output"      , func_load },
+    {"id"    , "Read/Write(-w new_id) servo ID"                      , func_id    , true},
+    {"pos"   , "Read/Write(-w angle,time) servo position"            , func_pos   , true},
+    {"offset", "Read/Write(-w new_offset) servo angle offset"        , func_offset, true},
+    {"limit" , "Read/Write(-w angle_min,angle_max) servo angle limit", func_limit , true},
+    {"load"  , "Enable([-w 1])/Disable(-w 0) servo load output"      , func_load  , true},
+    {"scan"  , "Find servos on the bus, only ID(-i id) if given"      , func_scan  , true},
+    {"calibrate", "Measure adapter echo, latency and servo turnaround", func_calibrate, true},
+    {"dump"  , "Print capture file(-f file) of a recorder as CSV"    , func_dump  , false},
+    {"batch" , "Run commands, one per line, from file(-f file) or stdin", func_batch, true},
 };
 
+/* longest line and most words of a batch command */
+#define BATCH_LINE_MAX 256
+#define BATCH_WORDS_MAX 8
+
 static void about(void)
 {
     fprintf(stdout,
@@ -92,6 +109,7 @@ static void more_help(void)
             "\t-i|--id id                    Target servo ID to communicate with, default 254(broadcast)\n"
             "\t-d|--device port              Serial port for Lobot servo, default /dev/tty/USB0\n"
             "\t-w|--write VAL1[,VAL2]        Write VAL1 [and VAL2 if applicable] to command\n"
+            "\t-f|--file path                Capture file for dump, command file for batch\n"
             "\n"
             "\t-v|--version                  Version information\n"
             "\t-h|--help                     This message\n"
@@ -111,6 +129,14 @@ static void more_help(void)
             "  move servo (ID==1) on port /dev/ttyUSB1 to position 20\n"
             "lobot_util -i 1 load -w 0\n"
             "  disable(unload) servo (ID==1) output load\n"
+            "lobot_util scan\n"
+            "  list IDs of all servos on default port /dev/ttyUSB0\n"
+            "lobot_util calibrate -i 1\n"
+            "  probe servo 1 to detect adapter echo and measure latency and turnaround\n"
+            "lobot_util dump -f /tmp/bus.rec > bus.csv\n"
+            "  convert a flight recorder capture to CSV\n"
+            "echo 'pos -i 3 -w 500,100' | lobot_util batch\n"
+            "  run commands over one open port, printing a JSON line per command\n"
            );
 }
 
@@ -125,7 +151,7 @@ static void usage(const char* name, const char* fmt, ...)
         va_end(args);
     }
     fprintf(stdout,
-            "Usage: %s COMMAND [-i id] [-w VAL1[,VAL2] [-d port] [-h] [-v]\n"
+            "Usage: %s COMMAND [-i id] [-w VAL1[,VAL2] [-d port] [-f file] [-h] [-v]\n"
             ,name);
 }
 
@@ -137,15 +163,41 @@ static struct option options[] =
     {"device", required_argument, 0, 'd'},
     {"id", required_argument, 0, 'i'},
     {"write", required_argument, 0, 'w'},
+    {"file", required_argument, 0, 'f'},
+    {0, 0, 0, 0},
 };
 
-static void parse_option(struct args* args, int argc, char* argv[])
+/* parse write values VAL1[,VAL2] and enable write */
+static bool parse_write(const char* str, struct args* args)
 {
-    int opt, opt_index = 0;
     unsigned long temp;
     char* temp_str_end;
 
-    while ((opt = getopt_long(argc, argv, "-:i:d:w:hv",
+    temp = strtoul(str, &temp_str_end, 10);
+    if (temp_str_end == str) {
+        return false;
+    }
+    args->write_val1 = temp;
+    if (*temp_str_end == ',') {
+        str = temp_str_end + 1;
+        temp = strtoul(str, &temp_str_end, 10);
+        if (temp_str_end == str) {
+            return false;
+        }
+        args->write_val2 = temp;
+    }
+    if (*temp_str_end != '\0') {
+        return false;
+    }
+    args->write_enable = true;
+    return true;
+}
+
+static void parse_option(struct args* args, int argc, char* argv[])
+{
+    int opt, opt_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "-:i:d:w:f:hv",
                     options, &opt_index)) != -1) {
         switch (opt) {
             case 1:
@@ -157,38 +209,23 @@ static void parse_option(struct args* args, int argc, char* argv[])
                 args->command = optarg;
                 break;
             case 'i':
-                temp= strtoul(optarg, &temp_str_end, 10);
-                if(temp > 0xFE || temp_str_end == optarg) {
+                if(!parse_id(optarg, LOBOT_ID_BROADCAST, &args->id)) {
                     usage(argv[0], "Servo ID range should be [0,254]");
                     exit(-EINVAL);
                 }
-                args->id = temp;
                 break; 
             case 'w':
-                temp= strtoul(optarg, &temp_str_end, 10);
-                if(temp_str_end == optarg) {
-                    usage(argv[0], "Invalid write value1");
-                    exit(-EINVAL);
-                }
-                args->write_val1 = temp;
-                if(*temp_str_end == ',') {
-                    optarg = temp_str_end+1;
-                    temp= strtoul(optarg, &temp_str_end, 10);
-                    if(temp_str_end == optarg) {
-                        usage(argv[0], "Invalid write value2");
-                        exit(-EINVAL);
-                    }
-                    args->write_val2 = temp;
-                }
-                if (*temp_str_end != '\0') {
+                if(!parse_write(optarg, args)) {
                     usage(argv[0], "Invalid write value(s)");
                     exit(-EINVAL);
                 }
-                args->write_enable = true;
                 break; 
             case 'd':
                 args->dev_path = optarg;
                 break;
+            case 'f':
+                args->file_path = optarg;
+                break;
             case ':':
                 usage(argv[0], "Missing argument for option %s", argv[optind-1]);
                 exit(-EINVAL);
@@ -304,10 +341,350 @@ static void func_load(struct lobot_port_t* port, struct args* args)
     }
 }
 
+static void func_scan(struct lobot_port_t* port, struct args* args)
+{
+    uint8_t found[LOBOT_ID_MAX + 1];
+    size_t n = 0, corrupt = 0, i;
+    lobot_error_t err;
+
+    /* broadcast, the default ID, scans the whole bus */
+    if (args->id == 0xFE) {
+        err = lobot_scan(port, NULL, 0, found, &n, &corrupt);
+    } else {
+        err = lobot_scan(port, &args->id, 1, found, &n, &corrupt);
+    }
+    if (err != LOBOT_OK) {
+        fprintf(stderr, "Error: scan failed (%d)\n", err);
+        return;
+    }
+    if (corrupt) {
+        fprintf(stderr, "Warning: %zu corrupted replies seen, a servo may be missing\n",
+                corrupt);
+    }
+
+    fprintf(stdout, "=>Found %zu servo(s):", n);
+    for (i = 0; i < n; ++i) {
+        fprintf(stdout, "%s%d", i ? "," : " ", found[i]);
+    }
+    fprintf(stdout, "\n");
+}
+
+static void func_calibrate(struct lobot_port_t* port, struct args* args)
+{
+    struct lobot_port_calibration cal;
+    int ret;
+
+    ret = lobot_port_calibrate(port, args->id, &cal);
+    if (ret < 0) {
+        fprintf(stderr, "Error: calibration failed (%d)\n", ret);
+        return;
+    }
+
+    fprintf(stdout, "=>Echo: %s\n", cal.echo ? "yes" : "no");
+    if (cal.echo) {
+        fprintf(stdout, "=>Echo time: %u us\n", cal.echo_us);
+        fprintf(stdout, "=>Latency: %u us\n", cal.latency_us);
+    }
+    if (cal.rtt_us) {
+        fprintf(stdout, "=>Round trip: %u us\n", cal.rtt_us);
+        fprintf(stdout, "=>Turnaround: %u us%s\n", cal.turnaround_us,
+                cal.echo ? "" : " (adapter latency included)");
+        fprintf(stdout, "=>Timeout: %u us\n", lobot_port_get_timeout(port));
+    } else {
+        fprintf(stderr, "Warning: no servo answered\n");
+    }
+}
+
+static void func_dump(struct lobot_port_t* port, struct args* args)
+{
+    static const char* types[] = {"", "tx", "rx", "frame", "sample"};
+    const struct lobot_record_header* header;
+    const struct lobot_record* r;
+    struct lobot_capture_t* cap;
+    size_t i, count;
+    int k;
+
+    (void)port;
+
+    if (!args->file_path) {
+        fprintf(stderr, "Error: dump needs a capture file (-f file)\n");
+        return;
+    }
+    cap = lobot_capture_open(args->file_path);
+    if (!cap) {
+        fprintf(stderr, "Error: Cannot open capture %s\n", args->file_path);
+        return;
+    }
+
+    header = lobot_capture_header(cap);
+    count = lobot_capture_count(cap);
+    fprintf(stdout, "time_ns,type,more,id,cmd,len,payload\n");
+    for (i = 0; i < count; ++i) {
+        r = lobot_capture_get(cap, i);
+        if (!r) {
+            continue;
+        }
+        /* wall clock time, from the offset to the start of the capture */
+        fprintf(stdout, "%lld,%s,%d,%d,%d,%d,",
+                (long long)(header->start_realtime_ns +
+                    (int64_t)(r->timestamp_ns - header->start_monotonic_ns)),
+                r->type < ARRAY_SIZE(types) ? types[r->type] : "?",
+                !!(r->flags & LOBOT_RECORD_MORE), r->id, r->cmd, r->len);
+        for (k = 0; k < r->len && k < LOBOT_RECORD_PAYLOAD; ++k) {
+            fprintf(stdout, "%s%02x", k ? " " : "", r->payload[k]);
+        }
+        fprintf(stdout, "\n");
+    }
+
+    lobot_capture_close(cap);
+}
+
+static const char* batch_status(lobot_error_t err)
+{
+    switch (err) {
+        case LOBOT_OK:
+            return "ok";
+        case LOBOT_BAD_PORT:
+            return "bad_port";
+        case LOBOT_BAD_CHKSUM:
+            return "bad_checksum";
+        case LOBOT_BAD_ARG:
+            return "bad_arg";
+        case LOBOT_BAD_WRITE:
+            return "bad_write";
+        case LOBOT_NO_REPLY:
+            return "no_reply";
+        case LOBOT_TIMEOUT:
+            return "timeout";
+        case LOBOT_NO_MEMORY:
+            return "no_memory";
+        default:
+            return "error";
+    }
+}
+
+/* print the JSON line of a command's result, values are only printed on
+ * success */
+static void batch_result(unsigned line, const struct args* args, lobot_error_t err,
+        const int* values, int nvalues)
+{
+    int k;
+
+    fprintf(stdout, "{\"line\":%u,\"cmd\":\"%s\",\"id\":%d,\"op\":\"%s\",\"status\":\"%s\"",
+            line, args->command, args->id, args->write_enable ? "write" : "read",
+            batch_status(err));
+    if (err == LOBOT_OK && nvalues > 0) {
+        fprintf(stdout, ",\"values\":[");
+        for (k = 0; k < nvalues; ++k) {
+            fprintf(stdout, "%s%d", k ? "," : "", values[k]);
+        }
+        fprintf(stdout, "]");
+    }
+    fprintf(stdout, "}\n");
+}
+
+/* parse a batch line into a command and its arguments
+ * @return NULL on success, otherwise what's wrong with the line
+ */
+static const char* batch_parse(char* text, struct args* args)
+{
+    char* words[BATCH_WORDS_MAX];
+    int nwords = 0, i, num = ARRAY_SIZE(command_table);
+    char* word;
+
+    for (word = strtok(text, " \t\r\n"); word; word = strtok(NULL, " \t\r\n")) {
+        if (nwords == BATCH_WORDS_MAX) {
+            return "too many words";
+        }
+        words[nwords++] = word;
+    }
+
+    for (i = 0; i < num; ++i) {
+        if (strcmp(command_table[i].name, words[0]) == 0) {
+            break;
+        }
+    }
+    if (i == num || !command_table[i].port || command_table[i].func == func_batch) {
+        return "unrecognized command";
+    }
+    args->command = command_table[i].name;
+
+    for (i = 1; i < nwords; i += 2) {
+        if (i + 1 == nwords) {
+            return "missing option argument";
+        }
+        if (strcmp(words[i], "-i") == 0 || strcmp(words[i], "--id") == 0) {
+            if (!parse_id(words[i + 1], LOBOT_ID_BROADCAST, &args->id)) {
+                return "servo ID range should be [0,254]";
+            }
+        } else if (strcmp(words[i], "-w") == 0 || strcmp(words[i], "--write") == 0) {
+            if (!parse_write(words[i + 1], args)) {
+                return "invalid write value(s)";
+            }
+        } else {
+            return "unrecognized option";
+        }
+    }
+    return NULL;
+}
+
+/* run a single command, filling values with what was read or written */
+static lobot_error_t batch_exec(struct lobot_port_t* port, struct args* args,
+        int* values, int* nvalues)
+{
+    const char* cmd = args->command;
+    uint16_t u1 = 0, u2 = 0;
+    uint8_t u8 = 0;
+    int8_t s8 = 0;
+    lobot_error_t err;
+
+    *nvalues = 0;
+    if (strcmp(cmd, "id") == 0) {
+        if (args->write_enable) {
+            if (args->write_val1 > 0xFE) {
+                return LOBOT_BAD_ARG;
+            }
+            err = lobot_set_id(port, args->id, args->write_val1);
+            u8 = args->write_val1;
+        } else {
+            err = lobot_get_id(port, args->id, &u8);
+        }
+        values[(*nvalues)++] = u8;
+    } else if (strcmp(cmd, "pos") == 0) {
+        if (args->write_enable) {
+            err = lobot_set_pos(port, args->id, args->write_val1, args->write_val2);
+            values[(*nvalues)++] = args->write_val1;
+            values[(*nvalues)++] = args->write_val2;
+        } else {
+            err = lobot_get_pos(port, args->id, &u1);
+            values[(*nvalues)++] = u1;
+        }
+    } else if (strcmp(cmd, "offset") == 0) {
+        if (args->write_enable) {
+            s8 = (int8_t)args->write_val1;
+            err = lobot_set_offset(port, args->id, s8);
+        } else {
+            err = lobot_get_offset(port, args->id, &s8);
+        }
+        values[(*nvalues)++] = s8;
+    } else if (strcmp(cmd, "limit") == 0) {
+        if (args->write_enable) {
+            u1 = args->write_val1;
+            u2 = args->write_val2;
+            err = lobot_set_limit(port, args->id, u1, u2);
+        } else {
+            err = lobot_get_limit(port, args->id, &u1, &u2);
+        }
+        values[(*nvalues)++] = u1;
+        values[(*nvalues)++] = u2;
+    } else if (strcmp(cmd, "load") == 0) {
+        /* like the command, load is enabled unless -w 0 is given */
+        u8 = !args->write_enable || args->write_val1 != 0;
+        err = lobot_set_load(port, args->id, u8);
+        values[(*nvalues)++] = u8;
+    } else {
+        err = LOBOT_BAD_ARG;
+    }
+    return err;
+}
+
+/* read the positions of queued pos reads in one pipelined sweep */
+static void batch_flush_pos(struct lobot_port_t* port, const struct args* queued,
+        const unsigned* lines, size_t n)
+{
+    uint8_t ids[LOBOT_ID_MAX + 1] = {0};
+    uint16_t pos[LOBOT_ID_MAX + 1];
+    lobot_error_t status[LOBOT_ID_MAX + 1];
+    size_t i;
+    int value;
+
+    if (n == 0) {
+        return;
+    }
+    for (i = 0; i < n; ++i) {
+        ids[i] = queued[i].id;
+    }
+    lobot_read_positions(port, ids, n, pos, status);
+    for (i = 0; i < n; ++i) {
+        /* positions of failed reads are left untouched, and not printed */
+        value = status[i] == LOBOT_OK ? pos[i] : 0;
+        batch_result(lines[i], &queued[i], status[i], &value, 1);
+    }
+}
+
+static void func_batch(struct lobot_port_t* port, struct args* args)
+{
+    static struct args queued[LOBOT_ID_MAX + 1];
+    static unsigned queued_lines[LOBOT_ID_MAX + 1];
+    char text[BATCH_LINE_MAX];
+    struct args line_args;
+    const char* error;
+    unsigned line = 0;
+    size_t nqueued = 0;
+    int values[2], nvalues;
+    lobot_error_t err;
+    bool pos_read;
+    char* comment;
+    FILE* in = stdin;
+
+    if (args->file_path && strcmp(args->file_path, "-") != 0) {
+        in = fopen(args->file_path, "r");
+        if (!in) {
+            fprintf(stderr, "Error: Cannot open %s\n", args->file_path);
+            return;
+        }
+    }
+
+    while (fgets(text, sizeof(text), in)) {
+        line++;
+        comment = strchr(text, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        if (strspn(text, " \t\r\n") == strlen(text)) {
+            continue;
+        }
+
+        /* ID given to batch itself is the default of every line */
+        memset(&line_args, 0, sizeof(line_args));
+        line_args.id = args->id;
+        line_args.dev_path = args->dev_path;
+        error = batch_parse(text, &line_args);
+        if (error) {
+            fprintf(stdout, "{\"line\":%u,\"status\":\"parse_error\",\"error\":\"%s\"}\n",
+                    line, error);
+            continue;
+        }
+
+        /* consecutive position reads go out together, pipelined */
+        pos_read = strcmp(line_args.command, "pos") == 0 && !line_args.write_enable;
+        if (nqueued && (!pos_read || nqueued == ARRAY_SIZE(queued))) {
+            batch_flush_pos(port, queued, queued_lines, nqueued);
+            nqueued = 0;
+        }
+        if (pos_read) {
+            queued[nqueued] = line_args;
+            queued_lines[nqueued++] = line;
+            continue;
+        }
+
+        err = batch_exec(port, &line_args, values, &nvalues);
+        batch_result(line, &line_args, err, values, nvalues);
+        fflush(stdout);
+    }
+    if (nqueued) {
+        batch_flush_pos(port, queued, queued_lines, nqueued);
+    }
+    fflush(stdout);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+}
 
 int main(int argc, char* argv[])
 {
-    struct lobot_port_t* port;
+    struct lobot_port_t* port = NULL;
     struct args args = {0};
     int num = ARRAY_SIZE(command_table);
     int index;
@@ -328,16 +705,6 @@ int main(int argc, char* argv[])
         exit(-EINVAL);
     }
 
-    printf("\nDev:%s\nWrite:%d\nCMD:%s\nID:%#x\nValues:%d,%d\n",
-            args.dev_path, args.write_enable,
-            args.command, args.id, args.write_val1, args.write_val2);
-
-    port = lobot_port_open(args.dev_path);
-    if(!port) {
-        fprintf(stderr, "Cannot open port %s\n", args.dev_path);
-        exit(-ENODEV);
-    }
-
     for (index = 0; index < num; ++index) {
         if (strncmp(command_table[index].name, args.command,
                     strlen(command_table[index].name)) == 0) {
@@ -351,6 +718,21 @@ int main(int argc, char* argv[])
         goto out;
     }
 
+    if (command_table[index].port) {
+        /* batch output is machine readable, keep the banner out of it */
+        if (command_table[index].func != func_batch) {
+            printf("\nDev:%s\nWrite:%d\nCMD:%s\nID:%#x\nValues:%d,%d\n",
+                    args.dev_path, args.write_enable,
+                    args.command, args.id, args.write_val1, args.write_val2);
+        }
+
+        port = lobot_port_open(args.dev_path);
+        if(!port) {
+            fprintf(stderr, "Cannot open port %s\n", args.dev_path);
+            exit(-ENODEV);
+        }
+    }
+
     command_table[index].func(port, &args);
 out:
     lobot_port_close(port);
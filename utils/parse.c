@@ -0,0 +1,56 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lobot_servo/servo.h"
+
+#include "parse.h"
+
+bool parse_id(const char* str, uint8_t max, uint8_t* id)
+{
+    unsigned long temp;
+    char* end;
+
+    temp = strtoul(str, &end, 10);
+    if (temp > max || end == str || *end != '\0') {
+        return false;
+    }
+    *id = temp;
+    return true;
+}
+
+size_t parse_ids(const char* str, uint8_t* ids, size_t max)
+{
+    unsigned long temp;
+    char* end;
+    size_t n = 0;
+
+    do {
+        temp = strtoul(str, &end, 10);
+        if (end == str || temp > LOBOT_ID_MAX || n == max) {
+            return 0;
+        }
+        ids[n++] = temp;
+        str = end + 1;
+    } while (*end == ',');
+
+    return *end == '\0' ? n : 0;
+}
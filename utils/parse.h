@@ -0,0 +1,43 @@
+/******************************************************************************
+ * Copyright 2021 Mogi LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************/
+
+/* Argument parsing shared by the command line tools. */
+
+#ifndef MOGI_LOBOT__UTILS_PARSE_H_
+#define MOGI_LOBOT__UTILS_PARSE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* parse a servo ID
+ * @param str Decimal ID, nothing else
+ * @param max Largest ID accepted, e.g. LOBOT_ID_BROADCAST
+ * @param id Output ID
+ * @return true on success
+ */
+bool parse_id(const char* str, uint8_t max, uint8_t* id);
+
+/* parse a comma separated list of servo IDs, each in range [0, LOBOT_ID_MAX]
+ * @param str List, e.g. "1,2,3"
+ * @param ids Output IDs, room for max
+ * @param max Largest number of IDs accepted
+ * @return number of IDs, 0 if str isn't such a list
+ */
+size_t parse_ids(const char* str, uint8_t* ids, size_t max);
+
+#endif